@@ -0,0 +1,350 @@
+/*
+  ota-bench.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host benchmarks of the OTA hot paths: Intel Hex sizing and decoding,
+  packed image decoding, filesystem round trips and firmware upload
+  chunking. The inputs are the .hex files of SIM_WEB_ROOT (with their .timg
+  packed images, if any) plus synthetic images from 1 KB to 64 KB.
+  Every result is printed as one JSON object per line on stdout.
+  ----------------------------------------------------------------------------
+*/
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "host-sim.h"
+#include "timonel-twim-ota.h"
+
+#define BENCH_FILE "/bench.hex"  // Filesystem round trip file
+#define BENCH_MIN_ITERATIONS 3   // Iterations of every benchmark, at least
+
+// ----------------------------------------------------------------------------
+// Heap accounting: every operator new goes through here
+// ----------------------------------------------------------------------------
+
+struct HeapStats {
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+    uint64_t live_bytes;
+    uint64_t peak_bytes;
+};
+
+static HeapStats heap_stats;
+
+// Block header keeping the size, padded to keep the alignment of the block
+union HeapHeader {
+    size_t size;
+    max_align_t align;
+};
+
+// Kept out of line, otherwise the compiler matches the free() below against the caller's new
+__attribute__((noinline)) void *operator new(size_t size) {
+    HeapHeader *p_header = (HeapHeader *)malloc(sizeof(HeapHeader) + size);
+    if (p_header == nullptr) {
+        throw std::bad_alloc();
+    }
+    p_header->size = size;
+    heap_stats.allocations++;
+    heap_stats.allocated_bytes += size;
+    heap_stats.live_bytes += size;
+    heap_stats.peak_bytes = max(heap_stats.peak_bytes, heap_stats.live_bytes);
+    return p_header + 1;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete(void *p_block) noexcept {
+    if (p_block != nullptr) {
+        HeapHeader *p_header = (HeapHeader *)((char *)p_block - sizeof(HeapHeader));
+        heap_stats.live_bytes -= p_header->size;
+        free(p_header);
+    }
+}
+
+void operator delete[](void *p_block) noexcept {
+    operator delete(p_block);
+}
+
+void operator delete(void *p_block, size_t size) noexcept {
+    (void)size;
+    operator delete(p_block);
+}
+
+void operator delete[](void *p_block, size_t size) noexcept {
+    (void)size;
+    operator delete(p_block);
+}
+
+// ----------------------------------------------------------------------------
+// Benchmark runner
+// ----------------------------------------------------------------------------
+
+struct BenchInput {
+    std::string name;
+    String hex_text;
+    std::vector<uint8_t> payload;  // Decoded image
+    std::vector<uint8_t> packed;   // Packed image file, empty if there is none
+};
+
+// Result of one benchmark, measured over all its iterations
+struct BenchResult {
+    uint32_t iterations;
+    double host_ns;           // Host time per iteration
+    double allocations;       // Heap allocations per iteration
+    double allocated_bytes;   // Heap bytes allocated per iteration
+    uint64_t peak_heap;       // Largest heap growth above the starting point
+    uint64_t sim_us;          // Simulated time per iteration (device side cost), 0 if none
+};
+
+typedef uint32_t (*BenchFunction)(BenchInput *p_input);
+
+static long bench_min_ms = 200;
+
+// Function RunBench
+// Repeats the function for BENCH_MIN_MS of host time, with BENCH_MIN_ITERATIONS at least
+static BenchResult RunBench(BenchFunction bench_function, BenchInput *p_input, uint32_t *p_output) {
+    BenchResult result = {};
+    uint64_t heap_start = heap_stats.live_bytes;
+    heap_stats.peak_bytes = heap_start;
+    uint64_t allocations = heap_stats.allocations;
+    uint64_t allocated_bytes = heap_stats.allocated_bytes;
+    uint64_t sim_start = SimNow();
+    auto host_start = std::chrono::steady_clock::now();
+    double elapsed_ns = 0;
+    do {
+        *p_output = bench_function(p_input);
+        result.iterations++;
+        elapsed_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - host_start).count();
+    } while ((result.iterations < BENCH_MIN_ITERATIONS) || (elapsed_ns < bench_min_ms * 1e6));
+    result.host_ns = elapsed_ns / result.iterations;
+    result.allocations = (double)(heap_stats.allocations - allocations) / result.iterations;
+    result.allocated_bytes = (double)(heap_stats.allocated_bytes - allocated_bytes) / result.iterations;
+    result.peak_heap = heap_stats.peak_bytes - heap_start;
+    result.sim_us = (SimNow() - sim_start) / result.iterations;
+    return result;
+}
+
+// Function PrintResult (one JSON object per line, throughput computed over the input bytes)
+static void PrintResult(const char bench_name[], BenchInput *p_input, size_t input_bytes, BenchResult *p_result, uint32_t output) {
+    printf("{\"bench\":\"%s\",\"input\":\"%s\",\"input_bytes\":%zu,\"iterations\":%u,"
+           "\"ns_per_op\":%.1f,\"bytes_per_s\":%.0f,\"allocs_per_op\":%.2f,\"alloc_bytes_per_op\":%.0f,"
+           "\"peak_heap_bytes\":%llu,\"output\":%u",
+           bench_name, p_input->name.c_str(), input_bytes, p_result->iterations,
+           p_result->host_ns, input_bytes * 1e9 / p_result->host_ns, p_result->allocations, p_result->allocated_bytes,
+           (unsigned long long)p_result->peak_heap, output);
+    if (p_result->sim_us > 0) {
+        printf(",\"sim_us_per_op\":%llu,\"sim_bytes_per_s\":%.0f",
+               (unsigned long long)p_result->sim_us, input_bytes * 1e6 / p_result->sim_us);
+    }
+    printf("}\n");
+}
+
+// Function PrintSkipped
+static void PrintSkipped(const char bench_name[], BenchInput *p_input, size_t input_bytes, const char reason[]) {
+    printf("{\"bench\":\"%s\",\"input\":\"%s\",\"input_bytes\":%zu,\"skipped\":\"%s\"}\n",
+           bench_name, p_input->name.c_str(), input_bytes, reason);
+}
+
+// ----------------------------------------------------------------------------
+// Inputs
+// ----------------------------------------------------------------------------
+
+// Function MakeSyntheticHex
+// Pseudo-random image of "size" bytes in 16-byte data records, like avr-gcc output
+static String MakeSyntheticHex(uint32_t size) {
+    std::string hex_text;
+    uint32_t seed = size;
+    for (uint32_t address = 0; address < size; address += 16) {
+        uint8_t byte_count = (uint8_t)min((uint32_t)16, size - address);
+        uint8_t record_check = byte_count + (uint8_t)(address >> 8) + (uint8_t)address;
+        char field[16];
+        snprintf(field, sizeof(field), ":%02X%04X00", byte_count, (uint16_t)address);
+        hex_text += field;
+        for (uint8_t ix = 0; ix < byte_count; ix++) {
+            seed = seed * 1103515245 + 12345;
+            uint8_t data = (uint8_t)(seed >> 16);
+            record_check += data;
+            snprintf(field, sizeof(field), "%02X", data);
+            hex_text += field;
+        }
+        snprintf(field, sizeof(field), "%02X\r\n", (uint8_t)(0x100 - record_check));
+        hex_text += field;
+    }
+    hex_text += ":00000001FF\r\n";
+    return String(hex_text);
+}
+
+// Function AddInput
+static void AddInput(std::vector<BenchInput> *p_inputs, std::string name, String hex_text) {
+    BenchInput input;
+    input.name = name;
+    input.hex_text = hex_text;
+    size_t payload_size = 0;
+    HexParser hex_parser;
+    hex_parser.DecodeIHex(hex_text.c_str(), hex_text.length(), nullptr, 0, &payload_size);
+    input.payload.assign(payload_size, 0xFF);
+    hex_parser.DecodeIHex(hex_text.c_str(), hex_text.length(), input.payload.data(), payload_size, &payload_size);
+    p_inputs->push_back(input);
+}
+
+// Function LoadInputs (the .hex files of SIM_WEB_ROOT in name order, then the synthetic images)
+static void LoadInputs(std::vector<BenchInput> *p_inputs) {
+    std::string web_root = SimEnvString("SIM_WEB_ROOT", "../fw-attiny85");
+    std::vector<std::string> file_names;
+    DIR *p_dir = opendir(web_root.c_str());
+    if (p_dir != nullptr) {
+        struct dirent *p_entry;
+        while ((p_entry = readdir(p_dir)) != nullptr) {
+            std::string file_name = p_entry->d_name;
+            if ((file_name.size() > 4) && (file_name.compare(file_name.size() - 4, 4, ".hex") == 0)) {
+                file_names.push_back(file_name);
+            }
+        }
+        closedir(p_dir);
+    }
+    std::sort(file_names.begin(), file_names.end());
+    for (const std::string &file_name : file_names) {
+        std::string hex_text;
+        FILE *p_file = fopen((web_root + "/" + file_name).c_str(), "rb");
+        if (p_file != nullptr) {
+            int c;
+            while ((c = fgetc(p_file)) != EOF) {
+                hex_text += (char)c;
+            }
+            fclose(p_file);
+            AddInput(p_inputs, file_name, String(hex_text));
+        }
+        p_file = fopen((web_root + "/" + file_name.substr(0, file_name.size() - 4) + FW_PACKED_EXT).c_str(), "rb");
+        if (p_file != nullptr) {
+            int c;
+            while ((c = fgetc(p_file)) != EOF) {
+                p_inputs->back().packed.push_back(c);
+            }
+            fclose(p_file);
+        }
+    }
+    for (uint32_t size_kb = 1; size_kb <= 64; size_kb <<= 1) {
+        AddInput(p_inputs, "synthetic-" + std::to_string(size_kb) + "k", MakeSyntheticHex(size_kb * 1024));
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Benchmarks (each returns a value that depends on the work done)
+// ----------------------------------------------------------------------------
+
+// Function BenchGetIHexSize
+static uint32_t BenchGetIHexSize(BenchInput *p_input) {
+    return GetIHexSize(p_input->hex_text);
+}
+
+// Function BenchParseIHexFormat (the payload is sized with GetIHexSize, as the callers do)
+static uint32_t BenchParseIHexFormat(BenchInput *p_input) {
+    uint16_t payload_size = GetIHexSize(p_input->hex_text);
+    uint8_t *payload = new uint8_t[payload_size];
+    bool errors = ParseIHexFormat(p_input->hex_text, payload, payload_size);
+    delete[] payload;
+    return errors ? 0 : payload_size;
+}
+
+// Function CountDecodedData (data handler that only adds up the bytes)
+static void CountDecodedData(uint32_t address, const uint8_t *data, uint8_t length, void *context) {
+    (void)address;
+    (void)data;
+    *(uint32_t *)context += length;
+}
+
+// Function BenchHsDecoder (packed payload fed in network-sized chunks, as FwImageStream does)
+static uint32_t BenchHsDecoder(BenchInput *p_input) {
+    const FwImageHeader *p_header = (const FwImageHeader *)p_input->packed.data();
+    const uint8_t *p_payload = p_input->packed.data() + sizeof(FwImageHeader);
+    uint32_t decoded_size = 0;
+    HsDecoder decoder;
+    decoder.BeginStream(p_header->window_bits, p_header->lookahead_bits, CountDecodedData, &decoded_size);
+    for (size_t offset = 0; offset < p_header->payload_size; offset += IHEX_STREAM_CHUNK) {
+        decoder.FeedStream(&p_payload[offset], min((size_t)IHEX_STREAM_CHUNK, p_header->payload_size - offset));
+    }
+    return (decoder.EndStream() == 0) ? decoded_size : 0;
+}
+
+// Function BenchFileRoundTrip
+static uint32_t BenchFileRoundTrip(BenchInput *p_input) {
+    WriteFile(BENCH_FILE, p_input->hex_text);
+    return ReadFile(BENCH_FILE).length();
+}
+
+// Function BenchUploadBuffered (whole image in one UploadApplication call, as BufferFirmware does)
+static uint32_t BenchUploadBuffered(BenchInput *p_input) {
+    Timonel timonel(SIM_TML_ADDR, SDA, SCL);
+    return (timonel.UploadApplication(p_input->payload.data(), p_input->payload.size()) == 0) ? p_input->payload.size() : 0;
+}
+
+// Function BenchUploadPipelined (hex stream fed in network-sized chunks into the page uploader)
+static uint32_t BenchUploadPipelined(BenchInput *p_input) {
+    Timonel timonel(SIM_TML_ADDR, SDA, SCL);
+    PageUploader page_uploader(&timonel);
+    HexParser hex_parser;
+    hex_parser.BeginStream(PageUploader::DataHandler, &page_uploader);
+    const uint8_t *p_text = (const uint8_t *)p_input->hex_text.c_str();
+    size_t text_len = p_input->hex_text.length();
+    for (size_t offset = 0; (offset < text_len) && !hex_parser.StreamComplete(); offset += IHEX_STREAM_CHUNK) {
+        hex_parser.FeedStream(&p_text[offset], min((size_t)IHEX_STREAM_CHUNK, text_len - offset));
+    }
+    uint8_t errors = hex_parser.EndStream() + page_uploader.Finish();
+    return (errors == 0) ? page_uploader.GetPageCount() : 0;
+}
+
+// Host entry point
+int main(void) {
+    setvbuf(stdout, nullptr, _IOFBF, 1 << 16);
+    bench_min_ms = SimEnvLong("BENCH_MIN_MS", bench_min_ms);
+    SimBeginFs();
+    SimBeginTwi();
+    fs_session.Mount();
+    // The slave stays in the bootloader, every upload overwrites the previous one
+    SimGetSlave(0)->in_bootloader = true;
+    std::vector<BenchInput> inputs;
+    LoadInputs(&inputs);
+    uint32_t output = 0;
+    for (BenchInput &input : inputs) {
+        size_t text_len = input.hex_text.length();
+        BenchResult result;
+        if (input.payload.size() > UINT16_MAX) {
+            PrintSkipped("GetIHexSize", &input, text_len, "image larger than the GetIHexSize range");
+            PrintSkipped("ParseIHexFormat", &input, text_len, "image larger than the GetIHexSize range");
+        } else {
+            result = RunBench(BenchGetIHexSize, &input, &output);
+            PrintResult("GetIHexSize", &input, text_len, &result, output);
+            result = RunBench(BenchParseIHexFormat, &input, &output);
+            PrintResult("ParseIHexFormat", &input, text_len, &result, output);
+        }
+        if (input.packed.size() > sizeof(FwImageHeader)) {
+            result = RunBench(BenchHsDecoder, &input, &output);
+            PrintResult("HsDecoder", &input, input.packed.size() - sizeof(FwImageHeader), &result, output);
+        } else {
+            PrintSkipped("HsDecoder", &input, 0, "no packed image");
+        }
+        result = RunBench(BenchFileRoundTrip, &input, &output);
+        PrintResult("WriteFile+ReadFile", &input, text_len, &result, output);
+        if (input.payload.size() > SIM_TML_START) {
+            PrintSkipped("UploadApplication", &input, input.payload.size(), "image larger than the slave application flash");
+            PrintSkipped("PageUploader", &input, input.payload.size(), "image larger than the slave application flash");
+            continue;
+        }
+        result = RunBench(BenchUploadBuffered, &input, &output);
+        PrintResult("UploadApplication", &input, input.payload.size(), &result, output);
+        result = RunBench(BenchUploadPipelined, &input, &output);
+        PrintResult("PageUploader", &input, input.payload.size(), &result, output);
+    }
+    fs_session.Remove(BENCH_FILE);
+    fflush(stdout);
+    return 0;
+}
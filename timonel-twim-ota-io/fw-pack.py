@@ -0,0 +1,137 @@
+# Packs an Intel Hex firmware file for the compressed transport: the decoded
+# binary, heatshrink-compressed, after a firmware image header (the layout of
+# FwImageHeader in include/fw-image.h). The device flashes it as it streams
+# in and caches it as is. Publish it next to the .hex file, which stays as
+# the fallback for devices that don't take packed images:
+#
+#   python fw-pack.py ../fw-attiny85/firmware-1.2.0.hex
+#
+# writes ../fw-attiny85/firmware-1.2.0.timg, the version is taken from the
+# file name unless given as a second argument. With --release, the release
+# manifest the devices check for updates (fw-manifest.md, in the same folder)
+# is written too, along with the plain version document older devices check
+# (fw-latest.md), so publishing them releases that version:
+#
+#   python fw-pack.py --release ../fw-attiny85/firmware-1.2.0.hex
+
+import os
+import re
+import struct
+import sys
+import zlib
+
+FW_IMAGE_MAGIC = 0x474D4954  # "TIMG"
+FW_IMAGE_FORMAT = 1
+FW_IMAGE_HEATSHRINK = 1
+FW_IMAGE_VER_LEN = 16
+FW_MANIFEST_NAME = "fw-manifest.md"
+FW_LATEST_NAME = "fw-latest.md"  # Version only, no trailing newline
+WINDOW_BITS = 8              # Must not exceed HS_WINDOW_BITS_MAX on the device
+LOOKAHEAD_BITS = 4
+
+
+def parse_ihex(file_name):
+    data = {}
+    record_count = 0
+    base_address = 0
+    for line in open(file_name):
+        line = line.strip()
+        if not line.startswith(":"):
+            continue
+        record = bytes.fromhex(line[1:])
+        if sum(record) & 0xFF:
+            sys.exit("%s: checksum error in record %s" % (file_name, line))
+        length, address, record_type = record[0], (record[1] << 8) | record[2], record[3]
+        if record_type == 0x00:
+            record_count += 1
+            for ix in range(length):
+                data[base_address + address + ix] = record[4 + ix]
+        elif record_type == 0x01:
+            break
+        elif record_type == 0x02:
+            base_address = ((record[4] << 8) | record[5]) << 4
+        elif record_type == 0x04:
+            base_address = ((record[4] << 8) | record[5]) << 16
+    if not data:
+        sys.exit("%s: no data records" % file_name)
+    low_address, high_address = min(data), max(data) + 1
+    # Gaps are erased flash
+    return low_address, bytes(data.get(address, 0xFF) for address in range(low_address, high_address)), record_count
+
+
+def write_manifest(file_name, version, load_address, binary, record_count):
+    # Size and CRC32 leave out the trailing erased bytes, as the device does (see FwDigest)
+    firmware = binary.rstrip(b"\xff")
+    with open(file_name, "w") as manifest_file:
+        manifest_file.write("version=%s\naddress=0x%04X\nsize=%d\nrecords=%d\ncrc32=0x%08X\n" %
+                            (version, load_address, len(firmware), record_count, zlib.crc32(firmware) & 0xFFFFFFFF))
+
+
+def heatshrink_encode(data, window_bits, lookahead_bits):
+    bits = []
+    window_size, max_length = 1 << window_bits, 1 << lookahead_bits
+    # A back reference only pays off when it replaces more literal bits than it takes
+    min_length = (1 + window_bits + lookahead_bits) // 9 + 1
+
+    def put(value, bit_count):
+        bits.extend((value >> shift) & 1 for shift in range(bit_count - 1, -1, -1))
+
+    ix = 0
+    while ix < len(data):
+        best_length, best_distance = 0, 0
+        for start in range(max(0, ix - window_size), ix):
+            length = 0
+            while length < max_length and ix + length < len(data) and data[start + length] == data[ix + length]:
+                length += 1
+            if length > best_length:
+                best_length, best_distance = length, ix - start
+        if best_length >= min_length:
+            put(0, 1)
+            put(best_distance - 1, window_bits)
+            put(best_length - 1, lookahead_bits)
+            ix += best_length
+        else:
+            put(1, 1)
+            put(data[ix], 8)
+            ix += 1
+    bits.extend([0] * (-len(bits) % 8))
+    return bytes(int("".join(map(str, bits[ix:ix + 8])), 2) for ix in range(0, len(bits), 8))
+
+
+def main():
+    args = sys.argv[1:]
+    release = "--release" in args
+    if release:
+        args.remove("--release")
+    if len(args) < 1:
+        sys.exit("usage: python fw-pack.py [--release] firmware-x.y.z.hex [version]")
+    hex_name = args[0]
+    if len(args) > 1:
+        version = args[1]
+    else:
+        match = re.search(r"firmware-(.+)\.hex$", os.path.basename(hex_name))
+        if match is None:
+            sys.exit("%s: no version in the file name, pass it as the second argument" % hex_name)
+        version = match.group(1)
+    if len(version) >= FW_IMAGE_VER_LEN:
+        sys.exit("version \"%s\" too long" % version)
+    load_address, binary, record_count = parse_ihex(hex_name)
+    payload = heatshrink_encode(binary, WINDOW_BITS, LOOKAHEAD_BITS)
+    header = struct.pack("<IBBBB16sIII", FW_IMAGE_MAGIC, FW_IMAGE_FORMAT, FW_IMAGE_HEATSHRINK,
+                         WINDOW_BITS, LOOKAHEAD_BITS, version.encode(), len(payload), load_address,
+                         zlib.crc32(payload) & 0xFFFFFFFF)
+    image_name = os.path.splitext(hex_name)[0] + ".timg"
+    with open(image_name, "wb") as image_file:
+        image_file.write(header + payload)
+    print("%s: %d hex bytes, %d firmware bytes, %d packed (%d with the header)" %
+          (image_name, os.path.getsize(hex_name), len(binary), len(payload), len(header) + len(payload)))
+    if release:
+        manifest_name = os.path.join(os.path.dirname(hex_name), FW_MANIFEST_NAME)
+        write_manifest(manifest_name, version, load_address, binary, record_count)
+        with open(os.path.join(os.path.dirname(hex_name), FW_LATEST_NAME), "w") as latest_file:
+            latest_file.write(version)
+        print("%s: firmware %s released" % (manifest_name, version))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,42 @@
+/*
+  block-reader.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Buffered file reader: a Stream that fetches a file in large blocks, so the
+  hex parser and the image code can consume it with a few flash reads.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _BLOCK_READER_H_
+#define _BLOCK_READER_H_
+
+#include <Arduino.h>
+#include <FS.h>
+
+#define FS_BLOCK_SIZE 256  // Bytes fetched from flash per file access
+
+class BlockReader : public Stream {
+   public:
+    BlockReader(File &file, uint8_t buffer[], size_t buffer_size);
+    int available(void) override;
+    int read(void) override;
+    int peek(void) override;
+    size_t readBytes(char *buffer, size_t length) override;
+    size_t write(uint8_t data) override;
+    using Stream::readBytes;
+    using Print::write;
+    size_t ReadBlock(uint8_t data[], size_t length);
+    uint32_t GetFlashReads(void);
+
+   private:
+    bool Refill(void);
+    File &file_;
+    uint8_t *buffer_;
+    size_t buffer_size_;
+    size_t buffer_len_ = 0;     // Valid bytes in the buffer
+    size_t buffer_ix_ = 0;      // Next byte to hand out
+    uint32_t flash_reads_ = 0;  // File reads done so far
+};
+
+#endif  // _BLOCK_READER_H_
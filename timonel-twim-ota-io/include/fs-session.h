@@ -0,0 +1,56 @@
+/*
+  fs-session.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Filesystem session: the filesystem is mounted once and stays mounted, and
+  the small state files (firmware versions, retry counters) are kept in RAM
+  with write-through, so deciding whether to update touches no flash.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _FS_SESSION_H_
+#define _FS_SESSION_H_
+
+#include <Arduino.h>
+#include <FS.h>
+#include <LittleFS.h>
+
+#include "block-reader.h"
+
+#define OTA_FS LittleFS       // Filesystem holding the firmware images and state files
+#define FS_CACHE_SLOTS 8      // State files that can be cached
+#define FS_CACHE_MAX_LEN 64   // Longest state file kept in RAM
+
+class FsSession {
+   public:
+    bool Mount(void);
+    void Unmount(void);
+    bool CacheFile(const char file_name[]);
+    bool Exists(const char file_name[]);
+    String ReadFile(const char file_name[]);
+    bool WriteFile(const char file_name[], const String file_data);
+    size_t ReadBlock(const char file_name[], uint8_t buffer[], size_t capacity, uint32_t offset = 0);
+    bool WriteBlock(const char file_name[], const uint8_t data[], size_t length, bool append = false);
+    bool Remove(const char file_name[]);
+    bool Rename(const char source_file_name[], const char destination_file_name[]);
+    bool Format(void);
+
+   private:
+    // Cached state file, "loaded" is false until its content (or absence) is known
+    struct CacheEntry {
+        const char *file_name = nullptr;
+        bool loaded = false;
+        bool exists = false;
+        String data = "";
+    };
+    CacheEntry *FindEntry(const char file_name[]);
+    bool LoadEntry(CacheEntry *p_entry);
+    void ReadString(File &file, String *p_data);
+    bool mounted_ = false;
+    CacheEntry cache_[FS_CACHE_SLOTS];
+};
+
+extern FsSession fs_session;
+
+#endif  // _FS_SESSION_H_
@@ -0,0 +1,111 @@
+/*
+  fw-image.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Pre-parsed firmware image files: the decoded payload of an Intel Hex file
+  is saved once, after its first successful parse, so any later update
+  attempt streams it from flash instead. A packed image (the
+  payload heatshrink-compressed, see fw-pack.py) is downloaded as it is and
+  kept that way, it is decoded on the fly whenever it is read.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _FW_IMAGE_H_
+#define _FW_IMAGE_H_
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include "fs-session.h"
+#include "hs-decoder.h"
+#include "ihex-parser.h"
+#include "ota-arena.h"
+
+#define FW_IMAGE_MAGIC 0x474D4954  // "TIMG" stored little-endian
+#define FW_IMAGE_FORMAT 1          // Image header layout version
+#define FW_IMAGE_VER_LEN 16        // Firmware version string space, including the terminator
+#define FW_IMAGE_CHUNK 64          // Payload bytes handed to the data handler at a time when streaming an image
+
+// Payload encodings
+#define FW_IMAGE_RAW 0         // Firmware bytes as they are flashed
+#define FW_IMAGE_HEATSHRINK 1  // Heatshrink-compressed firmware bytes
+
+// Image file errors
+#define FW_IMAGE_OK 0          // Image saved or loaded successfully
+#define FW_IMAGE_ERR_FS 1      // File system or file access error
+#define FW_IMAGE_ERR_HEADER 2  // Not an image file or unknown format
+#define FW_IMAGE_ERR_SIZE 3    // Payload too big for the buffer or truncated file
+#define FW_IMAGE_ERR_CRC 4     // Payload CRC32 mismatch
+#define FW_IMAGE_ERR_MEMORY 6  // No room left in the OTA arena to decode the payload
+
+// Image file header, followed by payload_size bytes of firmware
+struct FwImageHeader {
+    uint32_t magic;                   // FW_IMAGE_MAGIC
+    uint8_t format;                   // FW_IMAGE_FORMAT
+    uint8_t encoding;                 // FW_IMAGE_RAW (zero in the first images) or FW_IMAGE_HEATSHRINK
+    uint8_t window_bits;              // Heatshrink parameters of a packed payload, zero otherwise
+    uint8_t lookahead_bits;
+    char version[FW_IMAGE_VER_LEN];   // Firmware version, e.g. "1.2.0"
+    uint32_t payload_size;            // Payload bytes following the header, as stored
+    uint32_t load_address;            // Target flash address of the first firmware byte
+    uint32_t crc32;                   // CRC32 of the payload, as stored
+};
+
+uint32_t Crc32(const uint8_t data[], size_t length, uint32_t crc = 0);
+bool FwImageHeaderValid(const FwImageHeader *p_header);
+uint8_t OpenFwImage(const char file_name[], File *p_file, FwImageHeader *p_header);
+uint8_t ReadFwImageHeader(const char file_name[], FwImageHeader *p_header);
+uint8_t CopyFwImage(const char source_file_name[], const char destination_file_name[], FwImageHeader *p_header);
+uint8_t StreamFwImage(const char file_name[],
+                      String *p_version,
+                      IHexDataHandler data_handler,
+                      void *context);
+
+// Writes an image whose payload arrives piece by piece, the header is completed on Finish()
+class FwImageWriter {
+   public:
+    FwImageWriter();
+    ~FwImageWriter();
+    uint8_t Begin(const char file_name[], const String version, uint8_t encoding = FW_IMAGE_RAW, uint8_t window_bits = 0, uint8_t lookahead_bits = 0);
+    uint8_t Append(uint32_t address, const uint8_t data[], size_t length);
+    uint8_t Finish(bool keep_image);
+    uint32_t GetCrc32(void);
+    static void DataHandler(uint32_t address, const uint8_t *data, uint8_t length, void *context);
+
+   private:
+    FwImageHeader header_;
+    File file_;
+    const char *file_name_ = nullptr;
+    uint8_t errors_ = FW_IMAGE_OK;
+};
+
+// Receives a packed image file piece by piece, as it is downloaded: the payload is decoded on
+// the fly for the data handler, and the file is saved as it arrives, kept only if it is intact.
+// The decoder is in the OTA arena from BeginStream() to EndStream().
+class FwImageStream {
+   public:
+    void BeginStream(const char file_name[], const String version, IHexDataHandler data_handler, void *context = nullptr);
+    size_t FeedStream(const uint8_t *chunk, size_t chunk_len);
+    bool StreamComplete(void);
+    uint8_t EndStream(void);
+    uint32_t GetStreamDataSize(void);
+    uint32_t GetCrc32(void);
+
+   private:
+    void FeedPayload(const uint8_t *data, size_t length);
+    FwImageHeader header_;
+    size_t header_len_ = 0;         // Header bytes received so far
+    uint32_t payload_len_ = 0;      // Payload bytes received so far
+    const char *file_name_ = nullptr;
+    String version_ = "";           // Version the image must carry
+    IHexDataHandler data_handler_ = nullptr;
+    void *handler_context_ = nullptr;
+    uint32_t data_size_ = 0;        // Firmware bytes handed to the data handler
+    FwImageWriter image_writer_;
+    HsDecoder *p_decoder_ = nullptr;  // In the OTA arena
+    size_t arena_mark_ = 0;           // Arena mark before the decoder was allocated
+    uint8_t errors_ = FW_IMAGE_OK;
+};
+
+#endif  // _FW_IMAGE_H_
@@ -0,0 +1,64 @@
+/*
+  fw-manifest.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Release manifest: the document published with each firmware release (see
+  fw-pack.py) tells its version, load address, size, Intel Hex data record
+  count and CRC32. The size sets the update buffers exactly, and the digest
+  of the firmware, taken as it streams in, is checked against the manifest
+  before the slave application is deleted.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _FW_MANIFEST_H_
+#define _FW_MANIFEST_H_
+
+#include <Arduino.h>
+
+#include "fw-image.h"
+#include "ihex-parser.h"
+
+#define FW_MANIFEST_BLANK 0xFF  // Erased flash byte, gaps and trailing blank bytes are not part of the firmware size
+
+// Firmware release, as published: "key=value" lines, an older version document is just the version
+struct FwManifest {
+    String version = "";        // Firmware version, e.g. "1.2.0"
+    uint32_t load_address = 0;  // Target flash address of the first firmware byte
+    uint32_t size = 0;          // Firmware bytes, from the load address to the last one that isn't blank
+    uint16_t records = 0;       // Data records of the Intel Hex file, zero if not published
+    uint32_t crc32 = 0;         // CRC32 of the firmware bytes counted in size, gaps taken as blank
+    bool complete = false;      // Size and CRC32 given, the firmware can be checked
+};
+
+bool ParseFwManifest(const String document, FwManifest *p_manifest);
+
+// Digest of the firmware as it is decoded, in address order, forwarded to another data handler
+// on the way. Gaps are forwarded filled with blank bytes, so the target gets a contiguous payload.
+class FwDigest {
+   public:
+    void Begin(uint32_t size_limit, IHexDataHandler data_handler = nullptr, void *context = nullptr);
+    void Update(uint32_t address, const uint8_t data[], uint8_t length);
+    bool Matches(const FwManifest *p_manifest);
+    uint32_t GetSize(void);
+    uint32_t GetCrc32(void);
+    uint16_t GetRecordCount(void);
+    static void DataHandler(uint32_t address, const uint8_t *data, uint8_t length, void *context);
+
+   private:
+    void ForwardGap(uint32_t address, uint32_t length);
+    void HashBlank(void);
+    IHexDataHandler data_handler_ = nullptr;
+    void *handler_context_ = nullptr;
+    uint32_t size_limit_ = 0;     // Firmware bytes accepted past the load address
+    uint32_t load_address_ = 0;
+    uint32_t next_address_ = 0;   // Address following the last byte received
+    uint32_t size_ = 0;           // Bytes in the digest, up to the last one that isn't blank
+    uint32_t blank_count_ = 0;    // Blank bytes received after those, not in the digest yet
+    uint32_t crc32_ = 0;
+    uint16_t record_count_ = 0;   // Data handler calls, the data records when fed by a HexParser
+    bool started_ = false;
+    bool invalid_ = false;        // Data went backwards or past the size limit, the digest is not valid
+};
+
+#endif  // _FW_MANIFEST_H_
@@ -0,0 +1,73 @@
+/*
+  fw-store.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Firmware image store: every image flashed successfully is also kept in a
+  file named after its digest (the payload CRC32), tagged with its version.
+  Going back to a stored version, or flashing it to a replaced slave, needs
+  no download. The least recently used images are evicted to stay within
+  FW_STORE_ENTRIES images and FW_STORE_BUDGET bytes of flash.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _FW_STORE_H_
+#define _FW_STORE_H_
+
+#include <Arduino.h>
+
+#include "fs-session.h"
+#include "fw-image.h"
+
+#define FW_STORE_INDEX "/fw-store.bin"  // Store index, binary
+#define FW_STORE_FILE "/fw-%08x.img"    // Stored image, named after its digest
+#define FW_STORE_NAME_LEN 20            // Stored image file name space, including the terminator
+#define FW_STORE_MAGIC 0x5346           // "FS" stored little-endian
+#define FW_STORE_ERR_MISSING 5          // No stored image of that version (image file errors otherwise)
+
+#ifndef FW_STORE_ENTRIES
+#define FW_STORE_ENTRIES 8              // Images kept at most
+#endif  // FW_STORE_ENTRIES
+
+#ifndef FW_STORE_BUDGET
+#define FW_STORE_BUDGET 32768UL         // Flash bytes the stored image files may take
+#endif  // FW_STORE_BUDGET
+
+// Stored image
+struct FwStoreEntry {
+    uint32_t digest;                  // Payload CRC32 of the image, as stored
+    uint32_t file_size;               // Image file bytes, header included
+    uint32_t last_used;               // Store use count when the image was last added or restored
+    char version[FW_IMAGE_VER_LEN];   // Firmware version of the image
+};
+
+class FwStore {
+   public:
+    FwStore();
+    bool Load(void);
+    uint8_t Add(const char file_name[]);
+    uint8_t Restore(const String version, const char file_name[], uint32_t *p_digest);
+    uint8_t GetEntryCount(void);
+    uint32_t GetUsedBytes(void);
+
+   private:
+    // Index, as stored in flash
+    struct StoreIndex {
+        uint16_t magic;        // FW_STORE_MAGIC
+        uint8_t entry_count;
+        uint8_t reserved;      // Zero
+        uint32_t use_count;    // Grows by one with each add or restore, it orders the entries by use
+        FwStoreEntry entries[FW_STORE_ENTRIES];
+        uint32_t crc32;        // CRC32 of all the fields above
+    };
+    bool Save(void);
+    int8_t FindDigest(uint32_t digest);
+    int8_t FindVersion(const String version);
+    void RemoveEntry(uint8_t entry_ix);
+    void GetFileName(uint32_t digest, char file_name[]);
+    StoreIndex index_;
+};
+
+extern FwStore fw_store;
+
+#endif  // _FW_STORE_H_
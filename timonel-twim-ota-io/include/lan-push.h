@@ -0,0 +1,73 @@
+/*
+  lan-push.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  LAN push updates: a plain HTTP endpoint, advertised over mDNS, that takes
+  a firmware image POSTed from the local network. The request is read here,
+  the image itself goes through the same checks and flash path as a web
+  download. With the release manifest fields sent as headers, it is checked
+  against them too:
+
+    curl --data-binary @firmware-1.2.0.timg -H "X-Firmware-Version: 1.2.0" \
+         -H "X-Firmware-Size: 850" -H "X-Firmware-Crc32: 0x2AE3E67C" \
+         http://timonel-ota.local/update
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _LAN_PUSH_H_
+#define _LAN_PUSH_H_
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266mDNS.h>
+
+#include "fw-manifest.h"
+
+#ifndef LAN_PUSH_HOST
+#define LAN_PUSH_HOST "timonel-ota"   // mDNS host name, the endpoint is at http://timonel-ota.local/update
+#endif  // LAN_PUSH_HOST
+#ifndef LAN_PUSH_PORT
+#define LAN_PUSH_PORT 80
+#endif  // LAN_PUSH_PORT
+#ifndef LAN_PUSH_TOKEN
+#define LAN_PUSH_TOKEN ""             // Value the X-Push-Token header must carry, empty for none
+#endif  // LAN_PUSH_TOKEN
+#define LAN_PUSH_PATH "/update"
+#define LAN_PUSH_SERVICE "timonel-ota"  // mDNS service, "_timonel-ota._tcp"
+#define LAN_PUSH_HEADER_PREFIX "X-Firmware-"  // Release manifest fields sent as headers, e.g. X-Firmware-Version
+#define LAN_PUSH_TIMEOUT 2000         // Longest wait for the request headers (ms)
+
+// HTTP status codes of the replies
+#define HTTP_STATUS_ACCEPTED 202
+#define HTTP_STATUS_BAD_REQUEST 400
+#define HTTP_STATUS_FORBIDDEN 403
+#define HTTP_STATUS_NOT_ALLOWED 405
+#define HTTP_STATUS_UNPROCESSABLE 422
+#define HTTP_STATUS_UNAVAILABLE 503
+
+// Request received by the endpoint, the client is left at the start of the body
+struct LanPushRequest {
+    String method = "";
+    String path = "";
+    uint32_t content_length = 0;
+    bool authorized = false;   // X-Push-Token matches LAN_PUSH_TOKEN (always, with no token set)
+    String manifest_text = ""; // X-Firmware-* headers, as "key=value" lines for ParseFwManifest()
+};
+
+class LanPush {
+   public:
+    LanPush(uint16_t port);
+    bool Begin(const char host_name[]);
+    bool Accept(WiFiClient *p_client, LanPushRequest *p_request);
+    void Reply(WiFiClient &client, int status, const String text);
+    bool Running(void);
+
+   private:
+    WiFiServer server_;
+    bool running_ = false;
+};
+
+extern LanPush lan_push;
+
+#endif  // _LAN_PUSH_H_
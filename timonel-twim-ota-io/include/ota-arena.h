@@ -0,0 +1,52 @@
+/*
+  ota-arena.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Update memory arena: the firmware page pool, the decoders and the transfer
+  chunks of an update come from one buffer reserved at build time, instead
+  of the heap. Allocation only moves a mark forward, a scope gives back what
+  it took by releasing to the mark it started at, and every update run
+  resets the arena. Running out of it is an error of the update, never a
+  failed heap allocation somewhere else after days of uptime.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _OTA_ARENA_H_
+#define _OTA_ARENA_H_
+
+#include <Arduino.h>
+
+#include <new>
+
+#define OTA_ARENA_ALIGN alignof(max_align_t)  // Every allocation starts at this alignment
+
+class OtaArena {
+   public:
+    OtaArena(uint8_t pool[], size_t pool_size);
+    void Reset(void);
+    void *Allocate(size_t size);
+    size_t GetMark(void);
+    void Release(size_t mark);
+    size_t GetSize(void);
+    size_t GetPeak(void);
+    uint8_t GetFailures(void);
+    // Constructs an object in the arena, nullptr if it doesn't fit. Its destructor is never
+    // called, so only types with nothing to clean up (no File, no String) belong here.
+    template <typename T>
+    T *New(void) {
+        void *p_memory = Allocate(sizeof(T));
+        return (p_memory != nullptr) ? new (p_memory) T : nullptr;
+    }
+
+   private:
+    uint8_t *pool_;
+    size_t pool_size_;
+    size_t used_ = 0;      // Allocation mark, bytes from the start of the pool
+    size_t peak_ = 0;      // Highest mark since the last reset
+    uint8_t failures_ = 0; // Allocations refused since the last reset
+};
+
+extern OtaArena ota_arena;
+
+#endif  // _OTA_ARENA_H_
@@ -0,0 +1,100 @@
+/*
+  ota-log.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Console log: messages are formatted into a RAM ring buffer and drained to
+  the serial port only as fast as its transmit FIFO takes them, from loop()
+  and after every message, so logging never waits for the UART. Each
+  message has a level, and the levels above OTA_LOG_LEVEL (a build flag)
+  are compiled out: their arguments are still checked, never evaluated.
+  With OTA_LOG_NONE nothing is left.
+  When the buffer is full, messages are dropped and counted instead.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _OTA_LOG_H_
+#define _OTA_LOG_H_
+
+#include <Arduino.h>
+
+// Log levels
+#define OTA_LOG_NONE 0
+#define OTA_LOG_ERROR 1  // The update, or a part of it, failed
+#define OTA_LOG_WARN 2   // Something went wrong, the update goes on
+#define OTA_LOG_INFO 3   // Update progress, the console output by default
+#define OTA_LOG_DEBUG 4  // Diagnostics: requests, file operations
+
+#ifndef OTA_LOG_LEVEL
+#define OTA_LOG_LEVEL OTA_LOG_INFO  // Most detailed level built in
+#endif  // OTA_LOG_LEVEL
+
+#ifndef OTA_LOG_BUFFER
+#define OTA_LOG_BUFFER 2048  // Ring buffer bytes, about a second of console output at 115200 bps
+#endif  // OTA_LOG_BUFFER
+
+#define OTA_LOG_LINE 192  // Longest message, longer ones are cut
+
+// A message compiled out, no code is generated for it
+#define OTA_LOG_UNUSED(format, ...)          \
+    do {                                     \
+        if (0) {                             \
+            ::printf(format, ##__VA_ARGS__); \
+        }                                    \
+    } while (0)
+
+#if OTA_LOG_LEVEL >= OTA_LOG_ERROR
+#define LOG_ERROR(format, ...) ota_log.Printf(PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...) OTA_LOG_UNUSED(format, ##__VA_ARGS__)
+#endif  // OTA_LOG_ERROR
+
+#if OTA_LOG_LEVEL >= OTA_LOG_WARN
+#define LOG_WARN(format, ...) ota_log.Printf(PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_WARN(format, ...) OTA_LOG_UNUSED(format, ##__VA_ARGS__)
+#endif  // OTA_LOG_WARN
+
+#if OTA_LOG_LEVEL >= OTA_LOG_INFO
+#define LOG_INFO(format, ...) ota_log.Printf(PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) OTA_LOG_UNUSED(format, ##__VA_ARGS__)
+#endif  // OTA_LOG_INFO
+
+#if OTA_LOG_LEVEL >= OTA_LOG_DEBUG
+#define LOG_DEBUG(format, ...) ota_log.Printf(PSTR(format), ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) OTA_LOG_UNUSED(format, ##__VA_ARGS__)
+#endif  // OTA_LOG_DEBUG
+
+#if OTA_LOG_LEVEL > OTA_LOG_NONE
+
+class OtaLog {
+   public:
+    OtaLog(HardwareSerial *p_serial);
+    void Printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void Drain(void);
+    void Flush(void);
+    uint32_t GetDropped(void);
+
+   private:
+    void Put(const char text[], size_t length);
+    HardwareSerial *p_serial_;
+    char buffer_[OTA_LOG_BUFFER];
+    size_t head_ = 0;           // Next byte to write
+    size_t tail_ = 0;           // Next byte to send
+    size_t count_ = 0;          // Bytes waiting to be sent
+    uint32_t dropped_ = 0;      // Messages that found the buffer full, since startup
+    uint32_t unreported_ = 0;   // Of them, not reported on the console yet
+};
+
+extern OtaLog ota_log;
+
+#define LOG_DRAIN() ota_log.Drain()
+#define LOG_FLUSH() ota_log.Flush()
+#else
+#define LOG_DRAIN() do {} while (0)
+#define LOG_FLUSH() do {} while (0)
+#endif  // OTA_LOG_LEVEL > OTA_LOG_NONE
+
+#endif  // _OTA_LOG_H_
@@ -0,0 +1,104 @@
+/*
+  ota-timing.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Update latency instrumentation: the update path is split in timed spans
+  (WiFi association, TLS connection, response headers and body, parsing,
+  slave erase, page uploads, application start). The last spans are kept in
+  a ring buffer, and every span adds to a duration histogram of its phase.
+  The histograms are saved in the filesystem, so they add up across restarts,
+  and both can be dumped as JSON.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _OTA_TIMING_H_
+#define _OTA_TIMING_H_
+
+#include <Arduino.h>
+
+#include "fs-session.h"
+
+#define TIMING_FILE "/ota-timing.bin"    // Histograms, binary
+#define TIMING_JSON "/ota-timing.json"   // Last JSON dump
+#define TIMING_MAGIC 0x544F              // "OT" stored little-endian
+#define TIMING_RING_SIZE 32              // Most recent spans kept in RAM
+#define TIMING_BUCKETS 16                // Histogram buckets per phase
+#define TIMING_BUCKET_US 256             // Upper bound of the first bucket, each next one doubles it
+#define TIMING_SAVE_INTERVAL 3600000UL   // Shortest time between saves while idle (ms)
+
+// Timed phases of an update
+enum TimingPhase : uint8_t {
+    TIMING_WIFI,     // WiFi association
+    TIMING_TLS,      // TCP connection and TLS handshake
+    TIMING_HEADERS,  // Request sent until the end of the response headers
+    TIMING_BODY,     // Response body download, parsing and flashing excluded
+    TIMING_PARSE,    // Intel Hex or packed image decoding, flashing excluded
+    TIMING_ERASE,    // Slave application deletion, until the bootloader answers again
+    TIMING_PAGE,     // One upload call to one slave, up to UPLOAD_CHUNK_PAGES pages
+    TIMING_UPLOAD,   // Whole image sent (buffered mode), page uploads excluded
+    TIMING_RUN,      // Bootloader exit
+    TIMING_PHASES
+};
+
+// Span being timed. Its time excludes the spans that end while it runs, so
+// nested phases are never counted twice. It can be paused and resumed.
+struct TimingSpan {
+    TimingPhase phase;
+    bool running;
+    uint32_t begin_ms;     // millis() at Begin
+    uint32_t resume_us;    // micros() at the last Begin or Resume
+    uint32_t nested_mark;  // Nested time total at the last Begin or Resume
+    uint32_t self_us;      // Time accumulated until the last Pause
+};
+
+class OtaTiming {
+   public:
+    OtaTiming();
+    bool Load(void);
+    bool Save(void);
+    bool SaveIfDue(void);
+    void Clear(void);
+    void Begin(TimingSpan *p_span, TimingPhase phase);
+    void Pause(TimingSpan *p_span);
+    void Resume(TimingSpan *p_span);
+    void End(TimingSpan *p_span);
+    void Record(TimingPhase phase, uint32_t begin_ms, uint32_t duration_us);
+    void WriteJson(Print &output);
+    bool SaveJson(const char file_name[]);
+
+   private:
+    // Durations of a phase, since the histograms were cleared
+    struct PhaseHistogram {
+        uint32_t count;
+        uint32_t max_us;
+        uint64_t total_us;
+        uint16_t buckets[TIMING_BUCKETS];  // Saturating counts
+    };
+    // Histograms, as stored in flash
+    struct TimingStore {
+        uint16_t magic;        // TIMING_MAGIC
+        uint8_t phase_count;   // TIMING_PHASES
+        uint8_t bucket_count;  // TIMING_BUCKETS
+        uint32_t reserved;     // Zero
+        PhaseHistogram phases[TIMING_PHASES];
+        uint32_t crc32;        // CRC32 of all the fields above
+    };
+    // Span in the ring buffer
+    struct TimingEntry {
+        uint32_t begin_ms;
+        uint32_t duration_us;
+        TimingPhase phase;
+    };
+    TimingStore store_;
+    TimingEntry ring_[TIMING_RING_SIZE];
+    uint8_t ring_ix_ = 0;         // Next entry to write
+    uint8_t ring_count_ = 0;
+    uint32_t nested_us_ = 0;      // Time of every span paused or ended so far
+    uint32_t save_ms_ = 0;        // millis() at the last save
+    bool dirty_ = false;          // Spans recorded since the last save
+};
+
+extern OtaTiming ota_timing;
+
+#endif  // _OTA_TIMING_H_
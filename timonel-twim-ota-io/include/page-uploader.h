@@ -0,0 +1,152 @@
+/*
+  page-uploader.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Pipelined flashing: decoded firmware data is gathered into ATtiny85
+  flash-page buffers, and every page is sent to the Timonel bootloader as
+  soon as it is complete, while the rest of the image is still arriving.
+  With a base image set, pages identical to the ones already on the slave
+  are skipped (delta flashing), without one the slave is erased and blank
+  pages are skipped. Several slaves can share one uploader: each page goes
+  to all of them packet by packet, and they all program it at once, every
+  slave being waited for only before its next page. The uploader also
+  tracks how far the slave flash is confirmed to hold the image, so a
+  failed upload can resume from there. A single slave gets the pages to
+  write in runs of up to UPLOAD_CHUNK_PAGES per upload call, a shorter run
+  goes out when the download has no more data ready. Pages are sent in
+  write packets of the largest size the bootloader takes. The bus runs
+  at TWI_UPLOAD_CLOCK, a failed write lowers the clock and the run length
+  of that slave before it is tried again, so well-wired slaves flash at
+  full speed and marginal ones still get their firmware.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _PAGE_UPLOADER_H_
+#define _PAGE_UPLOADER_H_
+
+#include <Arduino.h>
+#include <TimonelTwiM.h>
+#include <Wire.h>
+
+#include "fw-image.h"
+#include "ota-arena.h"
+#include "ota-timing.h"
+
+#define TML_PAGE_SIZE 64      // ATtiny85 flash page size (SPM_PAGESIZE)
+#define PAGE_UPLOAD_TRIES 2   // Attempts to write the same pages, with the link at its slowest, before giving up on them
+#define MAX_UPLOAD_TARGETS 8  // Slaves that can be flashed at once by a single uploader
+#define CONFIRM_INTERVAL 16   // Pages confirmed between two calls to the confirm handler
+#define TWI_BASE_CLOCK 100000UL  // Standard-mode: the slowest upload clock, set back once the upload ends
+#define TML_PACKET_SIZE MST_PACKET_SIZE  // Page data bytes per write packet, the size TimonelTwiM and the bootloader are built with
+#define TML_PACKET_GAP_US 250    // Least time between two packets to a slave, while it stores the first one
+#define TML_WRITE_POLL_US 500    // Interval between two probes of a slave programming a page
+#define TML_PAGE_TIMEOUT 30      // Most time a slave takes to erase and program a page (ms)
+
+// Write packets are the largest the bootloader takes: a whole number per page, each one a single
+// TWI transaction (command, data and checksum) within the bus buffer
+#if (TML_PAGE_SIZE % TML_PACKET_SIZE) != 0
+#error "The Timonel write packet size must divide the flash page size"
+#endif
+#if (1 + TML_PACKET_SIZE + 1) > BUFFER_LENGTH
+#error "A Timonel write packet doesn't fit in the TWI buffer"
+#endif
+
+#ifndef TWI_UPLOAD_CLOCK
+#define TWI_UPLOAD_CLOCK 400000UL  // Bus clock the writes start at (Fast-mode), halved on each failed write
+#endif  // TWI_UPLOAD_CLOCK
+
+#ifndef UPLOAD_CHUNK_PAGES
+#define UPLOAD_CHUNK_PAGES 8  // Most pages per upload call, halved on each failed write (buffered in the OTA arena)
+#endif  // UPLOAD_CHUNK_PAGES
+
+// Handler called as the confirmed part of the slave flash grows, with the address it ends at
+typedef void (*FlashConfirmHandler)(uint32_t confirmed_end, void *context);
+
+class PageUploader {
+   public:
+    PageUploader(Timonel *p_timonel, FwImageWriter *p_image_writer = nullptr);
+    PageUploader(Timonel *p_timonels[], uint8_t target_count, FwImageWriter *p_image_writer = nullptr);
+    ~PageUploader();
+    void Write(uint32_t address, const uint8_t data[], uint16_t length);
+    uint8_t SetBaseImage(const char file_name[]);
+    void SetImageWriter(FwImageWriter *p_image_writer);
+    void SetResumeAddress(uint32_t resume_address);
+    void SetConfirmHandler(FlashConfirmHandler confirm_handler, void *context = nullptr);
+    void SendPending(void);
+    uint8_t Finish(void);
+    uint16_t GetPageCount(void);
+    uint16_t GetSkippedCount(void);
+    uint16_t GetResumedCount(void);
+    uint32_t GetConfirmedEnd(void);
+    uint8_t GetTargetErrors(uint8_t target_ix);
+    uint32_t GetTargetRate(uint8_t target_ix);
+    uint32_t GetTargetClock(uint8_t target_ix);
+    uint8_t GetTargetChunk(uint8_t target_ix);
+    static void DataHandler(uint32_t address, const uint8_t *data, uint8_t length, void *context);
+    static void IdleHandler(void *context);
+
+   private:
+    // Upload link to one slave, as fast as it proved to cope with
+    struct TargetLink {
+        uint32_t clock;       // Bus clock of its writes (Hz)
+        uint8_t chunk_pages;  // Most pages per upload call
+        uint32_t bytes;       // Page bytes written
+        uint32_t busy_us;     // Time taken by its successful upload calls and page rounds
+        unsigned long packet_us;  // When its last write packet went out
+    };
+    void OpenPage(uint32_t page_address);
+    void FlushPage(uint8_t buffer_ix);
+    void SendChunk(void);
+    bool WriteChunk(uint8_t target_ix, uint8_t first_page, uint8_t end_page);
+    void BroadcastPage(uint8_t page_ix);
+    bool SetPageAddress(uint8_t target_ix, uint32_t address);
+    bool WritePacket(uint8_t target_ix, const uint8_t data[]);
+    bool WaitReady(uint8_t target_ix);
+    bool SlowDown(uint8_t target_ix);
+    void ConfirmPages(uint32_t address, uint8_t page_count);
+    bool PageUnchanged(uint8_t buffer_ix);
+    bool ReadPackedBase(uint8_t data[], size_t length);
+    void CloseBaseImage(void);
+    // Decoding state of a packed base image, its pages are looked up in ascending order
+    struct PackedBase {
+        HsDecoder decoder;
+        uint8_t input[FW_IMAGE_CHUNK];
+        const uint8_t *p_input;  // Next input byte not yet decoded
+        size_t input_len;
+        uint32_t stored_left;    // Payload bytes not yet read from the file
+        uint32_t address;        // Address of the next decoded byte
+    };
+    Timonel *p_timonels_[MAX_UPLOAD_TARGETS];
+    uint8_t target_errors_[MAX_UPLOAD_TARGETS];
+    TargetLink links_[MAX_UPLOAD_TARGETS];
+    uint8_t target_count_ = 0;
+    FwImageWriter *p_image_writer_;
+    uint8_t page_buffer_[2][TML_PAGE_SIZE];  // One page is filled while the other waits to go to the slave
+    uint8_t *p_chunk_buffer_ = nullptr;      // Pages to write in one call, in the OTA arena (none: one page per call)
+    const uint8_t *p_chunk_ = nullptr;       // First page of the run waiting to be written
+    uint32_t chunk_address_ = 0;
+    uint8_t chunk_pages_ = 0;
+    uint8_t chunk_capacity_ = 1;
+    size_t chunk_arena_mark_ = 0;            // Arena mark before the chunk buffer was allocated
+    uint32_t page_address_[2] = {0, 0};
+    uint8_t fill_ix_ = 0;
+    bool page_open_ = false;
+    bool page_pending_ = false;
+    uint16_t page_count_ = 0;
+    uint16_t skipped_count_ = 0;
+    uint16_t resumed_count_ = 0;
+    uint32_t resume_address_ = 0;   // Pages below it are already on the slave, from a failed attempt
+    bool skip_blank_ = true;        // The slave was erased, blank pages need no write
+    uint32_t confirmed_end_ = 0;    // Every page from the first one up to here is on all the slaves
+    uint8_t unreported_pages_ = 0;  // Pages confirmed since the confirm handler was last called
+    FlashConfirmHandler confirm_handler_ = nullptr;
+    void *confirm_context_ = nullptr;
+    File base_file_;            // Image currently on the slave, for delta flashing
+    FwImageHeader base_header_;
+    PackedBase *p_packed_base_ = nullptr;  // Only with a packed base image, in the OTA arena
+    size_t base_arena_mark_ = 0;           // Arena mark before the packed base was allocated
+    bool out_of_order_ = false;  // Data went backwards, some of it was dropped
+};
+
+#endif  // _PAGE_UPLOADER_H_
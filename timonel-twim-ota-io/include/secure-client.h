@@ -0,0 +1,54 @@
+/*
+  secure-client.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Reusable TLS client for the update requests: the session of the last
+  connection is kept, so the next ones resume it with an abbreviated
+  handshake, and once the server has been found to support a smaller max
+  fragment length, the BearSSL buffers shrink from ~17 KB to ~1.4 KB. Every
+  connection reports its handshake time and buffer sizes.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _SECURE_CLIENT_H_
+#define _SECURE_CLIENT_H_
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+
+#ifndef TLS_FRAGMENT_LEN
+#define TLS_FRAGMENT_LEN 512     // Max fragment length asked for: 512, 1024, 2048 or 4096
+#endif  // TLS_FRAGMENT_LEN
+#define TLS_DEFAULT_RX_LEN 16384 // Record payload BearSSL buffers without a negotiated fragment length
+#define TLS_DEFAULT_TX_LEN 512
+#define TLS_RX_OVERHEAD 325      // Record header, MAC and padding room BearSSL adds to each buffer
+#define TLS_TX_OVERHEAD 85
+
+class SecureClient : public WiFiClientSecure {
+   public:
+    bool Connect(const char host[], uint16_t port, const char fingerprint[]);
+    void ForgetSession(void);
+    uint32_t GetHandshakeTime(void);
+    uint16_t GetRxBufferSize(void);
+    uint16_t GetTxBufferSize(void);
+
+   private:
+    enum MflnSupport : uint8_t {
+        MFLN_UNKNOWN,  // Not probed yet
+        MFLN_SUPPORTED,
+        MFLN_REFUSED   // The server ignores the extension, the default buffers are needed
+    };
+    void SetBuffers(uint16_t rx_len, uint16_t tx_len);
+    BearSSL::Session session_;
+    String session_host_ = "";         // Server the session and the fragment length probe belong to
+    bool session_saved_ = false;       // A connection succeeded since the session was reset
+    MflnSupport mfln_support_ = MFLN_UNKNOWN;
+    uint16_t rx_buffer_size_ = TLS_DEFAULT_RX_LEN + TLS_RX_OVERHEAD;
+    uint16_t tx_buffer_size_ = TLS_DEFAULT_TX_LEN + TLS_TX_OVERHEAD;
+    uint32_t handshake_time_ = 0;      // ms taken by the last connection
+};
+
+extern SecureClient secure_client;
+
+#endif  // _SECURE_CLIENT_H_
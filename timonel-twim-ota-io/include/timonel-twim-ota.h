@@ -17,8 +17,23 @@
 #include <TimonelTwiM.h>
 #include <TwiBus.h>
 #include <WiFiClientSecure.h>
+#include <Wire.h>
 #include <nb-twi-cmd.h>
 
+#include "fs-session.h"
+#include "fw-image.h"
+#include "fw-manifest.h"
+#include "fw-store.h"
+#include "ihex-parser.h"
+#include "lan-push.h"
+#include "ota-arena.h"
+#include "ota-log.h"
+#include "ota-timing.h"
+#include "page-uploader.h"
+#include "secure-client.h"
+#include "twi-registry.h"
+#include "update-journal.h"
+
 #ifndef SSID
 #define SSID "YourSSID"
 #define PASS "Password"
@@ -32,6 +47,8 @@
 // Serial display settings
 #define USE_SERIAL Serial
 #define SERIAL_BPS 115200
+#define CMD_TIMING_DUMP 't'   // Serial command: dump the update timing as JSON (also saved to TIMING_JSON)
+#define CMD_TIMING_CLEAR 'c'  // Serial command: clear the update timing histograms
 
 // I2C pins
 #define SDA 2  // I2C SDA pin - ESP8266 2 - ESP32 21
@@ -39,20 +56,163 @@
 
 // ATtiny85 MAX update attempts number
 const uint8_t MAX_UPDATE_TRIES = 3;
+
+// Multi-target mode: 1 = every slave on the bus is flashed with the same firmware at once
+#ifndef MULTI_TARGET_FLASHING
+#define MULTI_TARGET_FLASHING 0
+#endif  // MULTI_TARGET_FLASHING
+
+#define HIG_APP_ADDR 119  // Highest TWI address a slave application may use (0x77)
+
+// Update state machine timing (ms)
+#define TWI_SCAN_INTERVAL 500         // Bus scan period while waiting for a slave
+#define TML_POLL_INTERVAL 25          // Bootloader polling period while it restarts or erases
+#define TML_RESCAN_POLLS 8            // Bootloader polls between bus scans, the others probe its known address
+#define TML_READY_TIMEOUT 3000        // Longest wait for a bootloader to answer after a reset or an erase
+#define RETRY_BACKOFF 1000            // Pause before a new attempt after a failed one
+#define UPDATE_CHECK_INTERVAL 60000UL  // Time between update checks
+#define WIFI_POLL_INTERVAL 1000       // WiFi association polling period
+#define WIFI_CONNECT_TIMEOUT 20000UL  // Longest wait for the WiFi association
+#define WIFI_CONNECT_TRIES 3          // Associations tried before the slave application is started offline
+#define WIFI_RETRY_BACKOFF 5000       // Pause before a new association after a failed one
+
 #define WEB_HOST "raw.githubusercontent.com"
 #define WEB_PORT 443
+#define HTTP_STATUS_OK 200            // Document received
+#define HTTP_STATUS_NOT_MODIFIED 304  // Document unchanged since the validators sent were issued
+#define HTTP_STATUS_NOT_FOUND 404     // No such document
 // Use Firefox browser to get the web site certificate SHA1 fingerprint (case-insensitive)
 const char FINGERPRINT[] PROGMEM = "70 94 de dd e6 c4 69 48 3a 92 70 a1 48 56 78 2d 18 64 e0 b7";
 
 #define FW_WEB_URL "/casanovg/timonel-ota-demo/master/fw-attiny85"  // Firmware updates base URL
-#define FW_ONBOARD_VER "/fw-onboard.md"                             // This file keeps the firmware version currently running on the ATtiny85
-#define FW_ONBOARD_LOC "/fw-onboard.hex"                            // Firmware file currently running on the ATtiny85
-#define FW_LATEST_VER "/fw-latest.md"                               // This file keeps the new firmware version to flash the ATtiny85
-#define FW_LATEST_LOC "/fw-latest.hex"                              // New firmware file to flash the ATtiny85
-#define FW_LATEST_WEB FW_WEB_URL "/fw-latest.md"                    // Full URL to check for updates
-#define UPDATE_TRIES "/update-tries.md"                             // This file keeps the uploading try count across master resets
+#define FW_PACKED_EXT ".timg"                                       // Packed firmware file extension, next to the ".hex" one
+#define FW_ONBOARD_VER "/fw-onboard.md"                             // Onboard firmware version (older layout, imported into the journal)
+#define FW_ONBOARD_LOC "/fw-onboard.img"                            // Firmware image currently running on the ATtiny85
+#define FW_LATEST_VER "/fw-latest.md"                               // New firmware version (older layout, replaced by the journal)
+#define FW_LATEST_LOC "/fw-latest.img"                              // New firmware image, already parsed, to flash the ATtiny85
+#define FW_LATEST_WEB FW_WEB_URL "/fw-manifest.md"                  // Full URL to check for updates, the latest release manifest
+#define FW_LATEST_DOC FW_WEB_URL "/fw-latest.md"                    // Plain version document, checked if the server has no manifest
+#define FW_LATEST_ETAG "/fw-latest.etag"                            // ETag of the last version document found up to date
+#define FW_LATEST_DATE "/fw-latest.date"                            // Last-Modified date of the last version document found up to date
+#define UPDATE_TRIES "/update-tries.md"                             // Uploading try count (older layout, replaced by the journal)
+
+// Flashing mode: 1 = pipelined, pages go to the slave while the image is still arriving
+//                 0 = buffered, the whole image is decoded in RAM before flashing
+#ifndef PIPELINED_FLASHING
+#define PIPELINED_FLASHING 1
+#endif  // PIPELINED_FLASHING
+
+// Delta flashing (pipelined mode only): 1 = on a first attempt, only the pages that differ from
+// the onboard image are rewritten, without deleting the slave application first
+#ifndef DELTA_FLASHING
+#define DELTA_FLASHING 1
+#endif  // DELTA_FLASHING
+
+// Resumable flashing: 1 = a retry with the same image skips the erase and the pages a failed
+//                         attempt got onto the slave, as recorded in the journal
+#ifndef RESUMABLE_FLASHING
+#define RESUMABLE_FLASHING 1
+#endif  // RESUMABLE_FLASHING
+
+// Firmware transport: 1 = the packed (compressed binary) image is downloaded, falling back to the
+//                          Intel Hex file if the server doesn't have it
+//                      0 = Intel Hex file only
+#ifndef COMPRESSED_TRANSPORT
+#define COMPRESSED_TRANSPORT 1
+#endif  // COMPRESSED_TRANSPORT
+
+// LAN push updates: 1 = a firmware image can also be POSTed to the master from the local network
+//                      (see lan-push.h), it is flashed right away
+#ifndef LAN_PUSH_UPDATES
+#define LAN_PUSH_UPDATES 0
+#endif  // LAN_PUSH_UPDATES
+
+// Web update checks: 0 = the web server is never polled, only LAN pushes update the slaves (a
+//                        pushed version would otherwise be replaced by the published one)
+#ifndef WEB_UPDATE_CHECKS
+#define WEB_UPDATE_CHECKS 1
+#endif  // WEB_UPDATE_CHECKS
+
+// Update state machine states
+enum OtaState : uint8_t {
+    OTA_WAIT_SLAVE,       // Waiting until a slave shows up on the bus
+    OTA_CONNECT_WIFI,     // Polling the WiFi association, for the web server and the LAN endpoint
+    OTA_WIFI_RETRY,       // Counting a failed association and scheduling the next one
+    OTA_CHECK_UPDATE,     // Asking the web server for the latest firmware version
+    OTA_FETCH_IMAGE,      // Getting the new firmware into FS and checking it against the release manifest
+    OTA_FIND_BOOTLOADER,  // Locating the slave, resetting its application into Timonel if needed
+    OTA_WAIT_BOOTLOADER,  // Polling the bus until the reset slave answers at a Timonel address
+    OTA_ERASE,            // Deleting the slave application (skipped by delta updates)
+    OTA_WAIT_READY,       // Polling the bootloader until it answers again
+    OTA_FLASH,            // Sending the new firmware to the slave
+    OTA_RETRY,            // Counting a failed attempt and scheduling the next one
+    OTA_START_APP,        // Leaving the bootloader to run the slave application
+    OTA_IDLE,             // Normal operation until the next update check
+    // Multi-target mode
+    OTA_FLEET_RESET,      // Resetting every slave application into its bootloader
+    OTA_FLEET_DISCOVER,   // Polling the bus until every reset slave answers at a Timonel address
+    OTA_FLEET_ERASE,      // Deleting the applications of the slaves flashed in this round
+    OTA_FLEET_WAIT_READY, // Polling the bootloaders until they answer again
+    OTA_FLEET_FLASH,      // Sending the new firmware to all the slaves of the round at once
+    OTA_FLEET_REPORT      // Recording the result of every slave
+};
+
+// Slave being updated in multi-target mode
+struct TwiTarget {
+    uint8_t address;       // Timonel bootloader TWI address
+    uint8_t update_tries;  // Attempts begun and not completed, kept in the journal
+    uint8_t errors;        // Errors on the last attempt
+    bool updated;          // New firmware flashed and running
+};
+
+// Update state machine data
+struct OtaContext {
+    OtaState state = OTA_WAIT_SLAVE;
+    unsigned long state_time = 0;    // millis() when the current state was entered
+    uint16_t poll_count = 0;         // Polls (or other periodic actions) done in the current state
+    uint8_t twi_address = 0;         // Slave address
+    uint8_t update_tries = 0;        // Failed attempts, the flash attempts are also kept in the journal
+    bool delta_update = false;       // Current attempt rewrites only the changed pages
+    uint16_t resume_address = 0;     // Current attempt starts here, the slave holds the pages below
+    String new_version = "";         // Firmware version being flashed
+    FwManifest manifest;             // Release manifest of the new version
+    Timonel *p_timonel = nullptr;    // Slave bootloader, while it is being updated
+    TimingSpan erase_span;           // Slave erase, timed across the erase and polling states
+    TimingSpan wifi_span;            // WiFi association, timed across its polls
+    uint8_t wifi_tries = 0;          // Failed associations in a row
+#if MULTI_TARGET_FLASHING
+    TwiTarget targets[MAX_UPLOAD_TARGETS];    // Slaves being updated
+    uint8_t target_count = 0;
+    uint8_t reset_count = 0;                  // Applications reset into their bootloaders
+    Timonel *p_timonels[MAX_UPLOAD_TARGETS];  // Bootloaders flashed in the current round
+    uint8_t round_ixs[MAX_UPLOAD_TARGETS];    // Target of each bootloader in the round
+    uint8_t round_count = 0;
+    uint8_t attempt = 0;                      // Rounds done
+    uint8_t ready_mask = 0;                   // Bootloaders of the round answering after the erase
+#endif  // MULTI_TARGET_FLASHING
+};
+
+#define TARGET_FLASH_SIZE 8192  // ATtiny85 flash memory size, upper bound for any firmware payload
+#define HTTP_BODY_CHUNK 512     // Response body bytes read at a time, the chunk comes from the OTA arena
+#define HTTP_BODY_TIMEOUT 5000  // Longest wait for more body data, in ms (a stalled LAN client)
+#define HTTP_DOCUMENT_MAX 1024  // Longest text document read, version document or release manifest
+
+// OTA arena size: the decoders and the body chunk, plus the whole firmware in buffered mode
+#ifndef OTA_ARENA_WORK
+#define OTA_ARENA_WORK 1536
+#endif  // OTA_ARENA_WORK
+#if PIPELINED_FLASHING
+#define OTA_ARENA_SIZE OTA_ARENA_WORK
+#else
+#define OTA_ARENA_SIZE (TARGET_FLASH_SIZE + OTA_ARENA_WORK)
+#endif  // PIPELINED_FLASHING
 
-#define IHEX_START_CODE ':'  // Intel Hex file record start code
+// Validators of a version document, they make the next request for it conditional
+struct HttpValidators {
+    String etag = "";           // ETag header, sent back as If-None-Match
+    String last_modified = "";  // Last-Modified header, sent back as If-Modified-Since
+    bool not_modified = false;  // The last response was "304 Not Modified"
+};
 
 // Prototypes
 void ClrScr(void);
@@ -65,7 +225,8 @@ String ReadFile(const char file_name[]);
 uint8_t WriteFile(const char file_name[], const String file_data);
 uint8_t Rename(const char source_file_name[], const char destination_file_name[]);
 uint8_t DeleteFile(const char file_name[]);
-void RotaryDelay(void);
+void RotarySpin(void);
+void CheckSerialCommand(void);
 
 String CheckFwUpdate(const char ssid[],
                    const char password[],
@@ -73,11 +234,35 @@ String CheckFwUpdate(const char ssid[],
                    const int port,
                    const char fingerprint[],
                    const String current_version,
-                   const String latest_version);
+                   const String latest_version,
+                   FwManifest *p_manifest);
+void SaveHttpValidator(const char file_name[], const String validator);
 
-void UpdateFirmware(String new_version);
+void RunOtaStateMachine(OtaContext *p_ota);
+void SetOtaState(OtaContext *p_ota, OtaState state);
+void BeginUpdate(OtaContext *p_ota);
+void ServeLanPush(OtaContext *p_ota);
+uint8_t ReceivePushedFirmware(WiFiClient &client, String new_version, const FwManifest *p_manifest);
+void AbandonUpdate(OtaContext *p_ota);
+bool TimonelReady(Timonel *p_timonel, uint8_t twi_address);
+void RecoverUpdateState(void);
+bool FwImageMatches(const char file_name[], uint32_t image_crc);
+bool LatestImageReady(String new_version);
+uint8_t FetchFirmware(String new_version, const FwManifest *p_manifest);
+uint8_t VerifyFirmware(String new_version, const FwManifest *p_manifest, FwDigest *p_digest, bool records_counted, uint8_t fw_errors);
+bool FirmwareFits(Timonel *p_timonel, const FwManifest *p_manifest);
 
-void FlashTwiDevice(uint8_t payload[], uint16_t payload_size, uint8_t update_tries);
+uint16_t GetResumeAddress(String new_version);
+uint8_t PipelineFirmware(String new_version, Timonel *p_timonel, bool delta_update, uint16_t resume_address);
+uint8_t FeedFirmwarePages(String new_version, PageUploader *p_page_uploader, uint8_t *p_upload_errors);
+uint8_t SetDeltaBase(PageUploader *p_page_uploader);
+void SetFlashResume(PageUploader *p_page_uploader, String *p_new_version, uint16_t resume_address);
+void SaveFlashProgress(String new_version, PageUploader *p_page_uploader);
+void ConfirmFlashedPages(uint32_t confirmed_end, void *context);
+void ReportSkippedPages(PageUploader *p_page_uploader, bool delta_update);
+void ReportUploadRates(PageUploader *p_page_uploader, Timonel *p_timonels[], uint8_t target_count);
+uint8_t BufferFirmware(String new_version, Timonel *p_timonel, uint16_t resume_address, const FwManifest *p_manifest);
+uint8_t DownloadPackedFirmware(String new_version, IHexDataHandler data_handler, void *context, bool *p_found);
 
 String GetHttpDocument(const char ssid[],
                        const char password[],
@@ -85,10 +270,55 @@ String GetHttpDocument(const char ssid[],
                        const int port,
                        const char fingerprint[],
                        String url,
-                       char terminator);
-bool ParseIHexFormat(String serialized_file, uint8_t *payload);
+                       char terminator,
+                       HttpValidators *p_validators = nullptr,
+                       int *p_http_status = nullptr);
+bool ConnectWiFi(const char ssid[], const char password[]);
+int RequestHttpDocument(SecureClient &client,
+                        const char host[],
+                        const int port,
+                        const char fingerprint[],
+                        String url,
+                        HttpValidators *p_validators = nullptr);
+uint8_t DownloadIHexFile(const char ssid[],
+                         const char password[],
+                         const char host[],
+                         const int port,
+                         const char fingerprint[],
+                         String url,
+                         HexParser *p_hex_parser);
+uint8_t DownloadFwImageFile(const char ssid[],
+                            const char password[],
+                            const char host[],
+                            const int port,
+                            const char fingerprint[],
+                            String url,
+                            FwImageStream *p_image_stream,
+                            int *p_http_status);
+// Handler fed with the chunks of an HTTP response body, it returns true once it needs no more data
+typedef bool (*HttpBodyHandler)(const uint8_t data[], size_t length, void *context);
+uint32_t ReceiveHttpBody(WiFiClient &client, HttpBodyHandler body_handler, void *context);
+// Handler called while an HTTP response body has no data ready, with the context it was set with
+typedef void (*HttpIdleHandler)(void *context);
+void SetHttpIdleHandler(HttpIdleHandler idle_handler, void *context = nullptr);
+// Text document body, read up to its terminator ('\0': the whole body)
+struct HttpText {
+    String text = "";
+    char terminator = '\0';
+};
+bool AppendHttpText(const uint8_t data[], size_t length, void *context);
+bool FeedHexParser(const uint8_t data[], size_t length, void *context);
+bool FeedFwImageStream(const uint8_t data[], size_t length, void *context);
+bool ParseIHexFormat(String serialized_file, uint8_t *payload, size_t payload_capacity);
 uint16_t GetIHexSize(String serialized_file);
 void StartApplication(void);
-void RetryRestart(const char file_name[], uint8_t update_tries);
+void RunFleetState(OtaContext *p_ota, unsigned long state_elapsed);
+void StartTwiFleet(void);
+uint8_t ResetTwiApplications(void);
+uint8_t LoadTwiTargets(TwiTarget targets[], const uint8_t addresses[], uint8_t target_count);
+void FlashTwiFleet(OtaContext *p_ota);
+void ReportTwiFleet(OtaContext *p_ota);
+uint8_t ScanTwiRange(uint8_t addresses[], uint8_t max_count, uint8_t low_address, uint8_t high_address);
+void SaveTwiTargetTries(OtaContext *p_ota);
 
 #endif  // _TIMONEL_TWIM_OTA_H_
@@ -0,0 +1,74 @@
+/*
+  twi-registry.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  TWI device registry: the slave's Timonel and application addresses, and
+  the role it had when last seen, are kept in flash. Finding the slave is
+  then a single probe of its last address, or of its other address when it
+  has changed role (reset into the bootloader, or its application started).
+  The whole bus is scanned only for a slave not seen before, or one that no
+  longer answers where expected; what the scan finds goes to the registry.
+  A slave expected in Timonel is only looked for in the bootloader range.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _TWI_REGISTRY_H_
+#define _TWI_REGISTRY_H_
+
+#include <Arduino.h>
+#include <TwiBus.h>
+#include <Wire.h>
+#include <nb-twi-cmd.h>
+
+#include "fs-session.h"
+
+#define TWI_REGISTRY_FILE "/twi-registry.bin"  // Registry, binary
+#define TWI_REGISTRY_MAGIC 0x5254              // "TR" stored little-endian
+
+// Slave roles, by address range
+enum TwiRole : uint8_t {
+    TWI_ROLE_ANY,          // Locate(): either role, the slave address is unknown otherwise
+    TWI_ROLE_BOOTLOADER,   // Timonel, LOW_TML_ADDR to HIG_TML_ADDR
+    TWI_ROLE_APPLICATION   // User application, above HIG_TML_ADDR
+};
+
+// Slave, as last seen
+struct TwiDevice {
+    uint8_t tml_address;  // Timonel bootloader address, 0 if not seen yet
+    uint8_t app_address;  // Application address, 0 if not seen yet
+    uint8_t role;         // TwiRole at the last address found
+    uint8_t reserved;     // Zero
+};
+
+class TwiRegistry {
+   public:
+    TwiRegistry(uint8_t sda, uint8_t scl);
+    bool Load(void);
+    uint8_t Locate(TwiRole role = TWI_ROLE_ANY, bool scan = true);
+    void SetRole(TwiRole role);
+    uint32_t GetProbeCount(void);
+    uint32_t GetScanCount(void);
+
+   private:
+    // Registry, as stored in flash
+    struct RegistryFile {
+        uint16_t magic;    // TWI_REGISTRY_MAGIC
+        uint8_t reserved[2];
+        TwiDevice device;
+        uint32_t crc32;    // CRC32 of all the fields above
+    };
+    bool Probe(uint8_t twi_address);
+    void Record(uint8_t twi_address);
+    bool Save(void);
+    static TwiRole GetRole(uint8_t twi_address);
+    TwiDevice device_;
+    uint8_t sda_;
+    uint8_t scl_;
+    uint32_t probe_count_ = 0;  // Single address probes, since startup
+    uint32_t scan_count_ = 0;   // Full bus scans, since startup (bootloader range scans are probes)
+};
+
+extern TwiRegistry twi_registry;
+
+#endif  // _TWI_REGISTRY_H_
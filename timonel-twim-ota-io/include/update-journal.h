@@ -0,0 +1,84 @@
+/*
+  update-journal.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Update state journal: firmware versions, image CRCs, update phase and retry
+  counts (in multi-target mode, one per bootloader address too) live in one
+  record, appended to a log whenever the state changes.
+  Records carry a sequence number and a CRC32, the newest intact one is the
+  current state. The log alternates between two slot files, so a slot is
+  truncated only after the other one holds a valid record. How far a failed
+  attempt got with the latest image is recorded too, so the next one resumes.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _UPDATE_JOURNAL_H_
+#define _UPDATE_JOURNAL_H_
+
+#include <Arduino.h>
+#include <nb-twi-cmd.h>
+
+#include "fs-session.h"
+#include "fw-image.h"
+
+#define JOURNAL_SLOT_A "/journal-a.bin"  // Journal slot files
+#define JOURNAL_SLOT_B "/journal-b.bin"
+#define JOURNAL_SLOT_RECORDS 32          // Records appended to a slot before switching to the other
+#define JOURNAL_MAGIC 0x4A55             // "UJ" stored little-endian
+#define JOURNAL_DEVICES (HIG_TML_ADDR - LOW_TML_ADDR + 1)  // Bootloader addresses with their own retry count
+
+// Update phases
+enum JournalPhase : uint8_t {
+    JOURNAL_IDLE,        // The slave runs the onboard firmware
+    JOURNAL_DOWNLOADED,  // The latest firmware image is complete in FS, not flashed yet
+    JOURNAL_FLASHING     // The slave flash is being (or was partially) rewritten
+};
+
+// Update state
+struct UpdateState {
+    JournalPhase phase;
+    uint8_t update_tries;                     // Flash attempts begun and not completed
+    char onboard_version[FW_IMAGE_VER_LEN];   // Firmware running on the slave
+    char latest_version[FW_IMAGE_VER_LEN];    // Firmware downloaded to replace it
+    uint16_t flashed_end;                     // Slave flash confirmed to hold the latest image below this address, 0 if none
+    uint32_t onboard_crc;                     // Payload CRC32 of the onboard image
+    uint32_t latest_crc;                      // Payload CRC32 of the latest image
+    uint8_t device_tries[JOURNAL_DEVICES];    // Multi-target mode: flash attempts begun per bootloader address
+};
+
+class UpdateJournal {
+   public:
+    UpdateJournal();
+    bool Recover(void);
+    UpdateState GetState(void);
+    bool Append(const UpdateState &state);
+    bool SetDownloaded(const String version, uint32_t image_crc);
+    bool BeginFlash(uint8_t update_tries);
+    bool ConfirmFlash(uint16_t flashed_end);
+    bool CommitFlash(void);
+    bool AbandonFlash(void);
+    uint8_t GetDeviceTries(uint8_t twi_address);
+    bool SetDeviceTries(const uint8_t twi_addresses[], const uint8_t update_tries[], uint8_t device_count);
+    uint32_t GetSequence(void);
+
+   private:
+    // Journal record, as stored in flash
+    struct JournalRecord {
+        uint16_t magic;      // JOURNAL_MAGIC
+        uint16_t reserved;   // Zero
+        uint32_t sequence;   // Grows by one with each record
+        UpdateState state;
+        uint32_t crc32;      // CRC32 of all the fields above
+    };
+    uint8_t ScanSlot(const char file_name[], JournalRecord *p_newest, bool *p_torn);
+    UpdateState state_;
+    uint32_t sequence_ = 0;    // Sequence of the newest record, 0 if the journal is empty
+    uint8_t active_slot_ = 0;  // Slot holding the newest record
+    uint8_t slot_records_ = 0; // Records in the active slot
+    bool slot_torn_ = false;   // The active slot ends with a partial record
+};
+
+extern UpdateJournal update_journal;
+
+#endif  // _UPDATE_JOURNAL_H_
@@ -0,0 +1,172 @@
+/*
+ *******************************
+ * Heatshrink Stream Decoder   *
+ * Version: 1.0                *
+ *******************************
+ */
+
+#include "hs-decoder.h"
+
+// Constructor
+HsDecoder::HsDecoder() {
+    // Constructor
+}
+
+// Destructor
+HsDecoder::~HsDecoder() {
+    // Destructor
+}
+
+// Function Begin (restarts the decoder, with the parameters the stream was encoded with)
+uint8_t HsDecoder::Begin(uint8_t window_bits, uint8_t lookahead_bits) {
+    errors_ = 0;
+    if ((window_bits < HS_WINDOW_BITS_MIN) || (window_bits > HS_WINDOW_BITS_MAX) ||
+        (lookahead_bits < HS_LOOKAHEAD_BITS_MIN) || (lookahead_bits >= window_bits)) {
+        errors_ = HS_ERR_PARAMS;
+        window_bits_ = 0;
+        return errors_;
+    }
+    memset(window_, 0, sizeof(window_));
+    window_bits_ = window_bits;
+    lookahead_bits_ = lookahead_bits;
+    window_mask_ = (1 << window_bits) - 1;
+    window_ix_ = 0;
+    state_ = TAG_BIT;
+    input_bits_ = 0;
+    field_ = 0;
+    field_bits_ = 0;
+    token_bits_ = 0;
+    backref_count_ = 0;
+    return errors_;
+}
+
+// Function Decode
+// Consumes input and fills the output up to its capacity, advancing *pp_input and *p_input_len.
+// Returns the bytes decoded: fewer than the capacity only once the input is used up.
+size_t HsDecoder::Decode(const uint8_t **pp_input, size_t *p_input_len, uint8_t output[], size_t output_capacity) {
+    size_t output_len = 0;
+    uint16_t value = 0;
+    if (window_bits_ == 0) {
+        return 0;
+    }
+    while (output_len < output_capacity) {
+        switch (state_) {
+            case TAG_BIT: {
+                if (!GetBits(1, pp_input, p_input_len, &value)) {
+                    return output_len;
+                }
+                state_ = value ? LITERAL : BACKREF_INDEX;
+                break;
+            }
+            case LITERAL: {
+                if (!GetBits(8, pp_input, p_input_len, &value)) {
+                    return output_len;
+                }
+                window_[window_ix_] = value;
+                window_ix_ = (window_ix_ + 1) & window_mask_;
+                output[output_len++] = value;
+                token_bits_ = 0;
+                state_ = TAG_BIT;
+                break;
+            }
+            case BACKREF_INDEX: {
+                if (!GetBits(window_bits_, pp_input, p_input_len, &value)) {
+                    return output_len;
+                }
+                backref_index_ = value + 1;
+                state_ = BACKREF_COUNT;
+                break;
+            }
+            case BACKREF_COUNT: {
+                if (!GetBits(lookahead_bits_, pp_input, p_input_len, &value)) {
+                    return output_len;
+                }
+                backref_count_ = value + 1;
+                token_bits_ = 0;
+                state_ = BACKREF_COPY;
+                break;
+            }
+            case BACKREF_COPY: {
+                while ((backref_count_ > 0) && (output_len < output_capacity)) {
+                    uint8_t history_byte = window_[(window_ix_ - backref_index_) & window_mask_];
+                    window_[window_ix_] = history_byte;
+                    window_ix_ = (window_ix_ + 1) & window_mask_;
+                    output[output_len++] = history_byte;
+                    backref_count_--;
+                }
+                if (backref_count_ == 0) {
+                    state_ = TAG_BIT;
+                }
+                break;
+            }
+        }
+    }
+    return output_len;
+}
+
+// Function BeginStream
+// Decoded data goes to the handler in chunks of up to HS_OUTPUT_CHUNK bytes, with consecutive
+// addresses from the one given
+uint8_t HsDecoder::BeginStream(uint8_t window_bits, uint8_t lookahead_bits, HsDataHandler data_handler, void *context, uint32_t address) {
+    data_handler_ = data_handler;
+    handler_context_ = context;
+    address_ = address;
+    data_size_ = 0;
+    return Begin(window_bits, lookahead_bits);
+}
+
+// Function FeedStream (a chunk of any size, tokens may span chunks)
+size_t HsDecoder::FeedStream(const uint8_t *chunk, size_t chunk_len) {
+    uint8_t output[HS_OUTPUT_CHUNK];
+    size_t input_len = chunk_len;
+    size_t output_len;
+    while ((output_len = Decode(&chunk, &input_len, output, sizeof(output))) > 0) {
+        if (data_handler_ != nullptr) {
+            data_handler_(address_, output, output_len, handler_context_);
+        }
+        address_ += output_len;
+        data_size_ += output_len;
+    }
+    return chunk_len;
+}
+
+// Function EndStream
+// The encoder pads the last byte with zero bits: more than 7 bits into a token means the stream was cut
+uint8_t HsDecoder::EndStream(void) {
+    if ((token_bits_ > 7) || (backref_count_ > 0)) {
+        errors_ |= HS_ERR_TRUNCATED;
+    }
+    return errors_;
+}
+
+// Function GetStreamDataSize (decoded bytes handed out since BeginStream)
+uint32_t HsDecoder::GetStreamDataSize(void) {
+    return data_size_;
+}
+
+// Function GetBits
+// Reads a field most significant bit first, taking as many bits of the input byte as it can at
+// once. A field can span input buffers: it returns false when the input runs out, keeping the
+// bits read so far for the next call.
+bool HsDecoder::GetBits(uint8_t bit_count, const uint8_t **pp_input, size_t *p_input_len, uint16_t *p_value) {
+    while (field_bits_ < bit_count) {
+        if (input_bits_ == 0) {
+            if (*p_input_len == 0) {
+                return false;
+            }
+            input_byte_ = **pp_input;
+            (*pp_input)++;
+            (*p_input_len)--;
+            input_bits_ = 8;
+        }
+        uint8_t take_bits = min((uint8_t)(bit_count - field_bits_), input_bits_);
+        input_bits_ -= take_bits;
+        field_ = (field_ << take_bits) | ((input_byte_ >> input_bits_) & ((1 << take_bits) - 1));
+        field_bits_ += take_bits;
+        token_bits_ += take_bits;
+    }
+    *p_value = field_;
+    field_ = 0;
+    field_bits_ = 0;
+    return true;
+}
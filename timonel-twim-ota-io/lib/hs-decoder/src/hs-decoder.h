@@ -0,0 +1,72 @@
+/*
+ *******************************
+ * Heatshrink Stream Decoder   *
+ * Version: 1.0                *
+ *******************************
+ */
+
+// Decoder of the heatshrink LZSS bit stream (https://github.com/atomicobject/heatshrink): a tag
+// bit, then either a literal byte or a back reference (window_bits of distance - 1 and
+// lookahead_bits of length - 1), most significant bit first. The history is the only state
+// kept, a fixed window of 2^window_bits bytes, whatever the stream size.
+
+#ifndef _HS_DECODER_H_
+#define _HS_DECODER_H_
+
+#include <Arduino.h>
+
+#ifndef HS_WINDOW_BITS_MAX
+#define HS_WINDOW_BITS_MAX 8  // Largest window accepted, it sets the history buffer size
+#endif  // HS_WINDOW_BITS_MAX
+#define HS_WINDOW_BITS_MIN 4
+#define HS_LOOKAHEAD_BITS_MIN 3
+#define HS_OUTPUT_CHUNK 64    // Decoded bytes handed to the data handler at a time when streaming
+
+// Decoder error flags
+#define HS_ERR_PARAMS 0x01     // Window or lookahead size not supported
+#define HS_ERR_TRUNCATED 0x02  // Stream ended in the middle of a token
+
+// Handler called by the stream decoder with every chunk of decoded data, same signature as IHexDataHandler
+typedef void (*HsDataHandler)(uint32_t address, const uint8_t *data, uint8_t length, void *context);
+
+class HsDecoder {
+   public:
+    HsDecoder();
+    ~HsDecoder();
+    uint8_t Begin(uint8_t window_bits, uint8_t lookahead_bits);
+    size_t Decode(const uint8_t **pp_input, size_t *p_input_len, uint8_t output[], size_t output_capacity);
+    uint8_t BeginStream(uint8_t window_bits, uint8_t lookahead_bits, HsDataHandler data_handler, void *context = nullptr, uint32_t address = 0);
+    size_t FeedStream(const uint8_t *chunk, size_t chunk_len);
+    uint8_t EndStream(void);
+    uint32_t GetStreamDataSize(void);
+
+   private:
+    enum DecodeState : uint8_t {
+        TAG_BIT,        // Reading the bit that tells a literal from a back reference
+        LITERAL,        // Reading a literal byte
+        BACKREF_INDEX,  // Reading the distance of a back reference
+        BACKREF_COUNT,  // Reading the length of a back reference
+        BACKREF_COPY    // Copying from the history, it can span several output buffers
+    };
+    bool GetBits(uint8_t bit_count, const uint8_t **pp_input, size_t *p_input_len, uint16_t *p_value);
+    uint8_t window_[1 << HS_WINDOW_BITS_MAX];  // History, zeroed at start as the encoder assumes
+    uint16_t window_mask_ = 0;
+    uint16_t window_ix_ = 0;       // Next history position to write
+    uint8_t window_bits_ = 0;
+    uint8_t lookahead_bits_ = 0;
+    DecodeState state_ = TAG_BIT;
+    uint8_t input_byte_ = 0;       // Input byte being split into bits
+    uint8_t input_bits_ = 0;       // Bits of input_byte_ not yet read, the lowest ones
+    uint16_t field_ = 0;           // Bits of the current field read so far
+    uint8_t field_bits_ = 0;
+    uint8_t token_bits_ = 0;       // Bits read since the last complete token
+    uint16_t backref_index_ = 0;   // Distance back into the history
+    uint16_t backref_count_ = 0;   // Bytes still to copy
+    HsDataHandler data_handler_ = nullptr;
+    void *handler_context_ = nullptr;
+    uint32_t address_ = 0;         // Address of the next decoded byte
+    uint32_t data_size_ = 0;
+    uint8_t errors_ = 0;
+};
+
+#endif  // _HS_DECODER_H_
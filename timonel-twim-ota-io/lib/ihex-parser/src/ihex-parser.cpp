@@ -17,60 +17,435 @@ HexParser::~HexParser() {
     // Destructor
 }
 
+// Hex digit values indexed by ASCII code, 0xFF marks a non-hex character
+static const uint8_t IHEX_NIBBLE[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
 // Function ParseIHexFormat
-bool HexParser::ParseIHexFormat(String serialized_file, uint8_t *payload) {
-    uint16_t file_len = serialized_file.length();
-    uint16_t payload_ix = 0;
-    uint8_t line_count = 0;
-    bool checksum_err = false;
-    // Loops through the serialized file
-    for (int ix = 0; ix < file_len; ix++) {
-        // If a record start is detected
-        if (serialized_file.charAt(ix) == IHEX_START_CODE) {
-            uint8_t byte_count = strtoul(serialized_file.substring(ix + 1, ix + 3).c_str(), 0, 16);
-            uint16_t address = strtoul(serialized_file.substring(ix + 3, ix + 7).c_str(), 0, 16);
-            uint8_t record_type = strtoul(serialized_file.substring(ix + 7, ix + 9).c_str(), 0, 16);
-            uint8_t checksum = strtoul(serialized_file.substring(ix + 9 + (byte_count << 1), ix + 11 + (byte_count << 1)).c_str(), 0, 16);
-            // Serial.printf_P("\rix: %d line len: %d type: %d check: %d\n\r", ix, byte_count, record_type, checksum);
-            if (record_type == 0) {
-                uint8_t record_check = 0;
-                // Serial.printf_P("%02d) [%04X] ", line_count++, address);
-                for (int data_pos = ix + 9; data_pos < (ix + 9 + (byte_count << 1)); data_pos += 2) {
-                    uint8_t ihex_data = strtoul(serialized_file.substring(data_pos, data_pos + 2).c_str(), 0, 16);
-                    record_check += ihex_data;
-                    payload[payload_ix] = ihex_data;
-                    // Serial.printf_P(".%02X", ihex_data);
-                    payload_ix++;
-                }
-                record_check = (~((byte_count + ((address >> 8) & 0xFF) + (address & 0xFF) + record_type + record_check) & 0xFF)) + 1;
-                if (record_check != checksum) {
-                    // Serial.printf_P(" { %02X ERROR }", record_check);
-                    checksum_err = true;
-                } else {
-                    // Serial.printf_P(" { %02X }", record_check);
+// Kept for existing callers, sizing the payload with GetIHexSize. Data past the payload capacity
+// is not written, it is an error.
+bool HexParser::ParseIHexFormat(String serialized_file, uint8_t *payload, size_t payload_capacity) {
+    size_t payload_size = 0;
+    return (DecodeIHex(serialized_file.c_str(), serialized_file.length(), payload, payload_capacity, &payload_size) != 0);
+}
+
+// Function GetIHexSize (kept for existing callers, only sizes up to UINT16_MAX bytes)
+uint16_t HexParser::GetIHexSize(String serialized_file) {
+    size_t payload_size = 0;
+    DecodeIHex(serialized_file.c_str(), serialized_file.length(), nullptr, 0, &payload_size);
+    return payload_size;
+}
+
+// Function DecodeIHex
+// Sizes and decodes the data records of an in-memory Intel Hex text in a single pass, without
+// allocations. Data is placed by address, extended address records included, relative to the
+// first data record, and the gaps between records are filled with 0xFF. With a null payload only
+// the size is computed.
+uint8_t HexParser::DecodeIHex(const char *ihex_text, size_t text_len, uint8_t *payload, size_t payload_capacity, size_t *p_payload_size) {
+    size_t payload_end = 0;
+    uint32_t base_address = 0;
+    uint32_t origin = 0;
+    bool origin_set = false;
+    uint8_t errors = 0;
+    size_t ix = 0;
+    while (ix < text_len) {
+        // Skip everything up to the next record start code
+        if (ihex_text[ix++] != IHEX_START_CODE) {
+            continue;
+        }
+        if ((text_len - ix) < (IHEX_REC_OVERHEAD << 1)) {
+            errors |= IHEX_ERR_SYNTAX;
+            break;
+        }
+        uint8_t header[IHEX_REC_OVERHEAD - 1];  // Byte count, address (2), record type
+        uint8_t digit_check = 0;
+        for (uint8_t byte_ix = 0; byte_ix < sizeof(header); byte_ix++) {
+            uint8_t high = IHEX_NIBBLE[(uint8_t)ihex_text[ix + (byte_ix << 1)]];
+            uint8_t low = IHEX_NIBBLE[(uint8_t)ihex_text[ix + (byte_ix << 1) + 1]];
+            digit_check |= high | low;
+            header[byte_ix] = (high << 4) | low;
+        }
+        if (digit_check > 0x0F) {
+            errors |= IHEX_ERR_SYNTAX;
+            continue;
+        }
+        uint8_t byte_count = header[0];
+        uint8_t record_type = header[3];
+        size_t record_chars = (byte_count + IHEX_REC_OVERHEAD) << 1;
+        if ((text_len - ix) < record_chars) {
+            errors |= IHEX_ERR_SYNTAX;
+            break;
+        }
+        bool place_data = false;
+        bool store_data = false;
+        size_t offset = 0;
+        if (record_type == IHEX_REC_DATA) {
+            uint32_t address = base_address + ((header[1] << 8) | header[2]);
+            if (!origin_set) {
+                origin = address;
+                origin_set = true;
+            }
+            if (address < origin) {
+                // Data below the first record can't be placed
+                errors |= IHEX_ERR_OVERFLOW;
+            } else {
+                offset = address - origin;
+                place_data = true;
+                if ((offset + byte_count) > payload_capacity) {
+                    // Keep sizing, but never write past the caller's buffer
+                    if (payload != nullptr) {
+                        errors |= IHEX_ERR_OVERFLOW;
+                        place_data = false;
+                    }
+                } else if (payload != nullptr) {
+                    store_data = true;
+                    if (offset > payload_end) {
+                        memset(&payload[payload_end], 0xFF, offset - payload_end);
+                    }
                 }
-                // Serial.printf_P("\n\r");
+            }
+        }
+        uint8_t record_check = header[0] + header[1] + header[2] + header[3];
+        uint16_t record_value = 0;  // First two data bytes, big-endian, for the extended address records
+        const char *p_digits = &ihex_text[ix + ((IHEX_REC_OVERHEAD - 1) << 1)];
+        // Data bytes followed by the checksum byte
+        for (uint16_t byte_ix = 0; byte_ix <= byte_count; byte_ix++) {
+            uint8_t high = IHEX_NIBBLE[(uint8_t)p_digits[byte_ix << 1]];
+            uint8_t low = IHEX_NIBBLE[(uint8_t)p_digits[(byte_ix << 1) + 1]];
+            digit_check |= high | low;
+            uint8_t ihex_data = (high << 4) | low;
+            record_check += ihex_data;
+            if (byte_ix < 2) {
+                record_value = (record_value << 8) | ihex_data;
+            }
+            if (store_data && (byte_ix < byte_count)) {
+                payload[offset + byte_ix] = ihex_data;
+            }
+        }
+        if (digit_check > 0x0F) {
+            errors |= IHEX_ERR_SYNTAX;
+            continue;
+        }
+        if (record_check != 0) {
+            errors |= IHEX_ERR_CHECKSUM;
+        }
+        ix += record_chars;
+        if (record_type == IHEX_REC_DATA) {
+            if (place_data && ((offset + byte_count) > payload_end)) {
+                payload_end = offset + byte_count;
+            }
+        } else if (record_type == IHEX_REC_EOF) {
+            break;
+        } else if ((record_type == IHEX_REC_EXT_SEG) || (record_type == IHEX_REC_EXT_LIN)) {
+            if (byte_count != 2) {
+                errors |= IHEX_ERR_SYNTAX;
+            } else {
+                base_address = (uint32_t)record_value << ((record_type == IHEX_REC_EXT_SEG) ? 4 : 16);
             }
         }
     }
-    return checksum_err;
+    *p_payload_size = payload_end;
+    return errors;
 }
 
-// Function GetIHexSize
-uint16_t HexParser::GetIHexSize(String serialized_file) {
-    uint16_t file_length = serialized_file.length();
-    uint16_t data_size = 0;
-    for (int ix = 0; ix < file_length; ix++) {
-        if (serialized_file.charAt(ix) == ':') {
-            uint8_t record_type = strtoul(serialized_file.substring(ix + 7, ix + 9).c_str(), 0, 16);
-            uint8_t byte_count = strtoul(serialized_file.substring(ix + 1, ix + 3).c_str(), 0, 16);
-            //uint8_t checksum = strtoul(serialized_file.substring(ix + 9 + (byte_count << 1), ix + 11 + (byte_count << 1)).c_str(), 0, 16);
-            if (record_type == 0) {
-                data_size += byte_count;
+// Function DecodeIHex (sparse image)
+// Decodes an in-memory Intel Hex text into the pages of a sparse image, by address
+uint8_t HexParser::DecodeIHex(const char *ihex_text, size_t text_len, SparseImage *p_image) {
+    BeginStream(SparseImage::DataHandler, p_image);
+    FeedStream((const uint8_t *)ihex_text, text_len);
+    uint8_t errors = EndStream();
+    if (p_image->Overflow()) {
+        errors |= IHEX_ERR_OVERFLOW;
+    }
+    return errors;
+}
+
+// Function BeginStream
+void HexParser::BeginStream(IHexDataHandler data_handler, void *context) {
+    data_handler_ = data_handler;
+    handler_context_ = context;
+    record_ix_ = 0;
+    nibble_pending_ = false;
+    base_address_ = 0;
+    data_size_ = 0;
+    stream_errors_ = 0;
+    stream_state_ = WAIT_START;
+}
+
+// Function FeedStream (chunk)
+size_t HexParser::FeedStream(const uint8_t *chunk, size_t chunk_len) {
+    for (size_t ix = 0; ix < chunk_len; ix++) {
+        char ihex_char = chunk[ix];
+        if (stream_state_ == END_OF_FILE) {
+            break;
+        }
+        if (stream_state_ == WAIT_START) {
+            // Line breaks and anything else between records are skipped
+            if (ihex_char == IHEX_START_CODE) {
+                record_ix_ = 0;
+                nibble_pending_ = false;
+                stream_state_ = READ_RECORD;
+            }
+            continue;
+        }
+        uint8_t nibble = IHEX_NIBBLE[(uint8_t)ihex_char];
+        if (nibble > 0x0F) {
+            // A record was cut short, resynchronize on the next start code
+            stream_errors_ |= IHEX_ERR_SYNTAX;
+            record_ix_ = 0;
+            nibble_pending_ = false;
+            stream_state_ = (ihex_char == IHEX_START_CODE) ? READ_RECORD : WAIT_START;
+            continue;
+        }
+        if (!nibble_pending_) {
+            high_nibble_ = nibble;
+            nibble_pending_ = true;
+            continue;
+        }
+        nibble_pending_ = false;
+        record_[record_ix_++] = (high_nibble_ << 4) | nibble;
+        if (record_ix_ == record_[0] + IHEX_REC_OVERHEAD) {
+            stream_state_ = WAIT_START;
+            ProcessRecord();
+        }
+    }
+    return chunk_len;
+}
+
+// Function FeedStream (Stream)
+size_t HexParser::FeedStream(Stream &stream) {
+    uint8_t chunk[IHEX_STREAM_CHUNK];
+    size_t fed_bytes = 0;
+    int available = stream.available();
+    while ((available > 0) && (stream_state_ != END_OF_FILE)) {
+        size_t chunk_len = stream.readBytes(chunk, (available < IHEX_STREAM_CHUNK) ? available : IHEX_STREAM_CHUNK);
+        if (chunk_len == 0) {
+            break;
+        }
+        fed_bytes += FeedStream(chunk, chunk_len);
+        available = stream.available();
+    }
+    return fed_bytes;
+}
+
+// Function EndStream
+uint8_t HexParser::EndStream(void) {
+    if (stream_state_ == READ_RECORD) {
+        stream_errors_ |= IHEX_ERR_SYNTAX;
+    }
+    if (stream_state_ != END_OF_FILE) {
+        stream_errors_ |= IHEX_ERR_NO_EOF;
+    }
+    return stream_errors_;
+}
+
+// Function StreamComplete
+bool HexParser::StreamComplete(void) {
+    return (stream_state_ == END_OF_FILE);
+}
+
+// Function GetStreamDataSize
+uint32_t HexParser::GetStreamDataSize(void) {
+    return data_size_;
+}
+
+// Function ProcessRecord
+void HexParser::ProcessRecord(void) {
+    uint8_t byte_count = record_[0];
+    uint8_t record_check = 0;
+    for (uint16_t ix = 0; ix < record_ix_; ix++) {
+        record_check += record_[ix];
+    }
+    if (record_check != 0) {
+        // The two's complement checksum makes a valid record add up to zero
+        stream_errors_ |= IHEX_ERR_CHECKSUM;
+        return;
+    }
+    uint16_t address = (record_[1] << 8) | record_[2];
+    switch (record_[3]) {
+        case IHEX_REC_DATA: {
+            data_size_ += byte_count;
+            if (data_handler_ != nullptr) {
+                data_handler_(base_address_ + address, &record_[4], byte_count, handler_context_);
             }
+            break;
+        }
+        case IHEX_REC_EOF: {
+            stream_state_ = END_OF_FILE;
+            break;
+        }
+        case IHEX_REC_EXT_SEG: {
+            if (byte_count != 2) {
+                stream_errors_ |= IHEX_ERR_SYNTAX;
+                break;
+            }
+            base_address_ = (uint32_t)((record_[4] << 8) | record_[5]) << 4;
+            break;
+        }
+        case IHEX_REC_EXT_LIN: {
+            if (byte_count != 2) {
+                stream_errors_ |= IHEX_ERR_SYNTAX;
+                break;
+            }
+            base_address_ = (uint32_t)((record_[4] << 8) | record_[5]) << 16;
+            break;
+        }
+        default: {
+            // Start address records (03, 05) carry nothing to flash
+            break;
+        }
+    }
+}
+
+// Constructor
+SparseImage::SparseImage(uint8_t page_pool[], size_t pool_size, uint16_t page_size)
+    : page_pool_(page_pool), page_size_(page_size) {
+    pool_pages_ = pool_size / page_size;
+}
+
+// Function Clear
+void SparseImage::Clear(void) {
+    used_pages_ = 0;
+    run_count_ = 0;
+    last_run_ = -1;
+    overflow_ = false;
+}
+
+// Function Write
+// Data may arrive in any address order, a page is taken from the pool the first time it's written
+bool SparseImage::Write(uint32_t address, const uint8_t data[], uint16_t length) {
+    uint16_t ix = 0;
+    while (ix < length) {
+        uint32_t page_address = (address + ix) & ~((uint32_t)page_size_ - 1);
+        uint8_t *p_page = FindPage(page_address);
+        if (p_page == nullptr) {
+            p_page = AddPage(page_address);
+        }
+        if (p_page == nullptr) {
+            overflow_ = true;
+            return false;
+        }
+        uint16_t page_offset = (address + ix) - page_address;
+        uint16_t chunk_len = min((uint16_t)(page_size_ - page_offset), (uint16_t)(length - ix));
+        memcpy(&p_page[page_offset], &data[ix], chunk_len);
+        ix += chunk_len;
+    }
+    return true;
+}
+
+// Function DataHandler (IHexDataHandler adapter, context is the SparseImage)
+void SparseImage::DataHandler(uint32_t address, const uint8_t *data, uint8_t length, void *context) {
+    ((SparseImage *)context)->Write(address, data, length);
+}
+
+// Function GetRunCount
+uint8_t SparseImage::GetRunCount(void) {
+    return run_count_;
+}
+
+// Function GetRun (runs are listed by ascending address)
+const IHexPageRun *SparseImage::GetRun(uint8_t run_ix) {
+    return (run_ix < run_count_) ? &runs_[run_ix] : nullptr;
+}
+
+// Function GetPage (null for a page no record wrote to)
+const uint8_t *SparseImage::GetPage(uint32_t page_address) {
+    return FindPage(page_address);
+}
+
+// Function GetPageCount
+uint16_t SparseImage::GetPageCount(void) {
+    return used_pages_;
+}
+
+// Function GetPageSize
+uint16_t SparseImage::GetPageSize(void) {
+    return page_size_;
+}
+
+// Function GetLowAddress (first page address, 0 for an empty image)
+uint32_t SparseImage::GetLowAddress(void) {
+    return (run_count_ > 0) ? runs_[0].address : 0;
+}
+
+// Function GetHighAddress (end of the last page, 0 for an empty image)
+uint32_t SparseImage::GetHighAddress(void) {
+    if (run_count_ == 0) {
+        return 0;
+    }
+    IHexPageRun *p_run = &runs_[run_count_ - 1];
+    return p_run->address + (uint32_t)p_run->page_count * page_size_;
+}
+
+// Function PageBlank (a page left as erased flash)
+bool SparseImage::PageBlank(const uint8_t page[]) {
+    for (uint16_t ix = 0; ix < page_size_; ix++) {
+        if (page[ix] != 0xFF) {
+            return false;
         }
     }
-    //Serial.printf_P("\r\n[%s] File length: %d\n\r", __func__, file_length);
-    //Serial.printf_P("[%s] Payload size: %d\n\r", __func__, data_size);
-    return data_size;
-}
\ No newline at end of file
+    return true;
+}
+
+// Function Overflow
+bool SparseImage::Overflow(void) {
+    return overflow_;
+}
+
+// Function FindPage
+uint8_t *SparseImage::FindPage(uint32_t page_address) {
+    for (uint8_t run_ix = 0; run_ix < run_count_; run_ix++) {
+        IHexPageRun *p_run = &runs_[run_ix];
+        if ((page_address >= p_run->address) && (page_address < p_run->address + (uint32_t)p_run->page_count * page_size_)) {
+            return &page_pool_[((size_t)p_run->first_page + (page_address - p_run->address) / page_size_) * page_size_];
+        }
+    }
+    return nullptr;
+}
+
+// Function AddPage
+// Takes the next pool page, erased. It extends the last run grown if it follows it, otherwise
+// it starts a new run, inserted in address order.
+uint8_t *SparseImage::AddPage(uint32_t page_address) {
+    if (used_pages_ >= pool_pages_) {
+        return nullptr;
+    }
+    IHexPageRun *p_last = (last_run_ >= 0) ? &runs_[last_run_] : nullptr;
+    if ((p_last != nullptr) && (page_address == p_last->address + (uint32_t)p_last->page_count * page_size_)) {
+        p_last->page_count++;
+    } else {
+        if (run_count_ >= IHEX_MAX_RUNS) {
+            return nullptr;
+        }
+        uint8_t run_ix = run_count_;
+        while ((run_ix > 0) && (runs_[run_ix - 1].address > page_address)) {
+            runs_[run_ix] = runs_[run_ix - 1];
+            run_ix--;
+        }
+        runs_[run_ix].address = page_address;
+        runs_[run_ix].page_count = 1;
+        runs_[run_ix].first_page = used_pages_;
+        run_count_++;
+        last_run_ = run_ix;
+    }
+    uint8_t *p_page = &page_pool_[(size_t)used_pages_ * page_size_];
+    memset(p_page, 0xFF, page_size_);
+    used_pages_++;
+    return p_page;
+}
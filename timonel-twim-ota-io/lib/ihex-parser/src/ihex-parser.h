@@ -12,15 +12,98 @@
 
 #define IHEX_START_CODE ':'
 
+#define IHEX_MAX_DATA_LEN 255  // Largest data field that a single record can carry
+#define IHEX_REC_OVERHEAD 5    // Record bytes other than data: byte count, address (2), record type, checksum
+#define IHEX_STREAM_CHUNK 64   // Bytes read at a time when feeding the parser from a Stream
+#define IHEX_PAGE_SIZE 64      // Default sparse image page size (ATtiny85 SPM_PAGESIZE), a power of 2
+#define IHEX_MAX_RUNS 8        // Runs of consecutive pages a sparse image can hold
+
+// Intel Hex record types
+#define IHEX_REC_DATA 0x00     // Data record
+#define IHEX_REC_EOF 0x01      // End of file record
+#define IHEX_REC_EXT_SEG 0x02  // Extended segment address record
+#define IHEX_REC_EXT_LIN 0x04  // Extended linear address record
+
+// Stream parser error flags
+#define IHEX_ERR_CHECKSUM 0x01  // At least one record failed its checksum
+#define IHEX_ERR_SYNTAX 0x02    // Non-hex character or truncated record found
+#define IHEX_ERR_NO_EOF 0x04    // Stream ended without an end of file record
+#define IHEX_ERR_OVERFLOW 0x08  // Decoded data does not fit in the output buffer
+
+// Handler called by the stream parser for every checksum-verified data record
+typedef void (*IHexDataHandler)(uint32_t address, const uint8_t *data, uint8_t length, void *context);
+
+// Pages of a sparse image with consecutive addresses, stored one after the other in the page pool
+struct IHexPageRun {
+    uint32_t address;     // Flash address of the first page
+    uint16_t page_count;  // Pages in the run
+    uint16_t first_page;  // Pool index of the first page
+};
+
+// Firmware image kept as runs of whole flash pages, keyed by address. Only the pages that
+// records write to take pool space, gaps are left out and read back as erased (0xFF).
+class SparseImage {
+   public:
+    SparseImage(uint8_t page_pool[], size_t pool_size, uint16_t page_size = IHEX_PAGE_SIZE);
+    void Clear(void);
+    bool Write(uint32_t address, const uint8_t data[], uint16_t length);
+    static void DataHandler(uint32_t address, const uint8_t *data, uint8_t length, void *context);
+    uint8_t GetRunCount(void);
+    const IHexPageRun *GetRun(uint8_t run_ix);
+    const uint8_t *GetPage(uint32_t page_address);
+    uint16_t GetPageCount(void);
+    uint16_t GetPageSize(void);
+    uint32_t GetLowAddress(void);
+    uint32_t GetHighAddress(void);
+    bool PageBlank(const uint8_t page[]);
+    bool Overflow(void);
+
+   private:
+    uint8_t *FindPage(uint32_t page_address);
+    uint8_t *AddPage(uint32_t page_address);
+    uint8_t *page_pool_;
+    uint16_t pool_pages_;             // Pages the pool can hold
+    uint16_t page_size_;
+    uint16_t used_pages_ = 0;         // Pages taken from the pool, always the lowest ones
+    IHexPageRun runs_[IHEX_MAX_RUNS];  // Sorted by address
+    uint8_t run_count_ = 0;
+    int8_t last_run_ = -1;            // Run holding the last page taken, the only one that can grow
+    bool overflow_ = false;           // Some data didn't fit in the pool or the run table
+};
+
 class HexParser {
    public:
     HexParser();
     ~HexParser();
-    bool ParseIHexFormat(String serialized_file, uint8_t *payload);
+    bool ParseIHexFormat(String serialized_file, uint8_t *payload, size_t payload_capacity);
     uint16_t GetIHexSize(String serialized_file);
+    uint8_t DecodeIHex(const char *ihex_text, size_t text_len, uint8_t *payload, size_t payload_capacity, size_t *p_payload_size);
+    uint8_t DecodeIHex(const char *ihex_text, size_t text_len, SparseImage *p_image);
+    void BeginStream(IHexDataHandler data_handler, void *context = nullptr);
+    size_t FeedStream(const uint8_t *chunk, size_t chunk_len);
+    size_t FeedStream(Stream &stream);
+    uint8_t EndStream(void);
+    bool StreamComplete(void);
+    uint32_t GetStreamDataSize(void);
 
    protected:
    private:
+    enum StreamState : uint8_t {
+        WAIT_START,   // Skipping characters until a record start code arrives
+        READ_RECORD,  // Decoding the hex digits of a record
+        END_OF_FILE   // End of file record processed, the rest is ignored
+    };
+    void ProcessRecord(void);
+    IHexDataHandler data_handler_ = nullptr;
+    void *handler_context_ = nullptr;
+    uint8_t record_[IHEX_REC_OVERHEAD + IHEX_MAX_DATA_LEN];  // Fixed per-record state, whatever the file size
+    uint16_t record_ix_ = 0;
+    uint8_t high_nibble_ = 0;
+    bool nibble_pending_ = false;
+    uint32_t base_address_ = 0;
+    uint32_t data_size_ = 0;
+    uint8_t stream_errors_ = 0;
+    StreamState stream_state_ = WAIT_START;
 };
 
-#endif  // _IHEX_PARSER_H_
\ No newline at end of file
+#endif  // _IHEX_PARSER_H_
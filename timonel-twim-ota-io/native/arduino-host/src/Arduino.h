@@ -0,0 +1,212 @@
+/*
+  Arduino.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the parts of the ESP8266 Arduino core the OTA code uses
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <string>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define vsnprintf_P vsnprintf
+#define F(s) (s)
+
+typedef uint8_t byte;
+typedef uint16_t word;
+typedef uint16_t uint16;
+typedef uint32_t uint32;
+
+using std::max;
+using std::min;
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+class String {
+   public:
+    String() {}
+    String(const char *text) : s_(text ? text : "") {}
+    String(const std::string &text) : s_(text) {}
+    explicit String(char c) : s_(1, c) {}
+    String(int value) : s_(std::to_string(value)) {}
+    String(unsigned int value) : s_(std::to_string(value)) {}
+    String(long value) : s_(std::to_string(value)) {}
+    String(unsigned long value) : s_(std::to_string(value)) {}
+    String(unsigned char value) : s_(std::to_string(value)) {}
+    unsigned int length(void) const { return s_.size(); }
+    const char *c_str(void) const { return s_.c_str(); }
+    char charAt(unsigned int ix) const { return (ix < s_.size()) ? s_[ix] : 0; }
+    char operator[](unsigned int ix) const { return charAt(ix); }
+    bool reserve(unsigned int size) {
+        s_.reserve(size);
+        return true;
+    }
+    bool concat(const char *text, unsigned int length) {
+        s_.append(text, length);
+        return true;
+    }
+    String substring(unsigned int from) const { return (from < s_.size()) ? String(s_.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+        if (to > s_.size()) {
+            to = s_.size();
+        }
+        return (to > from) ? String(s_.substr(from, to - from)) : String();
+    }
+    int indexOf(char c) const { return Found(s_.find(c)); }
+    int indexOf(const char *text) const { return Found(s_.find(text)); }
+    int indexOf(char c, unsigned int from) const { return Found(s_.find(c, from)); }
+    int lastIndexOf(char c) const { return Found(s_.rfind(c)); }
+    bool startsWith(const String &prefix) const { return s_.compare(0, prefix.s_.size(), prefix.s_) == 0; }
+    bool endsWith(const String &suffix) const {
+        return (s_.size() >= suffix.s_.size()) && (s_.compare(s_.size() - suffix.s_.size(), suffix.s_.size(), suffix.s_) == 0);
+    }
+    bool equalsIgnoreCase(const String &other) const { return strcasecmp(s_.c_str(), other.s_.c_str()) == 0; }
+    long toInt(void) const { return atol(s_.c_str()); }
+    void trim(void) {
+        size_t first = s_.find_first_not_of(" \t\r\n");
+        size_t last = s_.find_last_not_of(" \t\r\n");
+        s_ = (first == std::string::npos) ? "" : s_.substr(first, last - first + 1);
+    }
+    void toLowerCase(void) {
+        for (char &c : s_) {
+            c = tolower(c);
+        }
+    }
+    String &operator+=(const String &other) {
+        s_ += other.s_;
+        return *this;
+    }
+    String &operator+=(const char *text) {
+        s_ += text;
+        return *this;
+    }
+    String &operator+=(char c) {
+        s_ += c;
+        return *this;
+    }
+    bool operator==(const String &other) const { return s_ == other.s_; }
+    bool operator==(const char *text) const { return s_ == text; }
+    bool operator!=(const String &other) const { return s_ != other.s_; }
+    bool operator!=(const char *text) const { return s_ != text; }
+    friend String operator+(const String &a, const String &b) { return String(a.s_ + b.s_); }
+    friend String operator+(const String &a, const char *b) { return String(a.s_ + b); }
+    friend String operator+(const char *a, const String &b) { return String(std::string(a) + b.s_); }
+    friend String operator+(const String &a, char b) { return String(a.s_ + b); }
+
+   private:
+    static int Found(size_t position) { return (position == std::string::npos) ? -1 : (int)position; }
+    std::string s_;
+};
+
+class Print {
+   public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t data) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size) {
+        size_t written = 0;
+        while ((written < size) && write(buffer[written])) {
+            written++;
+        }
+        return written;
+    }
+    size_t write(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+    size_t print(const String &text) { return write((const uint8_t *)text.c_str(), text.length()); }
+    size_t print(const char *text) { return write(text); }
+    size_t println(const String &text) { return print(text) + write("\r\n"); }
+    size_t println(void) { return write("\r\n"); }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    size_t printf_P(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    virtual void flush(void) {}
+
+   protected:
+    size_t Vprintf(const char *format, va_list args);
+};
+
+class Stream : public Print {
+   public:
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int peek(void) { return -1; }
+    virtual size_t readBytes(char *buffer, size_t length) {
+        size_t count = 0;
+        int c;
+        while ((count < length) && ((c = read()) >= 0)) {
+            buffer[count++] = (char)c;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t *buffer, size_t length) { return readBytes((char *)buffer, length); }
+    // Like the core's timedRead(), a terminator that never comes costs the whole stream timeout
+    String readStringUntil(char terminator) {
+        std::string text;
+        int c;
+        while (((c = read()) >= 0) && (c != terminator)) {
+            text += (char)c;
+        }
+        if (c < 0) {
+            delay(timeout_);
+        }
+        return String(text);
+    }
+    String readString(void) {
+        std::string text;
+        int c;
+        while ((c = read()) >= 0) {
+            text += (char)c;
+        }
+        return String(text);
+    }
+    void setTimeout(unsigned long timeout) { timeout_ = timeout; }
+
+   protected:
+    unsigned long timeout_ = 1000;  // Stream timeout, the core's default
+};
+
+class HardwareSerial : public Stream {
+   public:
+    void begin(unsigned long baud);
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available(void) override;
+    int read(void) override;
+    int availableForWrite(void);
+    void flush(void) override;
+
+   private:
+    unsigned long baud_ = 115200;
+    uint64_t fifo_empty_us_ = 0;     // When the transmit FIFO will have sent everything written
+    const char *p_input_ = nullptr;  // Console input left, from SIM_SERIAL_IN
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+   public:
+    [[noreturn]] void restart(void);
+    uint32_t getFreeHeap(void);
+    uint32_t getFlashChipRealSize(void);
+};
+
+extern EspClass ESP;
+
+#endif  // _HOST_ARDUINO_H_
@@ -0,0 +1,42 @@
+/*
+  ESP8266WiFi.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the ESP8266 WiFi station, the association runs in the
+  background for SIM_WIFI_ASSOC_MS of simulated time
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_ESP8266WIFI_H_
+#define _HOST_ESP8266WIFI_H_
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiServer.h>
+
+enum WiFiMode_t : uint8_t { WIFI_OFF, WIFI_STA, WIFI_AP, WIFI_AP_STA };
+enum wl_status_t : uint8_t { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 };
+
+// Station address, the loopback one on the host
+class IPAddress {
+   public:
+    String toString(void) const { return String("127.0.0.1"); }
+};
+
+class ESP8266WiFiClass {
+   public:
+    bool mode(WiFiMode_t mode);
+    wl_status_t begin(const char ssid[], const char password[]);
+    bool disconnect(bool wifi_off = false);
+    wl_status_t status(void);
+    IPAddress localIP(void);
+
+   private:
+    wl_status_t status_ = WL_DISCONNECTED;
+    uint64_t connect_us_ = UINT64_MAX;  // When the association started by begin() completes
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif  // _HOST_ESP8266WIFI_H_
@@ -0,0 +1,29 @@
+/*
+  ESP8266mDNS.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the mDNS responder, it only shows what is advertised
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_ESP8266MDNS_H_
+#define _HOST_ESP8266MDNS_H_
+
+#include <Arduino.h>
+
+class MDNSResponder {
+   public:
+    bool begin(const char host_name[]);
+    bool addService(const char service[], const char protocol[], uint16_t port);
+    bool update(void) {
+        return true;
+    }
+
+   private:
+    std::string host_name_;
+};
+
+extern MDNSResponder MDNS;
+
+#endif  // _HOST_ESP8266MDNS_H_
@@ -0,0 +1,81 @@
+/*
+  FS.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the ESP8266 filesystem API, backed by a host directory
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_FS_H_
+#define _HOST_FS_H_
+
+#include <Arduino.h>
+
+#include <memory>
+
+class File : public Stream {
+   public:
+    File() {}
+    explicit operator bool() const { return fp_ != nullptr; }
+    size_t write(uint8_t data) override { return write(&data, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available(void) override;
+    int read(void) override;
+    int peek(void) override;
+    size_t read(uint8_t *buffer, size_t size);
+    size_t readBytes(char *buffer, size_t length) override { return read((uint8_t *)buffer, length); }
+    using Stream::readBytes;
+    bool seek(uint32_t position);
+    size_t position(void);
+    size_t size(void);
+    void close(void);
+    void flush(void) override;
+    const char *name(void) { return name_.c_str(); }
+
+   private:
+    friend class FS;
+    std::shared_ptr<FILE> fp_;
+    std::string name_;
+};
+
+class Dir {
+   public:
+    bool next(void);
+    String fileName(void);
+    size_t fileSize(void);
+
+   private:
+    friend class FS;
+    std::shared_ptr<void> dir_;
+    std::string path_;
+    std::string current_;
+};
+
+struct FSInfo {
+    size_t totalBytes;
+    size_t usedBytes;
+    size_t blockSize;
+    size_t pageSize;
+    size_t maxOpenFiles;
+    size_t maxPathLength;
+};
+
+class FS {
+   public:
+    bool begin(void);
+    void end(void);
+    bool format(void);
+    File open(const char *path, const char *mode);
+    File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+    bool exists(const char *path);
+    bool remove(const char *path);
+    bool rename(const char *path_from, const char *path_to);
+    Dir openDir(const char *path);
+    bool info(FSInfo &info);
+};
+
+extern FS SPIFFS;
+
+#endif  // _HOST_FS_H_
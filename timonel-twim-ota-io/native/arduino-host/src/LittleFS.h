@@ -0,0 +1,17 @@
+/*
+  LittleFS.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for LittleFS, sharing the host directory with SPIFFS
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_LITTLEFS_H_
+#define _HOST_LITTLEFS_H_
+
+#include <FS.h>
+
+extern FS LittleFS;
+
+#endif  // _HOST_LITTLEFS_H_
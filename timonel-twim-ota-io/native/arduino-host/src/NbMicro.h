@@ -0,0 +1,28 @@
+/*
+  NbMicro.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the NbMicro TWI slave class
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_NBMICRO_H_
+#define _HOST_NBMICRO_H_
+
+#include <Arduino.h>
+#include <nb-twi-cmd.h>
+
+class NbMicro {
+   public:
+    NbMicro(uint8_t twi_address = 0, uint8_t sda = 0, uint8_t scl = 0);
+    virtual ~NbMicro() {}
+    uint8_t TwiCmdXmit(uint8_t twi_cmd, uint8_t twi_reply, uint8_t twi_reply_arr[] = nullptr, uint8_t reply_size = 0);
+    uint8_t TwiCmdXmit(uint8_t twi_cmd_arr[], uint8_t cmd_size, uint8_t twi_reply, uint8_t twi_reply_arr[] = nullptr, uint8_t reply_size = 0);
+    uint8_t GetTwiAddress(void);
+
+   protected:
+    uint8_t addr_;
+};
+
+#endif  // _HOST_NBMICRO_H_
@@ -0,0 +1,42 @@
+/*
+  TimonelTwiM.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the Timonel TWI master class, talking to a simulated
+  ATtiny85 with the bootloader's packet, page write and erase timing
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_TIMONEL_TWIM_H_
+#define _HOST_TIMONEL_TWIM_H_
+
+#include <Arduino.h>
+#include <NbMicro.h>
+
+#define MST_PACKET_SIZE 32  // Master-to-slave data packet size, as in the library
+#define SLV_PACKET_SIZE 32  // Slave-to-master data packet size, as in the library
+
+class Timonel : public NbMicro {
+   public:
+    struct Status {
+        uint8_t signature = 0;
+        uint8_t version_major = 0;
+        uint8_t version_minor = 0;
+        uint8_t features_code = 0;
+        uint8_t ext_features_code = 0;
+        uint16_t bootloader_start = 0;
+        uint16_t application_start = 0;
+        uint16_t trampoline_addr = 0;
+        uint8_t low_fuse_setting = 0;
+        uint8_t oscillator_cal = 0;
+        uint8_t check_empty_fl = 0;
+    };
+    Timonel(uint8_t twi_address = 0, uint8_t sda = 0, uint8_t scl = 0);
+    Status GetStatus(void);
+    uint8_t RunApplication(void);
+    uint8_t DeleteApplication(void);
+    uint8_t UploadApplication(uint8_t payload[], uint16_t payload_size, const uint16_t start_address = 0);
+};
+
+#endif  // _HOST_TIMONEL_TWIM_H_
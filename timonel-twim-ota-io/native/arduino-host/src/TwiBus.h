@@ -0,0 +1,21 @@
+/*
+  TwiBus.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the TWI bus scanner
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_TWIBUS_H_
+#define _HOST_TWIBUS_H_
+
+#include <Arduino.h>
+
+class TwiBus {
+   public:
+    TwiBus(uint8_t sda = 0, uint8_t scl = 0);
+    uint8_t ScanBus(bool *p_app_mode = nullptr);
+};
+
+#endif  // _HOST_TWIBUS_H_
@@ -0,0 +1,49 @@
+/*
+  WiFiClient.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the TCP client. Requests go to the simulated web server,
+  which answers from SIM_WEB_ROOT; the round trip and the transfer of every
+  byte are charged to the virtual clock. A client accepted by the simulated
+  WiFiServer reads the pushed request instead, and its reply is shown.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_WIFICLIENT_H_
+#define _HOST_WIFICLIENT_H_
+
+#include <Arduino.h>
+
+class WiFiClient : public Stream {
+   public:
+    virtual ~WiFiClient() {}
+    virtual int connect(const char host[], uint16_t port);
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+    int available(void) override;
+    int read(void) override;
+    int peek(void) override;
+    size_t readBytes(char *buffer, size_t length) override;
+    using Stream::readBytes;
+    uint8_t connected(void);
+    void stop(void);
+    explicit operator bool(void) {
+        return connected();
+    }
+    void SimAccept(const std::string &request);
+
+   protected:
+    void Receive(size_t bytes);
+
+   private:
+    bool connected_ = false;
+    bool accepted_ = false;  // Server side of a LAN connection, what is written is the reply
+    bool waiting_ = false;   // A response was produced and its first byte is still on the way
+    std::string request_;    // Request bytes sent so far
+    std::string response_;   // Response bytes not read yet
+    size_t response_ix_ = 0;
+};
+
+#endif  // _HOST_WIFICLIENT_H_
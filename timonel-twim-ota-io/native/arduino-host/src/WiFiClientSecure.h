@@ -0,0 +1,54 @@
+/*
+  WiFiClientSecure.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the BearSSL client: the plain client plus the cost of a
+  TLS handshake on every connection, a full one unless a session saved by
+  an earlier connection is resumed
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_WIFICLIENTSECURE_H_
+#define _HOST_WIFICLIENTSECURE_H_
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+namespace BearSSL {
+
+// TLS session parameters, filled by a successful connection for the next one to resume
+class Session {
+   public:
+    bool valid_ = false;
+};
+
+class WiFiClientSecure : public WiFiClient {
+   public:
+    int connect(const char host[], uint16_t port) override;
+    bool setFingerprint(const char fingerprint[]) {
+        (void)fingerprint;
+        return true;
+    }
+    void setInsecure(void) {}
+    void setSession(Session *p_session) {
+        p_session_ = p_session;
+    }
+    void setBufferSizes(int recv, int xmit);
+    bool getMFLNStatus(void) {
+        return mfln_status_;
+    }
+    static bool probeMaxFragmentLength(const char host[], uint16_t port, uint16_t length);
+
+   private:
+    Session *p_session_ = nullptr;
+    int recv_size_ = 16384;  // Record payload bytes the buffers hold, as BearSSL defaults
+    int xmit_size_ = 512;
+    bool mfln_status_ = false;
+};
+
+}  // namespace BearSSL
+
+using BearSSL::WiFiClientSecure;
+
+#endif  // _HOST_WIFICLIENTSECURE_H_
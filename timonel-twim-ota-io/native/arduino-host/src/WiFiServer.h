@@ -0,0 +1,31 @@
+/*
+  WiFiServer.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the TCP server. A LAN client connects once: at
+  SIM_PUSH_AT_MS it POSTs the image file SIM_PUSH_IMAGE as version
+  SIM_PUSH_VERSION, with the fields of the manifest file SIM_PUSH_MANIFEST
+  (if given) as X-Firmware-* headers.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_WIFISERVER_H_
+#define _HOST_WIFISERVER_H_
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+class WiFiServer {
+   public:
+    WiFiServer(uint16_t port) : port_(port) {}
+    void begin(void);
+    WiFiClient available(void);
+
+   private:
+    uint16_t port_;
+    bool listening_ = false;
+    bool pushed_ = false;  // The simulated LAN client already connected
+};
+
+#endif  // _HOST_WIFISERVER_H_
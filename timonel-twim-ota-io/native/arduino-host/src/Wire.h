@@ -0,0 +1,38 @@
+/*
+  Wire.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the TWI master, on the simulated bus
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_WIRE_H_
+#define _HOST_WIRE_H_
+
+#include <Arduino.h>
+
+#define BUFFER_LENGTH 128  // Bytes per transaction, as in the ESP8266 core
+
+class TwoWire : public Stream {
+   public:
+    void begin(int sda, int scl);
+    void begin(void);
+    void setClock(uint32_t frequency);
+    void beginTransmission(uint8_t address);
+    uint8_t endTransmission(bool send_stop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity);
+    size_t write(uint8_t data) override;
+    using Print::write;
+    int available(void) override;
+    int read(void) override;
+
+   private:
+    uint8_t address_ = 0;
+    uint8_t tx_length_ = 0;
+    uint8_t rx_length_ = 0;
+};
+
+extern TwoWire Wire;
+
+#endif  // _HOST_WIRE_H_
@@ -0,0 +1,301 @@
+/*
+  host-core.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in core: virtual clock, Serial, ESP and the main() that runs
+  setup() and loop() until the update completes, then reports its timing
+  ----------------------------------------------------------------------------
+*/
+
+#include <Arduino.h>
+
+#include <chrono>
+
+#include "host-sim.h"
+#include "ihex-parser.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+SimStats sim_stats;
+
+static uint64_t sim_now_us = 0;
+
+static const char *const SIM_CATEGORY_NAMES[SIM_CATEGORIES] = {
+    "CPU (loop passes)", "delay() waits", "Serial output", "Filesystem", "TLS handshakes",
+    "Network transfers", "TWI traffic", "Slave flash writes", "ESP8266 restarts"};
+
+void setup(void);
+void loop(void);
+
+// Function SimAdvance (every simulated cost goes through here)
+void SimAdvance(uint64_t us, SimCategory category) {
+    sim_now_us += us;
+    sim_stats.category_us[category] += us;
+}
+
+// Function SimNow
+uint64_t SimNow(void) {
+    return sim_now_us;
+}
+
+// Function SimEnvLong
+long SimEnvLong(const char name[], long default_value) {
+    const char *value = getenv(name);
+    return ((value != nullptr) && (*value != '\0')) ? atol(value) : default_value;
+}
+
+// Function SimEnvString
+const char *SimEnvString(const char name[], const char default_value[]) {
+    const char *value = getenv(name);
+    return ((value != nullptr) && (*value != '\0')) ? value : default_value;
+}
+
+unsigned long millis(void) {
+    return (unsigned long)(sim_now_us / 1000);
+}
+
+unsigned long micros(void) {
+    return (unsigned long)sim_now_us;
+}
+
+void delay(unsigned long ms) {
+    SimAdvance((uint64_t)ms * 1000, SIM_DELAY);
+}
+
+void delayMicroseconds(unsigned int us) {
+    SimAdvance(us, SIM_DELAY);
+}
+
+void yield(void) {
+    SimAdvance(SIM_YIELD_US, SIM_CPU);
+}
+
+// Function Print::printf
+size_t Print::printf(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t written = Vprintf(format, args);
+    va_end(args);
+    return written;
+}
+
+// Function Print::printf_P (no PROGMEM on the host)
+size_t Print::printf_P(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t written = Vprintf(format, args);
+    va_end(args);
+    return written;
+}
+
+// Function Print::Vprintf
+size_t Print::Vprintf(const char *format, va_list args) {
+    char text[256];
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int length = vsnprintf(text, sizeof(text), format, args);
+    size_t written;
+    if (length < (int)sizeof(text)) {
+        written = write((const uint8_t *)text, (length > 0) ? length : 0);
+    } else {
+        std::string long_text(length + 1, '\0');
+        vsnprintf(&long_text[0], long_text.size(), format, args_copy);
+        written = write((const uint8_t *)long_text.data(), length);
+    }
+    va_end(args_copy);
+    return written;
+}
+
+// Function HardwareSerial::begin
+// The console input is SIM_SERIAL_IN, typed again after every restart
+void HardwareSerial::begin(unsigned long baud) {
+    baud_ = baud;
+    p_input_ = SimEnvString("SIM_SERIAL_IN", "");
+}
+
+int HardwareSerial::available(void) {
+    return (p_input_ != nullptr) ? strlen(p_input_) : 0;
+}
+
+int HardwareSerial::read(void) {
+    return ((p_input_ != nullptr) && (*p_input_ != '\0')) ? (uint8_t)*p_input_++ : -1;
+}
+
+// Function HardwareSerial::write (10 bits per byte on the wire)
+size_t HardwareSerial::write(uint8_t data) {
+    return write(&data, 1);
+}
+
+// The bytes go into the transmit FIFO, the writer only waits while they don't fit in it
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+    fwrite(buffer, 1, size, stdout);
+    sim_stats.serial_bytes += size;
+    fifo_empty_us_ = std::max(fifo_empty_us_, sim_now_us) + (uint64_t)size * 10 * 1000000 / baud_;
+    uint64_t fifo_us = (uint64_t)SIM_UART_FIFO * 10 * 1000000 / baud_;
+    if (fifo_empty_us_ > sim_now_us + fifo_us) {
+        SimAdvance(fifo_empty_us_ - sim_now_us - fifo_us, SIM_SERIAL);
+    }
+    return size;
+}
+
+// Function HardwareSerial::availableForWrite (room left in the transmit FIFO)
+int HardwareSerial::availableForWrite(void) {
+    uint64_t queued_us = (fifo_empty_us_ > sim_now_us) ? (fifo_empty_us_ - sim_now_us) : 0;
+    uint64_t queued = (queued_us * baud_ + 10 * 1000000 - 1) / (10 * 1000000);
+    return (queued < SIM_UART_FIFO) ? (int)(SIM_UART_FIFO - queued) : 0;
+}
+
+// Function HardwareSerial::flush (waits until the transmit FIFO is empty)
+void HardwareSerial::flush(void) {
+    if (fifo_empty_us_ > sim_now_us) {
+        SimAdvance(fifo_empty_us_ - sim_now_us, SIM_SERIAL);
+    }
+}
+
+// Function EspClass::restart
+// The RAM of the sketch isn't reset, setup() runs again on the same globals
+void EspClass::restart(void) {
+    fflush(stdout);
+    throw SimRestart();
+}
+
+// Function EspClass::getFreeHeap
+uint32_t EspClass::getFreeHeap(void) {
+    return 40000;
+}
+
+// Function EspClass::getFlashChipRealSize
+uint32_t EspClass::getFlashChipRealSize(void) {
+    return 4 * 1024 * 1024;
+}
+
+// Programs with their own main(), like the benchmarks, build with SIM_NO_MAIN
+#ifndef SIM_NO_MAIN
+
+// Function SimUpdateDone (every slave was flashed and is running its new application)
+static bool SimUpdateDone(void) {
+    for (uint8_t ix = 0; ix < SimSlaveCount(); ix++) {
+        if (SimGetSlave(ix)->app_starts == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function SimVerifySlaves
+// Compares every slave flash with the firmware pushed over the LAN, or else the one named by the
+// release manifest in the web root, or by fw-latest.md (older version document)
+static uint8_t SimVerifySlaves(void) {
+    std::string web_root = SimEnvString("SIM_WEB_ROOT", "../fw-attiny85");
+    char version[32] = "";
+    char line[64];
+    FILE *p_file = fopen((web_root + "/fw-manifest.md").c_str(), "r");
+    if (p_file != nullptr) {
+        while ((version[0] == '\0') && (fgets(line, sizeof(line), p_file) != nullptr)) {
+            if (sscanf(line, "version=%31s", version) != 1) {
+                version[0] = '\0';
+            }
+        }
+        fclose(p_file);
+    }
+    if (strcmp(SimEnvString("SIM_PUSH_VERSION", ""), "") != 0) {
+        snprintf(version, sizeof(version), "%s", SimEnvString("SIM_PUSH_VERSION", ""));  // Pushed over the LAN
+    }
+    p_file = (version[0] == '\0') ? fopen((web_root + "/fw-latest.md").c_str(), "r") : nullptr;
+    if (p_file != nullptr) {
+        if (fscanf(p_file, "%31s", version) != 1) {
+            version[0] = '\0';
+        }
+        fclose(p_file);
+    }
+    std::string hex_text;
+    p_file = fopen((web_root + "/firmware-" + version + ".hex").c_str(), "rb");
+    if (p_file != nullptr) {
+        int c;
+        while ((c = fgetc(p_file)) != EOF) {
+            hex_text += (char)c;
+        }
+        fclose(p_file);
+    }
+    uint8_t expected[SIM_FLASH_SIZE];
+    memset(expected, 0xFF, sizeof(expected));
+    size_t payload_size = 0;
+    HexParser hex_parser;
+    bool hex_ok = !hex_text.empty() && (hex_parser.DecodeIHex(hex_text.c_str(), hex_text.size(), expected, SIM_TML_START, &payload_size) == 0);
+    uint8_t failures = 0;
+    for (uint8_t ix = 0; ix < SimSlaveCount(); ix++) {
+        SimSlave *p_slave = SimGetSlave(ix);
+        bool match = hex_ok && (memcmp(p_slave->flash, expected, SIM_TML_START) == 0);
+        printf("[sim] Slave %d/%d: %s firmware %s, %u pages written, %u pages erased\n", p_slave->tml_address, p_slave->app_address,
+               match ? "holds" : "DOESN'T hold", version, p_slave->pages_written, p_slave->pages_erased);
+        failures += match ? 0 : 1;
+    }
+    return failures;
+}
+
+// Function SimReport (the times are the ones at the end of the run, before the output tail)
+static void SimReport(bool done, double host_seconds, uint64_t end_us, const SimStats *p_end_stats) {
+    printf("\n\n[sim] ==========================================================\n");
+    if (done) {
+        printf("[sim] Update completed in %.3f s of simulated time (%.3f s host time)\n", end_us / 1e6, host_seconds);
+    } else {
+        printf("[sim] Update NOT completed after %.3f s of simulated time (%.3f s host time)\n", end_us / 1e6, host_seconds);
+    }
+    for (uint8_t category = 0; category < SIM_CATEGORIES; category++) {
+        if (p_end_stats->category_us[category] > 0) {
+            printf("[sim]   %-20s %10.3f s\n", SIM_CATEGORY_NAMES[category], p_end_stats->category_us[category] / 1e6);
+        }
+    }
+    printf("[sim] Restarts: %u, WiFi associations: %u, TLS handshakes: %u (%u resumed)\n",
+           p_end_stats->restarts, p_end_stats->wifi_associations, p_end_stats->tls_handshakes, p_end_stats->tls_resumed);
+    printf("[sim] HTTP requests: %u (%u not modified), %llu bytes received, %llu bytes sent\n",
+           p_end_stats->http_requests, p_end_stats->http_not_modified,
+           (unsigned long long)p_end_stats->net_rx_bytes, (unsigned long long)p_end_stats->net_tx_bytes);
+    printf("[sim] Filesystem: %llu mounts, %llu opens, %llu accesses\n",
+           (unsigned long long)p_end_stats->fs_mounts, (unsigned long long)p_end_stats->fs_opens, (unsigned long long)p_end_stats->fs_accesses);
+    printf("[sim] TWI: %llu bytes at %u Hz, Serial: %llu bytes\n",
+           (unsigned long long)p_end_stats->twi_bytes, SimTwiClock(), (unsigned long long)p_end_stats->serial_bytes);
+}
+
+// Host entry point
+// Runs until every slave runs its new firmware (or for SIM_RUN_MS if set), SIM_LIMIT_MS at most.
+// Then loop() keeps running for SIM_TAIL_MS, so console output still queued gets printed.
+int main(void) {
+    setvbuf(stdout, nullptr, _IOFBF, 1 << 16);
+    SimBeginFs();
+    SimBeginNet();
+    SimBeginTwi();
+    uint64_t run_us = (uint64_t)SimEnvLong("SIM_RUN_MS", 0) * 1000;
+    uint64_t limit_us = (uint64_t)SimEnvLong("SIM_LIMIT_MS", 600000) * 1000;
+    auto host_start = std::chrono::steady_clock::now();
+    bool done = false;
+    bool running = true;
+    uint64_t end_us = 0;
+    SimStats end_stats;
+    while (running) {
+        try {
+            setup();
+            while ((end_us == 0) || (sim_now_us < end_us + (uint64_t)SIM_TAIL_MS * 1000)) {
+                loop();
+                done = done || SimUpdateDone();
+                if ((end_us == 0) && (((run_us > 0) ? (sim_now_us >= run_us) : done) || (sim_now_us >= limit_us))) {
+                    end_us = sim_now_us;
+                    end_stats = sim_stats;
+                }
+            }
+            running = false;
+        } catch (SimRestart &) {
+            printf("\n[sim] ESP.restart() after %.3f s\n", sim_now_us / 1e6);
+            sim_stats.restarts++;
+            SimAdvance((uint64_t)SIM_BOOT_MS * 1000, SIM_BOOT);
+        }
+    }
+    double host_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - host_start).count();
+    end_stats.serial_bytes = sim_stats.serial_bytes;
+    SimReport(done, host_seconds, end_us, &end_stats);
+    uint8_t failures = SimVerifySlaves();
+    fflush(stdout);
+    return (done && (failures == 0)) ? 0 : 1;
+}
+#endif  // SIM_NO_MAIN
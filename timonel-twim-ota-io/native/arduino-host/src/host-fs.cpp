@@ -0,0 +1,191 @@
+/*
+  host-fs.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in filesystem: SPIFFS and LittleFS map to SIM_FS_ROOT, which is
+  emptied on start unless SIM_KEEP_FS=1 (to simulate a reboot with state)
+  ----------------------------------------------------------------------------
+*/
+
+#include <FS.h>
+#include <LittleFS.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <filesystem>
+
+#include "host-sim.h"
+
+FS SPIFFS;
+FS LittleFS;
+
+static std::string fs_root;
+
+// Function HostPath
+static std::string HostPath(const char *path) {
+    return fs_root + ((path[0] == '/') ? "" : "/") + path;
+}
+
+// Function FsAccess
+static void FsAccess(void) {
+    sim_stats.fs_accesses++;
+    SimAdvance(SIM_FS_ACCESS_US, SIM_FS);
+}
+
+// Function SimBeginFs
+void SimBeginFs(void) {
+    fs_root = SimEnvString("SIM_FS_ROOT", ".pio/sim-fs");
+    if (SimEnvLong("SIM_KEEP_FS", 0) == 0) {
+        std::filesystem::remove_all(fs_root);
+    }
+    std::filesystem::create_directories(fs_root);
+}
+
+bool FS::begin(void) {
+    sim_stats.fs_mounts++;
+    SimAdvance(SIM_FS_MOUNT_US, SIM_FS);
+    return true;
+}
+
+void FS::end(void) {
+}
+
+bool FS::format(void) {
+    std::filesystem::remove_all(fs_root);
+    std::filesystem::create_directories(fs_root);
+    return true;
+}
+
+File FS::open(const char *path, const char *mode) {
+    sim_stats.fs_opens++;
+    SimAdvance(SIM_FS_OPEN_US, SIM_FS);
+    std::string host_mode = std::string(mode) + "b";  // "r", "w", "a", "r+" ... in binary mode
+    File file;
+    FILE *p_file = fopen(HostPath(path).c_str(), host_mode.c_str());
+    if (p_file != nullptr) {
+        file.fp_ = std::shared_ptr<FILE>(p_file, fclose);
+        file.name_ = path;
+    }
+    return file;
+}
+
+bool FS::exists(const char *path) {
+    struct stat file_stat;
+    return stat(HostPath(path).c_str(), &file_stat) == 0;
+}
+
+bool FS::remove(const char *path) {
+    return ::remove(HostPath(path).c_str()) == 0;
+}
+
+// LittleFS refuses to overwrite, and so does this stand-in
+bool FS::rename(const char *path_from, const char *path_to) {
+    if (exists(path_to)) {
+        return false;
+    }
+    return ::rename(HostPath(path_from).c_str(), HostPath(path_to).c_str()) == 0;
+}
+
+Dir FS::openDir(const char *path) {
+    Dir dir;
+    dir.path_ = HostPath(path);
+    DIR *p_dir = opendir(dir.path_.c_str());
+    if (p_dir != nullptr) {
+        dir.dir_ = std::shared_ptr<void>(p_dir, [](void *p) { closedir((DIR *)p); });
+    }
+    return dir;
+}
+
+bool FS::info(FSInfo &info) {
+    info.totalBytes = 1024 * 1024;
+    info.usedBytes = 0;
+    for (const auto &entry : std::filesystem::directory_iterator(fs_root)) {
+        info.usedBytes += entry.is_regular_file() ? entry.file_size() : 0;
+    }
+    info.blockSize = 8192;
+    info.pageSize = 256;
+    info.maxOpenFiles = 5;
+    info.maxPathLength = 32;
+    return true;
+}
+
+size_t File::write(const uint8_t *buffer, size_t size) {
+    FsAccess();
+    return fp_ ? fwrite(buffer, 1, size, fp_.get()) : 0;
+}
+
+int File::available(void) {
+    return fp_ ? (int)(size() - position()) : 0;
+}
+
+int File::read(void) {
+    FsAccess();
+    return fp_ ? fgetc(fp_.get()) : -1;
+}
+
+int File::peek(void) {
+    if (!fp_) {
+        return -1;
+    }
+    int c = fgetc(fp_.get());
+    if (c != EOF) {
+        ungetc(c, fp_.get());
+    }
+    return c;
+}
+
+size_t File::read(uint8_t *buffer, size_t size) {
+    FsAccess();
+    return fp_ ? fread(buffer, 1, size, fp_.get()) : 0;
+}
+
+bool File::seek(uint32_t position) {
+    return fp_ && (fseek(fp_.get(), position, SEEK_SET) == 0);
+}
+
+size_t File::position(void) {
+    return fp_ ? ftell(fp_.get()) : 0;
+}
+
+size_t File::size(void) {
+    if (!fp_) {
+        return 0;
+    }
+    fflush(fp_.get());
+    struct stat file_stat;
+    return (fstat(fileno(fp_.get()), &file_stat) == 0) ? file_stat.st_size : 0;
+}
+
+void File::close(void) {
+    fp_.reset();
+}
+
+void File::flush(void) {
+    if (fp_) {
+        fflush(fp_.get());
+    }
+}
+
+bool Dir::next(void) {
+    if (!dir_) {
+        return false;
+    }
+    struct dirent *p_entry;
+    while ((p_entry = readdir((DIR *)dir_.get())) != nullptr) {
+        if (p_entry->d_name[0] != '.') {
+            current_ = p_entry->d_name;
+            return true;
+        }
+    }
+    return false;
+}
+
+String Dir::fileName(void) {
+    return String(current_);
+}
+
+size_t Dir::fileSize(void) {
+    struct stat file_stat;
+    return (stat((path_ + "/" + current_).c_str(), &file_stat) == 0) ? file_stat.st_size : 0;
+}
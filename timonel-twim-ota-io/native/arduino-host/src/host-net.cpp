@@ -0,0 +1,324 @@
+/*
+  host-net.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Simulated WiFi station and web server. The server answers GET requests
+  with the file of SIM_WEB_ROOT named as the last URL segment, sends an
+  ETag and a Last-Modified header and honours conditional requests. On the
+  LAN side, a single client can push an image to the master's own server.
+  ----------------------------------------------------------------------------
+*/
+
+#include <ESP8266WiFi.h>
+#include <ESP8266mDNS.h>
+#include <WiFiClientSecure.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "host-sim.h"
+
+ESP8266WiFiClass WiFi;
+MDNSResponder MDNS;
+
+static std::string sim_web_root;
+
+// Function SimBeginNet
+void SimBeginNet(void) {
+    sim_web_root = SimEnvString("SIM_WEB_ROOT", "../fw-attiny85");
+}
+
+// Function SimHeaderValue (empty if the request doesn't carry the header)
+static std::string SimHeaderValue(const std::string &request, const char name[]) {
+    std::string key = std::string("\r\n") + name + ":";
+    size_t start = request.find(key);
+    if (start == std::string::npos) {
+        return "";
+    }
+    start = request.find_first_not_of(' ', start + key.size());
+    return request.substr(start, request.find("\r\n", start) - start);
+}
+
+// Function SimServeRequest
+static std::string SimServeRequest(const std::string &request) {
+    sim_stats.http_requests++;
+    size_t path_start = request.find(' ') + 1;
+    std::string path = request.substr(path_start, request.find(' ', path_start) - path_start);
+    std::string file_name = sim_web_root + "/" + path.substr(path.rfind('/') + 1);
+    std::string body;
+    struct stat file_stat;
+    FILE *p_file = fopen(file_name.c_str(), "rb");
+    if ((p_file == nullptr) || (stat(file_name.c_str(), &file_stat) != 0)) {
+        if (p_file != nullptr) {
+            fclose(p_file);
+        }
+        return "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    }
+    int c;
+    while ((c = fgetc(p_file)) != EOF) {
+        body += (char)c;
+    }
+    fclose(p_file);
+    uint32_t hash = 2166136261u;  // FNV-1a
+    for (char ch : body) {
+        hash = (hash ^ (uint8_t)ch) * 16777619u;
+    }
+    char etag[16];
+    snprintf(etag, sizeof(etag), "\"%08x\"", hash);
+    char last_modified[40];
+    strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&file_stat.st_mtime));
+    std::string if_none_match = SimHeaderValue(request, "If-None-Match");
+    std::string if_modified_since = SimHeaderValue(request, "If-Modified-Since");
+    bool not_modified = (if_none_match != "") ? (if_none_match == etag) : (if_modified_since == last_modified);
+    std::string headers = std::string("ETag: ") + etag + "\r\nLast-Modified: " + last_modified + "\r\n";
+    if (not_modified) {
+        sim_stats.http_not_modified++;
+        return "HTTP/1.1 304 Not Modified\r\n" + headers + "Connection: close\r\n\r\n";
+    }
+    return "HTTP/1.1 200 OK\r\n" + headers + "Content-Length: " + std::to_string(body.size()) +
+           "\r\nConnection: close\r\n\r\n" + body;
+}
+
+// ----------------------------------------------------------------------------
+// WiFi station
+// ----------------------------------------------------------------------------
+
+bool ESP8266WiFiClass::mode(WiFiMode_t mode) {
+    (void)mode;
+    return true;
+}
+
+// The association completes in the background, as on the ESP8266. SIM_WIFI_FAILS=n makes the
+// first n associations of the run never complete, as with the access point out of reach.
+wl_status_t ESP8266WiFiClass::begin(const char ssid[], const char password[]) {
+    static uint32_t begin_count = 0;
+    (void)ssid;
+    (void)password;
+    sim_stats.wifi_associations++;
+    begin_count++;
+    status_ = WL_DISCONNECTED;
+    bool fails = (begin_count <= (uint32_t)SimEnvLong("SIM_WIFI_FAILS", 0));
+    connect_us_ = fails ? UINT64_MAX : SimNow() + (uint64_t)SIM_WIFI_ASSOC_MS * 1000;
+    return status_;
+}
+
+bool ESP8266WiFiClass::disconnect(bool wifi_off) {
+    (void)wifi_off;
+    status_ = WL_DISCONNECTED;
+    connect_us_ = UINT64_MAX;
+    return true;
+}
+
+wl_status_t ESP8266WiFiClass::status(void) {
+    if ((status_ != WL_CONNECTED) && (SimNow() >= connect_us_)) {
+        status_ = WL_CONNECTED;
+    }
+    return status_;
+}
+
+IPAddress ESP8266WiFiClass::localIP(void) {
+    return IPAddress();
+}
+
+// ----------------------------------------------------------------------------
+// WiFiClient
+// ----------------------------------------------------------------------------
+
+int WiFiClient::connect(const char host[], uint16_t port) {
+    (void)host;
+    (void)port;
+    if (WiFi.status() != WL_CONNECTED) {
+        return 0;
+    }
+    SimAdvance((uint64_t)SIM_NET_RTT_MS * 1000, SIM_NET);  // TCP handshake
+    connected_ = true;
+    accepted_ = false;
+    waiting_ = false;
+    request_.clear();
+    response_.clear();
+    response_ix_ = 0;
+    return 1;
+}
+
+// The server answers as soon as the request headers are complete, then closes the connection
+size_t WiFiClient::write(const uint8_t *buffer, size_t size) {
+    if (!connected_) {
+        return 0;
+    }
+    request_.append((const char *)buffer, size);
+    sim_stats.net_tx_bytes += size;
+    SimAdvance((uint64_t)size * 8 * 1000000 / SIM_NET_BPS, SIM_NET);
+    if (!accepted_ && (request_.find("\r\n\r\n") != std::string::npos)) {
+        response_ = SimServeRequest(request_);
+        response_ix_ = 0;
+        waiting_ = true;
+        connected_ = false;
+    }
+    return size;
+}
+
+size_t WiFiClient::write(uint8_t data) {
+    return write(&data, 1);
+}
+
+// Function WiFiClient::Receive (half a round trip for the first byte, then the transfer)
+void WiFiClient::Receive(size_t bytes) {
+    if (waiting_) {
+        waiting_ = false;
+        SimAdvance((uint64_t)SIM_NET_RTT_MS * 1000, SIM_NET);
+    }
+    sim_stats.net_rx_bytes += bytes;
+    SimAdvance((uint64_t)bytes * 8 * 1000000 / SIM_NET_BPS, SIM_NET);
+}
+
+int WiFiClient::available(void) {
+    return (int)(response_.size() - response_ix_);
+}
+
+int WiFiClient::read(void) {
+    if (response_ix_ >= response_.size()) {
+        return -1;
+    }
+    Receive(1);
+    return (uint8_t)response_[response_ix_++];
+}
+
+int WiFiClient::peek(void) {
+    return (response_ix_ < response_.size()) ? (uint8_t)response_[response_ix_] : -1;
+}
+
+size_t WiFiClient::readBytes(char *buffer, size_t length) {
+    size_t count = min(length, response_.size() - response_ix_);
+    if (count > 0) {
+        Receive(count);
+        memcpy(buffer, &response_[response_ix_], count);
+        response_ix_ += count;
+    }
+    return count;
+}
+
+// Like the ESP8266 core, a closed connection counts as connected while data is left to read
+uint8_t WiFiClient::connected(void) {
+    return connected_ || (available() > 0);
+}
+
+void WiFiClient::stop(void) {
+    if (accepted_ && connected_) {
+        ::printf("\n[sim] LAN push reply: %s\n", request_.substr(0, request_.find("\r\n")).c_str());
+    }
+    connected_ = false;
+    waiting_ = false;
+    response_.clear();
+    response_ix_ = 0;
+}
+
+// Function WiFiClient::SimAccept (server side of a connection, the request is there to read)
+void WiFiClient::SimAccept(const std::string &request) {
+    connected_ = true;
+    accepted_ = true;
+    waiting_ = true;
+    request_.clear();
+    response_ = request;
+    response_ix_ = 0;
+}
+
+// ----------------------------------------------------------------------------
+// WiFiServer and mDNS
+// ----------------------------------------------------------------------------
+
+void WiFiServer::begin(void) {
+    listening_ = true;
+}
+
+// Function WiFiServer::available (the simulated LAN client, once it is due)
+WiFiClient WiFiServer::available(void) {
+    WiFiClient client;
+    std::string image_name = SimEnvString("SIM_PUSH_IMAGE", "");
+    if (!listening_ || pushed_ || (image_name == "") || (SimNow() < (uint64_t)SimEnvLong("SIM_PUSH_AT_MS", 0) * 1000)) {
+        return client;
+    }
+    pushed_ = true;
+    std::string body;
+    FILE *p_file = fopen(image_name.c_str(), "rb");
+    if (p_file != nullptr) {
+        int c;
+        while ((c = fgetc(p_file)) != EOF) {
+            body += (char)c;
+        }
+        fclose(p_file);
+    }
+    std::string request = "POST /update HTTP/1.1\r\nHost: timonel-ota.local:" + std::to_string(port_) + "\r\n" +
+                          "Content-Type: application/octet-stream\r\n" +
+                          "X-Firmware-Version: " + SimEnvString("SIM_PUSH_VERSION", "") + "\r\n";
+    // Manifest "key=value" lines become X-Firmware-Key headers, as a LAN client would send them
+    char line[64];
+    p_file = fopen(SimEnvString("SIM_PUSH_MANIFEST", ""), "r");
+    while ((p_file != nullptr) && (fgets(line, sizeof(line), p_file) != nullptr)) {
+        std::string field = line;
+        size_t equals = field.find('=');
+        if ((equals != std::string::npos) && (field.compare(0, equals, "version") != 0)) {
+            field.erase(field.find_last_not_of("\r\n") + 1);
+            request += "X-Firmware-" + field.substr(0, equals) + ": " + field.substr(equals + 1) + "\r\n";
+        }
+    }
+    if (p_file != nullptr) {
+        fclose(p_file);
+    }
+    request += "X-Push-Token: " + std::string(SimEnvString("SIM_PUSH_TOKEN", "")) + "\r\n";
+    request += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    printf("\n[sim] LAN client pushing %s (%zu bytes) ...\n", image_name.c_str(), body.size());
+    client.SimAccept(request);
+    return client;
+}
+
+bool MDNSResponder::begin(const char host_name[]) {
+    host_name_ = host_name;
+    return true;
+}
+
+bool MDNSResponder::addService(const char service[], const char protocol[], uint16_t port) {
+    printf("[sim] mDNS: _%s._%s advertised at %s.local:%u\n", service, protocol, host_name_.c_str(), port);
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// WiFiClientSecure
+// ----------------------------------------------------------------------------
+
+// A saved session is resumed with an abbreviated handshake, with no public key operations.
+// The fragment length is only negotiated with receive buffers below the 16 KB default.
+int BearSSL::WiFiClientSecure::connect(const char host[], uint16_t port) {
+    if (!WiFiClient::connect(host, port)) {
+        return 0;
+    }
+    sim_stats.tls_handshakes++;
+    if ((p_session_ != nullptr) && p_session_->valid_) {
+        sim_stats.tls_resumed++;
+        SimAdvance((uint64_t)SIM_TLS_RESUME_MS * 1000, SIM_TLS);
+    } else {
+        SimAdvance((uint64_t)SIM_TLS_HANDSHAKE_MS * 1000, SIM_TLS);
+    }
+    if (p_session_ != nullptr) {
+        p_session_->valid_ = true;
+    }
+    mfln_status_ = (recv_size_ < 16384) && SimEnvLong("SIM_TLS_MFLN", 1);
+    return 1;
+}
+
+void BearSSL::WiFiClientSecure::setBufferSizes(int recv, int xmit) {
+    recv_size_ = recv;
+    xmit_size_ = xmit;
+}
+
+// The probe is a connection of its own, closed after the server hello. SIM_TLS_MFLN=0 makes the
+// server ignore the extension.
+bool BearSSL::WiFiClientSecure::probeMaxFragmentLength(const char host[], uint16_t port, uint16_t length) {
+    (void)host;
+    (void)port;
+    (void)length;
+    if (WiFi.status() != WL_CONNECTED) {
+        return false;
+    }
+    SimAdvance((uint64_t)SIM_NET_RTT_MS * 2 * 1000, SIM_NET);  // TCP handshake, client and server hello
+    return SimEnvLong("SIM_TLS_MFLN", 1) != 0;
+}
@@ -0,0 +1,166 @@
+/*
+  host-sim.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host simulation of the OTA setup: a virtual clock, the timing model of the
+  network, the filesystem, the TWI bus and the ATtiny85 slaves running
+  Timonel, and the end-to-end report. Every model constant can be changed
+  with a -D build flag, the run options with environment variables.
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_SIM_H_
+#define _HOST_SIM_H_
+
+#include <stdint.h>
+
+// ESP8266
+#ifndef SIM_BOOT_MS
+#define SIM_BOOT_MS 350  // Restart until setup() runs
+#endif
+#ifndef SIM_YIELD_US
+#define SIM_YIELD_US 20  // CPU time of a yield(), i.e. of an idle loop() pass
+#endif
+
+// Network
+#ifndef SIM_WIFI_ASSOC_MS
+#define SIM_WIFI_ASSOC_MS 2500  // WiFi association and DHCP
+#endif
+#ifndef SIM_TLS_HANDSHAKE_MS
+#define SIM_TLS_HANDSHAKE_MS 1500  // Full BearSSL handshake on an 80 MHz ESP8266
+#endif
+#ifndef SIM_TLS_RESUME_MS
+#define SIM_TLS_RESUME_MS 120  // Abbreviated handshake resuming a saved session
+#endif
+#ifndef SIM_NET_RTT_MS
+#define SIM_NET_RTT_MS 40  // Round trip to the web server
+#endif
+#ifndef SIM_NET_BPS
+#define SIM_NET_BPS 2000000  // Effective TLS download rate (bits/s)
+#endif
+
+// Filesystem
+#ifndef SIM_FS_MOUNT_US
+#define SIM_FS_MOUNT_US 30000  // LittleFS mount
+#endif
+#ifndef SIM_FS_OPEN_US
+#define SIM_FS_OPEN_US 800  // File open, including the metadata lookup
+#endif
+#ifndef SIM_FS_ACCESS_US
+#define SIM_FS_ACCESS_US 60  // Any read or write call on an open file
+#endif
+
+// Serial console
+#ifndef SIM_UART_FIFO
+#define SIM_UART_FIFO 128  // ESP8266 UART transmit FIFO, writes only wait for room beyond it
+#endif
+#ifndef SIM_TAIL_MS
+#define SIM_TAIL_MS 500  // Loop passes after the update completes, so console output still queued gets out
+#endif
+
+// TWI bus and Timonel bootloader
+#ifndef SIM_TWI_CLOCK_HZ
+#define SIM_TWI_CLOCK_HZ 100000  // Bus clock until Wire.setClock() is called
+#endif
+#ifndef SIM_TML_PACKET_SIZE
+#define SIM_TML_PACKET_SIZE 32  // Page data bytes per write packet the bootloader is built for, other sizes are refused
+#endif
+#ifndef SIM_TML_PACKET_GAP_US
+#define SIM_TML_PACKET_GAP_US 250  // Master pause after each packet while the slave stores it
+#endif
+#ifndef SIM_TML_PAGE_WRITE_US
+#define SIM_TML_PAGE_WRITE_US 4500  // ATtiny85 page write
+#endif
+#ifndef SIM_TML_PAGE_ERASE_US
+#define SIM_TML_PAGE_ERASE_US 4500  // ATtiny85 page erase
+#endif
+#ifndef SIM_TML_START
+#define SIM_TML_START 0x1A40  // Timonel bootloader start, the application flash ends here
+#endif
+#ifndef SIM_TML_BOOT_US
+#define SIM_TML_BOOT_US 150000  // Slave reset until Timonel answers
+#endif
+#ifndef SIM_APP_BOOT_US
+#define SIM_APP_BOOT_US 50000  // Timonel exit until the application answers
+#endif
+#ifndef SIM_TML_ADDR
+#define SIM_TML_ADDR 11  // Timonel address of the first slave
+#endif
+#ifndef SIM_APP_ADDR
+#define SIM_APP_ADDR 54  // Application address of the first slave
+#endif
+#ifndef SIM_MAX_SLAVES
+#define SIM_MAX_SLAVES 8
+#endif
+
+#define SIM_FLASH_SIZE 8192
+#define SIM_PAGE_SIZE 64
+
+// Simulated time categories, for the report
+enum SimCategory : uint8_t {
+    SIM_CPU,     // yield() and loop() passes
+    SIM_DELAY,   // delay() calls (mostly polling waits)
+    SIM_SERIAL,  // Serial output at the configured baud rate
+    SIM_FS,      // Filesystem mounts and accesses
+    SIM_TLS,     // TLS handshakes
+    SIM_NET,     // Request round trips and transfers
+    SIM_TWI,     // TWI traffic
+    SIM_FLASH,   // Slave page writes the master waits for
+    SIM_BOOT,    // ESP8266 restarts
+    SIM_CATEGORIES
+};
+
+// ATtiny85 running Timonel, or an application that can be reset into it
+struct SimSlave {
+    uint8_t tml_address;
+    uint8_t app_address;
+    bool in_bootloader;
+    uint64_t busy_until_us;  // The slave doesn't acknowledge its address until then
+    uint8_t flash[SIM_FLASH_SIZE];
+    uint8_t page_buffer[SIM_PAGE_SIZE];  // Write packets received since the page address was set
+    uint32_t page_address;
+    uint8_t page_fill;
+    uint32_t pages_written;
+    uint32_t pages_erased;
+    uint32_t app_starts;  // Applications started after at least one page was written
+};
+
+// Counters shown in the report
+struct SimStats {
+    uint64_t category_us[SIM_CATEGORIES];
+    uint32_t restarts;
+    uint32_t wifi_associations;
+    uint32_t tls_handshakes;
+    uint32_t tls_resumed;
+    uint32_t http_requests;
+    uint32_t http_not_modified;
+    uint64_t net_rx_bytes;
+    uint64_t net_tx_bytes;
+    uint64_t twi_bytes;
+    uint64_t fs_mounts;
+    uint64_t fs_opens;
+    uint64_t fs_accesses;
+    uint64_t serial_bytes;
+};
+
+struct SimRestart {};  // Thrown by ESP.restart(), caught by the host main()
+
+void SimAdvance(uint64_t us, SimCategory category);
+uint64_t SimNow(void);
+long SimEnvLong(const char name[], long default_value);
+const char *SimEnvString(const char name[], const char default_value[]);
+
+void SimBeginFs(void);
+void SimBeginNet(void);
+void SimBeginTwi(void);
+uint8_t SimSlaveCount(void);
+SimSlave *SimGetSlave(uint8_t ix);
+SimSlave *SimFindSlave(uint8_t twi_address);
+bool SimSlaveAnswers(SimSlave *p_slave);
+void SimTwiTransfer(uint32_t bytes);
+uint32_t SimTwiClock(void);
+
+extern SimStats sim_stats;
+
+#endif  // _HOST_SIM_H_
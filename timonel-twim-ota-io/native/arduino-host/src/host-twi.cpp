@@ -0,0 +1,367 @@
+/*
+  host-twi.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Simulated TWI bus with SIM_SLAVES ATtiny85 slaves. Each one runs an
+  application until it is reset into Timonel, which then takes write packets,
+  programs pages (erasing the ones not blank) and erases the application,
+  without acknowledging its address while the flash is busy. Pages come
+  either from UploadApplication, which waits for every page write, or from
+  page address and write packet commands, which return as soon as the last
+  packet of a page is stored.
+  ----------------------------------------------------------------------------
+*/
+
+#include <NbMicro.h>
+#include <TimonelTwiM.h>
+#include <TwiBus.h>
+#include <Wire.h>
+
+#include "host-sim.h"
+#include "ihex-parser.h"
+
+TwoWire Wire;
+
+static SimSlave sim_slaves[SIM_MAX_SLAVES];
+static uint8_t sim_slave_count = 0;
+static uint32_t sim_twi_clock = SIM_TWI_CLOCK_HZ;
+
+// Function SimBeginTwi
+// SIM_SLAVE_HEX optionally preloads every slave with a running application
+void SimBeginTwi(void) {
+    long slave_count = SimEnvLong("SIM_SLAVES", 1);
+    sim_slave_count = (slave_count < 1) ? 1 : ((slave_count > SIM_MAX_SLAVES) ? SIM_MAX_SLAVES : slave_count);
+    uint8_t application[SIM_FLASH_SIZE];
+    memset(application, 0xFF, sizeof(application));
+    const char *hex_file_name = SimEnvString("SIM_SLAVE_HEX", "");
+    if (*hex_file_name != '\0') {
+        std::string hex_text;
+        FILE *p_file = fopen(hex_file_name, "rb");
+        if (p_file != nullptr) {
+            int c;
+            while ((c = fgetc(p_file)) != EOF) {
+                hex_text += (char)c;
+            }
+            fclose(p_file);
+        }
+        size_t payload_size = 0;
+        HexParser hex_parser;
+        if (hex_text.empty() || (hex_parser.DecodeIHex(hex_text.c_str(), hex_text.size(), application, SIM_TML_START, &payload_size) != 0)) {
+            printf("[sim] Can't load \"%s\", the slaves start blank\n", hex_file_name);
+            memset(application, 0xFF, sizeof(application));
+        }
+    }
+    for (uint8_t ix = 0; ix < sim_slave_count; ix++) {
+        SimSlave *p_slave = &sim_slaves[ix];
+        memset(p_slave, 0, sizeof(SimSlave));
+        p_slave->tml_address = SIM_TML_ADDR + ix;
+        p_slave->app_address = SIM_APP_ADDR + ix;
+        p_slave->in_bootloader = false;
+        memcpy(p_slave->flash, application, SIM_FLASH_SIZE);
+    }
+}
+
+// Function SimSlaveCount
+uint8_t SimSlaveCount(void) {
+    return sim_slave_count;
+}
+
+// Function SimGetSlave
+SimSlave *SimGetSlave(uint8_t ix) {
+    return &sim_slaves[ix];
+}
+
+// Function SimFindSlave (the slave using an address now, busy or not)
+SimSlave *SimFindSlave(uint8_t twi_address) {
+    for (uint8_t ix = 0; ix < sim_slave_count; ix++) {
+        SimSlave *p_slave = &sim_slaves[ix];
+        if ((p_slave->in_bootloader ? p_slave->tml_address : p_slave->app_address) == twi_address) {
+            return p_slave;
+        }
+    }
+    return nullptr;
+}
+
+// Function SimSlaveAnswers
+bool SimSlaveAnswers(SimSlave *p_slave) {
+    return (p_slave != nullptr) && (SimNow() >= p_slave->busy_until_us);
+}
+
+// Function SimTwiTransfer
+// One transaction: a start, "bytes" bytes of 8 bits plus acknowledge (address included), a stop
+void SimTwiTransfer(uint32_t bytes) {
+    sim_stats.twi_bytes += bytes;
+    SimAdvance(((uint64_t)bytes * 9 + 2) * 1000000 / sim_twi_clock, SIM_TWI);
+}
+
+// Function SimTwiClock
+uint32_t SimTwiClock(void) {
+    return sim_twi_clock;
+}
+
+// Function SimUploadFails
+// SIM_FAIL_UPLOAD=n makes the n-th upload of the run (an UploadApplication call or a page address
+// set) and the SIM_FAIL_COUNT (2) after it fail, as a bus glitch would
+static bool SimUploadFails(void) {
+    static uint32_t upload_count = 0;
+    long fail_upload = SimEnvLong("SIM_FAIL_UPLOAD", 0);
+    upload_count++;
+    return (fail_upload > 0) && (upload_count >= (uint32_t)fail_upload) &&
+           (upload_count < (uint32_t)(fail_upload + SimEnvLong("SIM_FAIL_COUNT", 2)));
+}
+
+// Function SimPacketMissed
+// SIM_TWI_MAX_CLOCK=hz makes the slaves miss write packets sent with the bus clock above it, as
+// long or loaded bus lines do
+static bool SimPacketMissed(void) {
+    return sim_twi_clock > (uint32_t)SimEnvLong("SIM_TWI_MAX_CLOCK", 1000000);
+}
+
+// Function SimProgramPage (the slave is busy until the page is erased, if not blank, and written)
+static void SimProgramPage(SimSlave *p_slave, uint32_t page_address, const uint8_t page[]) {
+    uint64_t busy_us = SIM_TML_PAGE_WRITE_US;
+    for (uint8_t ix = 0; ix < SIM_PAGE_SIZE; ix++) {
+        if (p_slave->flash[page_address + ix] != 0xFF) {
+            busy_us += SIM_TML_PAGE_ERASE_US;
+            p_slave->pages_erased++;
+            break;
+        }
+    }
+    memcpy(&p_slave->flash[page_address], page, SIM_PAGE_SIZE);
+    p_slave->pages_written++;
+    p_slave->busy_until_us = SimNow() + busy_us;
+}
+
+// ----------------------------------------------------------------------------
+// Wire
+// ----------------------------------------------------------------------------
+
+void TwoWire::begin(int sda, int scl) {
+    (void)sda;
+    (void)scl;
+}
+
+void TwoWire::begin(void) {
+}
+
+void TwoWire::setClock(uint32_t frequency) {
+    sim_twi_clock = frequency;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    address_ = address;
+    tx_length_ = 0;
+}
+
+// Returns 0 on acknowledge, 2 if no slave acknowledged the address
+uint8_t TwoWire::endTransmission(bool send_stop) {
+    (void)send_stop;
+    SimTwiTransfer(1 + tx_length_);
+    return SimSlaveAnswers(SimFindSlave(address_)) ? 0 : 2;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity) {
+    SimTwiTransfer(1 + quantity);
+    rx_length_ = SimSlaveAnswers(SimFindSlave(address)) ? quantity : 0;
+    return rx_length_;
+}
+
+size_t TwoWire::write(uint8_t data) {
+    (void)data;
+    tx_length_++;
+    return 1;
+}
+
+int TwoWire::available(void) {
+    return rx_length_;
+}
+
+int TwoWire::read(void) {
+    if (rx_length_ == 0) {
+        return -1;
+    }
+    rx_length_--;
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// TwiBus
+// ----------------------------------------------------------------------------
+
+TwiBus::TwiBus(uint8_t sda, uint8_t scl) {
+    (void)sda;
+    (void)scl;
+}
+
+// Probes the addresses in ascending order, returns the first one acknowledged (0 if none)
+uint8_t TwiBus::ScanBus(bool *p_app_mode) {
+    for (uint8_t twi_address = LOW_TML_ADDR; twi_address < 120; twi_address++) {
+        SimTwiTransfer(1);
+        if (SimSlaveAnswers(SimFindSlave(twi_address))) {
+            if (p_app_mode != nullptr) {
+                *p_app_mode = (twi_address > HIG_TML_ADDR);
+            }
+            return twi_address;
+        }
+    }
+    return 0;
+}
+
+// ----------------------------------------------------------------------------
+// NbMicro
+// ----------------------------------------------------------------------------
+
+NbMicro::NbMicro(uint8_t twi_address, uint8_t sda, uint8_t scl) : addr_(twi_address) {
+    (void)sda;
+    (void)scl;
+}
+
+// Sends a command and reads its reply, a reset sends the slave into Timonel. Page address and write
+// packet commands are acknowledged with their checksum (the sum of their argument bytes), the
+// last packet of a page starts its write. A write packet not of the bootloader's size is refused.
+uint8_t NbMicro::TwiCmdXmit(uint8_t twi_cmd, uint8_t twi_reply, uint8_t twi_reply_arr[], uint8_t reply_size) {
+    return TwiCmdXmit(&twi_cmd, 1, twi_reply, twi_reply_arr, reply_size);
+}
+
+uint8_t NbMicro::TwiCmdXmit(uint8_t twi_cmd_arr[], uint8_t cmd_size, uint8_t twi_reply, uint8_t twi_reply_arr[], uint8_t reply_size) {
+    SimTwiTransfer(1 + cmd_size);
+    SimSlave *p_slave = SimFindSlave(addr_);
+    if (!SimSlaveAnswers(p_slave)) {
+        return 1;
+    }
+    bool page_command = (twi_cmd_arr[0] == STPGADDR) || (twi_cmd_arr[0] == WRITPAGE);
+    if (page_command && (!p_slave->in_bootloader || SimPacketMissed() || ((twi_cmd_arr[0] == STPGADDR) && SimUploadFails()))) {
+        return 1;
+    }
+    if ((twi_cmd_arr[0] == WRITPAGE) && (cmd_size != 1 + SIM_TML_PACKET_SIZE + 1)) {
+        return 1;
+    }
+    SimTwiTransfer(2 + reply_size);
+    if (twi_reply_arr != nullptr) {
+        memset(twi_reply_arr, 0, reply_size);
+    }
+    uint8_t checksum = 0;
+    for (uint8_t ix = 1; ix < cmd_size - 1; ix++) {
+        checksum += twi_cmd_arr[ix];
+    }
+    if (twi_cmd_arr[0] == RESETMCU) {
+        p_slave->in_bootloader = true;
+        p_slave->busy_until_us = SimNow() + SIM_TML_BOOT_US;
+    } else if (twi_cmd_arr[0] == STPGADDR) {
+        p_slave->page_address = ((twi_cmd_arr[1] << 8) | twi_cmd_arr[2]) & ~(SIM_PAGE_SIZE - 1);
+        p_slave->page_fill = 0;
+    } else if (twi_cmd_arr[0] == WRITPAGE) {
+        uint8_t packet_size = min((uint8_t)SIM_TML_PACKET_SIZE, (uint8_t)(SIM_PAGE_SIZE - p_slave->page_fill));
+        memcpy(&p_slave->page_buffer[p_slave->page_fill], &twi_cmd_arr[1], packet_size);
+        p_slave->page_fill += packet_size;
+        if (p_slave->page_fill == SIM_PAGE_SIZE) {
+            if ((p_slave->page_address + SIM_PAGE_SIZE) > SIM_TML_START) {
+                return 1;  // Timonel doesn't overwrite itself
+            }
+            SimProgramPage(p_slave, p_slave->page_address, p_slave->page_buffer);
+            p_slave->page_address += SIM_PAGE_SIZE;
+            p_slave->page_fill = 0;
+        }
+    }
+    if (page_command && (twi_reply_arr != nullptr) && (reply_size >= 2)) {
+        twi_reply_arr[0] = twi_reply;
+        twi_reply_arr[1] = checksum;
+    }
+    return 0;
+}
+
+uint8_t NbMicro::GetTwiAddress(void) {
+    return addr_;
+}
+
+// ----------------------------------------------------------------------------
+// Timonel
+// ----------------------------------------------------------------------------
+
+Timonel::Timonel(uint8_t twi_address, uint8_t sda, uint8_t scl) : NbMicro(twi_address, sda, scl) {
+}
+
+Timonel::Status Timonel::GetStatus(void) {
+    Status status;
+    uint8_t reply[9];
+    SimSlave *p_slave = SimFindSlave(addr_);
+    if ((TwiCmdXmit(GETTMNLV, ACKTMNLV, reply, sizeof(reply)) == 0) && p_slave->in_bootloader) {
+        status.signature = 84;  // 'T'
+        status.version_major = 1;
+        status.version_minor = 5;
+        status.bootloader_start = SIM_TML_START;
+        status.check_empty_fl = (p_slave->flash[0] == 0xFF);
+    }
+    return status;
+}
+
+uint8_t Timonel::RunApplication(void) {
+    SimSlave *p_slave = SimFindSlave(addr_);
+    if (TwiCmdXmit(EXITTMNL, ACKEXITT) != 0) {
+        return 1;
+    }
+    p_slave->in_bootloader = false;
+    p_slave->busy_until_us = SimNow() + SIM_APP_BOOT_US;
+    if (p_slave->pages_written > 0) {
+        p_slave->app_starts++;
+    }
+    return 0;
+}
+
+// The erase runs on the slave, the master gets the bus back at once
+uint8_t Timonel::DeleteApplication(void) {
+    SimSlave *p_slave = SimFindSlave(addr_);
+    if ((TwiCmdXmit(DELFLASH, ACKDELFL) != 0) || !p_slave->in_bootloader) {
+        return 1;
+    }
+    uint16_t page_count = SIM_TML_START / SIM_PAGE_SIZE;
+    memset(p_slave->flash, 0xFF, SIM_TML_START);
+    p_slave->pages_erased += page_count;
+    p_slave->busy_until_us = SimNow() + (uint64_t)page_count * SIM_TML_PAGE_ERASE_US;
+    return 0;
+}
+
+// Every page goes out in write packets of the library's size, then the master waits while the slave
+// programs it. A failed upload (see SimUploadFails and SimPacketMissed), or packets of a size the
+// bootloader wasn't built for, stops midway, leaving the page not written.
+uint8_t Timonel::UploadApplication(uint8_t payload[], uint16_t payload_size, const uint16_t start_address) {
+    SimSlave *p_slave = SimFindSlave(addr_);
+    if (!SimSlaveAnswers(p_slave) || !p_slave->in_bootloader) {
+        SimTwiTransfer(1);
+        return 1;
+    }
+    bool upload_fails = SimUploadFails();
+    if (SimPacketMissed() || upload_fails || (MST_PACKET_SIZE != SIM_TML_PACKET_SIZE)) {
+        SimTwiTransfer(1 + 1 + MST_PACKET_SIZE + 1);
+        return 1;
+    }
+    uint8_t errors = 0;
+    for (uint32_t offset = 0; offset < payload_size; offset += SIM_PAGE_SIZE) {
+        uint32_t page_address = (start_address + offset) & ~(SIM_PAGE_SIZE - 1);
+        if ((page_address + SIM_PAGE_SIZE) > SIM_TML_START) {
+            errors++;
+            break;
+        }
+        uint8_t page[SIM_PAGE_SIZE];
+        memset(page, 0xFF, SIM_PAGE_SIZE);
+        memcpy(page, &payload[offset], min((uint32_t)SIM_PAGE_SIZE, payload_size - offset));
+        for (uint8_t packet = 0; packet < SIM_PAGE_SIZE; packet += MST_PACKET_SIZE) {
+            SimTwiTransfer(1 + 1 + MST_PACKET_SIZE + 1);  // Address, command, data, checksum
+            SimTwiTransfer(1 + 2);                        // Address, reply, checksum
+            SimAdvance(SIM_TML_PACKET_GAP_US, SIM_TWI);
+        }
+        bool blank = true;
+        for (uint8_t ix = 0; ix < SIM_PAGE_SIZE; ix++) {
+            blank = blank && (p_slave->flash[page_address + ix] == 0xFF);
+        }
+        if (!blank) {
+            SimAdvance(SIM_TML_PAGE_ERASE_US, SIM_FLASH);
+            p_slave->pages_erased++;
+        }
+        SimAdvance(SIM_TML_PAGE_WRITE_US, SIM_FLASH);
+        memcpy(&p_slave->flash[page_address], page, SIM_PAGE_SIZE);
+        p_slave->pages_written++;
+    }
+    return errors;
+}
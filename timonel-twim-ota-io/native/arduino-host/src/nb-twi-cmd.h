@@ -0,0 +1,29 @@
+/*
+  nb-twi-cmd.h
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Host stand-in for the NB TWI command set, only what the OTA code uses
+  ----------------------------------------------------------------------------
+*/
+
+#ifndef _HOST_NB_TWI_CMD_H_
+#define _HOST_NB_TWI_CMD_H_
+
+#define RESETMCU 0x80  // Reset the slave microcontroller
+#define ACKRESET 0x7F  // Reset acknowledge
+#define GETTMNLV 0x82  // Get the Timonel status
+#define ACKTMNLV 0x7D
+#define EXITTMNL 0x86  // Exit Timonel, run the application
+#define ACKEXITT 0x79
+#define DELFLASH 0x87  // Delete the application
+#define ACKDELFL 0x78
+#define STPGADDR 0x88  // Set the address of the page to write
+#define AKPGADDR 0x77
+#define WRITPAGE 0x89  // Write a data packet to the page buffer
+#define ACKWTPAG 0x76
+
+#define LOW_TML_ADDR 8   // Lowest Timonel TWI address
+#define HIG_TML_ADDR 35  // Highest Timonel TWI address
+
+#endif  // _HOST_NB_TWI_CMD_H_
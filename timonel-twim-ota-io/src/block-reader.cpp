@@ -0,0 +1,87 @@
+/*
+  block-reader.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Buffered file reader
+  ----------------------------------------------------------------------------
+*/
+
+#include "block-reader.h"
+
+// Constructor (the buffer belongs to the caller, no heap is used)
+BlockReader::BlockReader(File &file, uint8_t buffer[], size_t buffer_size)
+    : file_(file), buffer_(buffer), buffer_size_(buffer_size) {
+}
+
+// Function available (bytes left, buffered or still in the file)
+int BlockReader::available(void) {
+    return (buffer_len_ - buffer_ix_) + file_.available();
+}
+
+// Function read
+int BlockReader::read(void) {
+    if ((buffer_ix_ == buffer_len_) && !Refill()) {
+        return -1;
+    }
+    return buffer_[buffer_ix_++];
+}
+
+// Function peek
+int BlockReader::peek(void) {
+    if ((buffer_ix_ == buffer_len_) && !Refill()) {
+        return -1;
+    }
+    return buffer_[buffer_ix_];
+}
+
+// Function readBytes (Stream interface, never waits)
+size_t BlockReader::readBytes(char *buffer, size_t length) {
+    return ReadBlock((uint8_t *)buffer, length);
+}
+
+// Function write (read-only stream)
+size_t BlockReader::write(uint8_t data) {
+    (void)data;
+    return 0;
+}
+
+// Function ReadBlock
+// Copies from the buffer, requests as large as the buffer go straight to the file
+size_t BlockReader::ReadBlock(uint8_t data[], size_t length) {
+    size_t bytes_read = 0;
+    while (bytes_read < length) {
+        if (buffer_ix_ == buffer_len_) {
+            if ((length - bytes_read) >= buffer_size_) {
+                size_t direct_len = file_.read(&data[bytes_read], length - bytes_read);
+                flash_reads_++;
+                bytes_read += direct_len;
+                break;
+            }
+            if (!Refill()) {
+                break;
+            }
+        }
+        size_t copy_len = buffer_len_ - buffer_ix_;
+        if (copy_len > (length - bytes_read)) {
+            copy_len = length - bytes_read;
+        }
+        memcpy(&data[bytes_read], &buffer_[buffer_ix_], copy_len);
+        buffer_ix_ += copy_len;
+        bytes_read += copy_len;
+    }
+    return bytes_read;
+}
+
+// Function GetFlashReads
+uint32_t BlockReader::GetFlashReads(void) {
+    return flash_reads_;
+}
+
+// Function Refill
+bool BlockReader::Refill(void) {
+    buffer_ix_ = 0;
+    buffer_len_ = file_.read(buffer_, buffer_size_);
+    flash_reads_++;
+    return buffer_len_ > 0;
+}
@@ -0,0 +1,216 @@
+/*
+  fs-session.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Filesystem session with an in-RAM state file cache
+  ----------------------------------------------------------------------------
+*/
+
+#include "fs-session.h"
+
+#include "ota-log.h"
+
+FsSession fs_session;  // Shared by every module that touches the filesystem
+
+// Function Mount (only the first call mounts, a failed mount is retried on the next call)
+bool FsSession::Mount(void) {
+    if (!mounted_) {
+        mounted_ = OTA_FS.begin();
+        if (!mounted_) {
+            LOG_ERROR("[%s] Error mounting the file system!\n\r", __func__);
+        }
+    }
+    return mounted_;
+}
+
+// Function Unmount (open files must be closed first, the cache stays valid)
+void FsSession::Unmount(void) {
+    if (mounted_) {
+        OTA_FS.end();
+        mounted_ = false;
+    }
+}
+
+// Function CacheFile
+// Registers a small state file to be kept in RAM, the name must outlive the session
+bool FsSession::CacheFile(const char file_name[]) {
+    if (FindEntry(file_name) != nullptr) {
+        return true;
+    }
+    for (uint8_t slot = 0; slot < FS_CACHE_SLOTS; slot++) {
+        if (cache_[slot].file_name == nullptr) {
+            cache_[slot].file_name = file_name;
+            cache_[slot].loaded = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function Exists
+bool FsSession::Exists(const char file_name[]) {
+    CacheEntry *p_entry = FindEntry(file_name);
+    if ((p_entry != nullptr) && LoadEntry(p_entry)) {
+        return p_entry->exists;
+    }
+    return Mount() && OTA_FS.exists(file_name);
+}
+
+// Function ReadFile (empty if the file is missing)
+String FsSession::ReadFile(const char file_name[]) {
+    CacheEntry *p_entry = FindEntry(file_name);
+    if ((p_entry != nullptr) && LoadEntry(p_entry)) {
+        return p_entry->data;
+    }
+    String file_data = "";
+    if (!Mount()) {
+        return file_data;
+    }
+    File file = OTA_FS.open(file_name, "r");
+    if (file) {
+        ReadString(file, &file_data);
+        file.close();
+    }
+    return file_data;
+}
+
+// Function WriteFile (write-through: the cache is updated only if the file was written)
+bool FsSession::WriteFile(const char file_name[], const String file_data) {
+    bool written = WriteBlock(file_name, (const uint8_t *)file_data.c_str(), file_data.length());
+    CacheEntry *p_entry = FindEntry(file_name);
+    if (p_entry != nullptr) {
+        // A failed write leaves the file content unknown
+        p_entry->loaded = written && (file_data.length() <= FS_CACHE_MAX_LEN);
+        p_entry->exists = true;
+        p_entry->data = file_data;
+    }
+    return written;
+}
+
+// Function ReadBlock
+// Reads up to "capacity" bytes from "offset" in a single file access, returns the bytes read
+size_t FsSession::ReadBlock(const char file_name[], uint8_t buffer[], size_t capacity, uint32_t offset) {
+    if (!Mount()) {
+        return 0;
+    }
+    File file = OTA_FS.open(file_name, "r");
+    if (!file) {
+        return 0;
+    }
+    size_t bytes_read = 0;
+    if (file.seek(offset)) {
+        bytes_read = file.read(buffer, capacity);
+    }
+    file.close();
+    return bytes_read;
+}
+
+// Function WriteBlock (cached files must be written with WriteFile, or the cache goes stale)
+bool FsSession::WriteBlock(const char file_name[], const uint8_t data[], size_t length, bool append) {
+    if (!Mount()) {
+        return false;
+    }
+    File file = OTA_FS.open(file_name, append ? "a" : "w");
+    if (!file) {
+        return false;
+    }
+    bool written = (file.write(data, length) == length);
+    file.close();
+    return written;
+}
+
+// Function Remove
+bool FsSession::Remove(const char file_name[]) {
+    if (!Mount()) {
+        return false;
+    }
+    bool removed = OTA_FS.remove(file_name);
+    CacheEntry *p_entry = FindEntry(file_name);
+    if (p_entry != nullptr) {
+        p_entry->loaded = true;
+        p_entry->exists = false;
+        p_entry->data = "";
+    }
+    return removed;
+}
+
+// Function Rename (if the destination exists, it is overwritten)
+bool FsSession::Rename(const char source_file_name[], const char destination_file_name[]) {
+    if (!Mount()) {
+        return false;
+    }
+    OTA_FS.remove(destination_file_name);
+    bool renamed = OTA_FS.rename(source_file_name, destination_file_name);
+    CacheEntry *p_source = FindEntry(source_file_name);
+    CacheEntry *p_destination = FindEntry(destination_file_name);
+    if (p_destination != nullptr) {
+        if (renamed && (p_source != nullptr) && p_source->loaded) {
+            *p_destination = *p_source;
+            p_destination->file_name = destination_file_name;
+        } else {
+            p_destination->loaded = false;
+        }
+    }
+    if (p_source != nullptr) {
+        p_source->loaded = false;
+    }
+    return renamed;
+}
+
+// Function Format (every cached file is gone afterwards)
+bool FsSession::Format(void) {
+    Mount();
+    bool formatted = OTA_FS.format();
+    for (uint8_t slot = 0; slot < FS_CACHE_SLOTS; slot++) {
+        cache_[slot].loaded = false;
+    }
+    return formatted;
+}
+
+// Function ReadString
+// Reads a whole file into a String reserved to its size, in blocks instead of byte by byte
+void FsSession::ReadString(File &file, String *p_data) {
+    char block[FS_BLOCK_SIZE];
+    p_data->reserve(file.size());
+    size_t block_len;
+    while ((block_len = file.read((uint8_t *)block, FS_BLOCK_SIZE)) > 0) {
+        p_data->concat(block, block_len);
+    }
+}
+
+// Function FindEntry
+FsSession::CacheEntry *FsSession::FindEntry(const char file_name[]) {
+    for (uint8_t slot = 0; slot < FS_CACHE_SLOTS; slot++) {
+        if ((cache_[slot].file_name != nullptr) && (strcmp(cache_[slot].file_name, file_name) == 0)) {
+            return &cache_[slot];
+        }
+    }
+    return nullptr;
+}
+
+// Function LoadEntry
+// Reads a cached file once, files too long to be cached are always read from flash
+bool FsSession::LoadEntry(CacheEntry *p_entry) {
+    if (p_entry->loaded) {
+        return true;
+    }
+    if (!Mount()) {
+        return false;
+    }
+    p_entry->exists = OTA_FS.exists(p_entry->file_name);
+    p_entry->data = "";
+    if (p_entry->exists) {
+        File file = OTA_FS.open(p_entry->file_name, "r");
+        if (!file || (file.size() > FS_CACHE_MAX_LEN)) {
+            if (file) {
+                file.close();
+            }
+            return false;
+        }
+        ReadString(file, &p_entry->data);
+        file.close();
+    }
+    p_entry->loaded = true;
+    return true;
+}
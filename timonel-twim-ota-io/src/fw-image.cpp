@@ -0,0 +1,399 @@
+/*
+  fw-image.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Pre-parsed firmware image files
+  ----------------------------------------------------------------------------
+*/
+
+#include "fw-image.h"
+
+#include "ota-log.h"
+
+// CRC32 (IEEE 802.3, reflected) nibble table, small enough to keep in RAM
+static const uint32_t CRC32_NIBBLE[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+/*  _______________
+   |               |
+   |     Crc32     |
+   |_______________|
+*/
+// Incremental: pass the previous result as crc to continue a running checksum
+uint32_t Crc32(const uint8_t data[], size_t length, uint32_t crc) {
+    crc = ~crc;
+    for (size_t ix = 0; ix < length; ix++) {
+        crc ^= data[ix];
+        crc = (crc >> 4) ^ CRC32_NIBBLE[crc & 0x0F];
+        crc = (crc >> 4) ^ CRC32_NIBBLE[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+/*  ____________________________
+   |                            |
+   |     FwImageHeaderValid     |
+   |____________________________|
+*/
+bool FwImageHeaderValid(const FwImageHeader *p_header) {
+    return (p_header->magic == FW_IMAGE_MAGIC) && (p_header->format == FW_IMAGE_FORMAT) &&
+           (p_header->encoding <= FW_IMAGE_HEATSHRINK);
+}
+
+/*  _____________________
+   |                     |
+   |     OpenFwImage     |
+   |_____________________|
+*/
+// Opens a verified image, leaving the file at the start of the payload.
+// On success the caller closes the file when done with it.
+uint8_t OpenFwImage(const char file_name[], File *p_file, FwImageHeader *p_header) {
+    uint8_t block[FS_BLOCK_SIZE];
+    if (!fs_session.Mount()) {
+        return FW_IMAGE_ERR_FS;
+    }
+    uint8_t errors = FW_IMAGE_OK;
+    File file = OTA_FS.open(file_name, "r");
+    if (!file) {
+        errors = FW_IMAGE_ERR_FS;
+    } else if ((file.read((uint8_t *)p_header, sizeof(FwImageHeader)) != sizeof(FwImageHeader)) ||
+               !FwImageHeaderValid(p_header)) {
+        errors = FW_IMAGE_ERR_HEADER;
+    } else {
+        // Nothing is handed out unless the whole payload is intact
+        uint32_t crc = 0;
+        uint32_t bytes_left = p_header->payload_size;
+        while (bytes_left > 0) {
+            size_t block_len = file.read(block, (bytes_left < FS_BLOCK_SIZE) ? bytes_left : FS_BLOCK_SIZE);
+            if (block_len == 0) {
+                break;
+            }
+            crc = Crc32(block, block_len, crc);
+            bytes_left -= block_len;
+        }
+        if (bytes_left > 0) {
+            errors = FW_IMAGE_ERR_SIZE;
+        } else if (crc != p_header->crc32) {
+            errors = FW_IMAGE_ERR_CRC;
+        }
+        file.seek(sizeof(FwImageHeader));
+    }
+    if (errors == FW_IMAGE_OK) {
+        p_header->version[FW_IMAGE_VER_LEN - 1] = '\0';
+        *p_file = file;
+    } else {
+        if (file) {
+            file.close();
+        }
+        LOG_ERROR("[%s] Firmware image \"%s\" unusable! (%d)\n\r", __func__, file_name, errors);
+    }
+    return errors;
+}
+
+/*  ___________________________
+   |                           |
+   |     ReadFwImageHeader     |
+   |___________________________|
+*/
+// Reads only the header, the payload is not verified
+uint8_t ReadFwImageHeader(const char file_name[], FwImageHeader *p_header) {
+    if (fs_session.ReadBlock(file_name, (uint8_t *)p_header, sizeof(FwImageHeader)) != sizeof(FwImageHeader)) {
+        return FW_IMAGE_ERR_FS;
+    }
+    if (!FwImageHeaderValid(p_header)) {
+        return FW_IMAGE_ERR_HEADER;
+    }
+    p_header->version[FW_IMAGE_VER_LEN - 1] = '\0';
+    return FW_IMAGE_OK;
+}
+
+/*  _____________________
+   |                     |
+   |     CopyFwImage     |
+   |_____________________|
+*/
+// Copies a verified image as it is stored, packed or not, block by block
+uint8_t CopyFwImage(const char source_file_name[], const char destination_file_name[], FwImageHeader *p_header) {
+    File source_file;
+    uint8_t block[FS_BLOCK_SIZE];
+    uint8_t errors = OpenFwImage(source_file_name, &source_file, p_header);
+    if (errors != FW_IMAGE_OK) {
+        return errors;
+    }
+    File destination_file = OTA_FS.open(destination_file_name, "w");
+    if (!destination_file || (destination_file.write((const uint8_t *)p_header, sizeof(FwImageHeader)) != sizeof(FwImageHeader))) {
+        errors = FW_IMAGE_ERR_FS;
+    }
+    uint32_t bytes_left = p_header->payload_size;
+    while ((bytes_left > 0) && (errors == FW_IMAGE_OK)) {
+        size_t block_len = source_file.read(block, (bytes_left < FS_BLOCK_SIZE) ? bytes_left : FS_BLOCK_SIZE);
+        if ((block_len == 0) || (destination_file.write(block, block_len) != block_len)) {
+            errors = FW_IMAGE_ERR_FS;
+        }
+        bytes_left -= block_len;
+    }
+    source_file.close();
+    if (destination_file) {
+        destination_file.close();
+    }
+    if (errors != FW_IMAGE_OK) {
+        LOG_ERROR("[%s] \"%s\" copy to \"%s\" failed!\n\r", __func__, source_file_name, destination_file_name);
+        OTA_FS.remove(destination_file_name);  // Never leave a truncated image behind
+    }
+    return errors;
+}
+
+/*  _______________________
+   |                       |
+   |     StreamFwImage     |
+   |_______________________|
+*/
+// Verifies an image and then hands its firmware, chunk by chunk and in address order, to a data handler
+uint8_t StreamFwImage(const char file_name[],
+                      String *p_version,
+                      IHexDataHandler data_handler,
+                      void *context) {
+    FwImageHeader header;
+    File file;
+    uint8_t block[FS_BLOCK_SIZE];
+    uint8_t chunk[FW_IMAGE_CHUNK];
+    uint8_t errors = OpenFwImage(file_name, &file, &header);
+    if (errors != FW_IMAGE_OK) {
+        return errors;
+    }
+    // The handler gets small chunks, while the flash is read a whole block at a time
+    BlockReader reader(file, block, FS_BLOCK_SIZE);
+    HsDecoder *p_decoder = nullptr;
+    size_t arena_mark = ota_arena.GetMark();
+    if (header.encoding == FW_IMAGE_HEATSHRINK) {
+        // A packed payload goes through the decoder, which hands the firmware to the handler
+        p_decoder = ota_arena.New<HsDecoder>();
+        if (p_decoder == nullptr) {
+            errors = FW_IMAGE_ERR_MEMORY;
+        } else if (p_decoder->BeginStream(header.window_bits, header.lookahead_bits, data_handler, context, header.load_address)) {
+            errors = FW_IMAGE_ERR_HEADER;
+        }
+    }
+    uint32_t address = header.load_address;
+    uint32_t bytes_left = header.payload_size;
+    while ((bytes_left > 0) && (errors == FW_IMAGE_OK)) {
+        size_t chunk_len = reader.ReadBlock(chunk, (bytes_left < FW_IMAGE_CHUNK) ? bytes_left : FW_IMAGE_CHUNK);
+        if (chunk_len == 0) {
+            errors = FW_IMAGE_ERR_SIZE;
+            break;
+        }
+        if (p_decoder != nullptr) {
+            p_decoder->FeedStream(chunk, chunk_len);
+        } else {
+            data_handler(address, chunk, chunk_len, context);
+        }
+        address += chunk_len;
+        bytes_left -= chunk_len;
+    }
+    if ((p_decoder != nullptr) && (errors == FW_IMAGE_OK) && p_decoder->EndStream()) {
+        errors = FW_IMAGE_ERR_SIZE;
+    }
+    ota_arena.Release(arena_mark);
+    file.close();
+    *p_version = header.version;
+    return errors;
+}
+
+/*  _______________________
+   |                       |
+   |     FwImageWriter     |
+   |_______________________|
+*/
+// Constructor
+FwImageWriter::FwImageWriter() {
+    memset(&header_, 0, sizeof(header_));
+}
+
+// Destructor
+FwImageWriter::~FwImageWriter() {
+    if (file_) {
+        Finish(false);
+    }
+}
+
+// Function Begin (a packed image gets the stored payload appended, with its encoding parameters)
+uint8_t FwImageWriter::Begin(const char file_name[], const String version, uint8_t encoding, uint8_t window_bits, uint8_t lookahead_bits) {
+    memset(&header_, 0, sizeof(header_));
+    header_.magic = FW_IMAGE_MAGIC;
+    header_.format = FW_IMAGE_FORMAT;
+    header_.encoding = encoding;
+    header_.window_bits = window_bits;
+    header_.lookahead_bits = lookahead_bits;
+    strncpy(header_.version, version.c_str(), FW_IMAGE_VER_LEN - 1);
+    file_name_ = file_name;
+    errors_ = FW_IMAGE_OK;
+    if (!fs_session.Mount()) {
+        errors_ = FW_IMAGE_ERR_FS;
+        return errors_;
+    }
+    file_ = OTA_FS.open(file_name, "w");
+    // The header is written as a placeholder, with no magic number, until Finish() completes it
+    FwImageHeader placeholder;
+    memset(&placeholder, 0, sizeof(placeholder));
+    if (!file_ || (file_.write((const uint8_t *)&placeholder, sizeof(placeholder)) != sizeof(placeholder))) {
+        LOG_ERROR("[%s] Error opening \"%s\" for writing!\n\r", __func__, file_name);
+        errors_ = FW_IMAGE_ERR_FS;
+    }
+    return errors_;
+}
+
+// Function Append (the payload must be contiguous, the first address becomes the load address)
+uint8_t FwImageWriter::Append(uint32_t address, const uint8_t data[], size_t length) {
+    if (header_.payload_size == 0) {
+        header_.load_address = address;
+    }
+    if ((errors_ == FW_IMAGE_OK) && (file_.write(data, length) != length)) {
+        errors_ = FW_IMAGE_ERR_FS;
+    }
+    header_.crc32 = Crc32(data, length, header_.crc32);
+    header_.payload_size += length;
+    return errors_;
+}
+
+// Function Finish
+uint8_t FwImageWriter::Finish(bool keep_image) {
+    if (file_) {
+        file_.close();
+    }
+    if (file_name_ == nullptr) {
+        return FW_IMAGE_ERR_FS;
+    }
+    if (keep_image && (errors_ == FW_IMAGE_OK)) {
+        File file = OTA_FS.open(file_name_, "r+");
+        if (!file || (file.write((const uint8_t *)&header_, sizeof(header_)) != sizeof(header_))) {
+            errors_ = FW_IMAGE_ERR_FS;
+        }
+        if (file) {
+            file.close();
+        }
+    }
+    if (!keep_image || (errors_ != FW_IMAGE_OK)) {
+        OTA_FS.remove(file_name_);  // Never leave an incomplete image behind
+    }
+    file_name_ = nullptr;
+    return keep_image ? errors_ : FW_IMAGE_OK;
+}
+
+// Function GetCrc32 (CRC32 of the payload appended so far)
+uint32_t FwImageWriter::GetCrc32(void) {
+    return header_.crc32;
+}
+
+// Function DataHandler (IHexDataHandler adapter, context is the FwImageWriter, data must be contiguous)
+void FwImageWriter::DataHandler(uint32_t address, const uint8_t *data, uint8_t length, void *context) {
+    ((FwImageWriter *)context)->Append(address, data, length);
+}
+
+/*  _______________________
+   |                       |
+   |     FwImageStream     |
+   |_______________________|
+*/
+// Function BeginStream
+void FwImageStream::BeginStream(const char file_name[], const String version, IHexDataHandler data_handler, void *context) {
+    memset(&header_, 0, sizeof(header_));
+    header_len_ = 0;
+    payload_len_ = 0;
+    file_name_ = file_name;
+    version_ = version;
+    data_handler_ = data_handler;
+    handler_context_ = context;
+    data_size_ = 0;
+    errors_ = FW_IMAGE_OK;
+    arena_mark_ = ota_arena.GetMark();
+    p_decoder_ = ota_arena.New<HsDecoder>();
+    if (p_decoder_ == nullptr) {
+        errors_ = FW_IMAGE_ERR_MEMORY;
+    }
+}
+
+// Function FeedStream (a chunk of any size, the header may span chunks)
+size_t FwImageStream::FeedStream(const uint8_t *chunk, size_t chunk_len) {
+    size_t chunk_ix = 0;
+    if ((header_len_ < sizeof(header_)) && (errors_ == FW_IMAGE_OK)) {
+        size_t header_part = min(chunk_len, sizeof(header_) - header_len_);
+        memcpy((uint8_t *)&header_ + header_len_, chunk, header_part);
+        header_len_ += header_part;
+        chunk_ix = header_part;
+        if (header_len_ == sizeof(header_)) {
+            header_.version[FW_IMAGE_VER_LEN - 1] = '\0';
+            if (!FwImageHeaderValid(&header_) || (version_ != header_.version)) {
+                errors_ = FW_IMAGE_ERR_HEADER;
+            } else if ((header_.encoding == FW_IMAGE_HEATSHRINK) &&
+                       p_decoder_->BeginStream(header_.window_bits, header_.lookahead_bits, data_handler_, handler_context_, header_.load_address)) {
+                errors_ = FW_IMAGE_ERR_HEADER;
+            } else {
+                image_writer_.Begin(file_name_, version_, header_.encoding, header_.window_bits, header_.lookahead_bits);
+            }
+        }
+    }
+    if ((chunk_ix < chunk_len) && (header_len_ == sizeof(header_)) && (errors_ == FW_IMAGE_OK)) {
+        FeedPayload(&chunk[chunk_ix], chunk_len - chunk_ix);
+    }
+    return chunk_len;
+}
+
+// Function StreamComplete (the whole payload announced by the header has arrived)
+bool FwImageStream::StreamComplete(void) {
+    return (errors_ != FW_IMAGE_OK) || ((header_len_ == sizeof(header_)) && (payload_len_ == header_.payload_size));
+}
+
+// Function EndStream (returns the image errors, the file is kept only without any)
+uint8_t FwImageStream::EndStream(void) {
+    if (errors_ == FW_IMAGE_OK) {
+        if (header_len_ < sizeof(header_)) {
+            errors_ = FW_IMAGE_ERR_HEADER;
+        } else if ((payload_len_ < header_.payload_size) ||
+                   ((header_.encoding == FW_IMAGE_HEATSHRINK) && p_decoder_->EndStream())) {
+            errors_ = FW_IMAGE_ERR_SIZE;
+        } else if (image_writer_.GetCrc32() != header_.crc32) {
+            errors_ = FW_IMAGE_ERR_CRC;
+        }
+    }
+    if (header_len_ == sizeof(header_)) {
+        uint8_t image_errors = image_writer_.Finish(errors_ == FW_IMAGE_OK);
+        if (errors_ == FW_IMAGE_OK) {
+            errors_ = image_errors;
+        }
+    }
+    if (p_decoder_ != nullptr) {
+        ota_arena.Release(arena_mark_);
+        p_decoder_ = nullptr;
+    }
+    return errors_;
+}
+
+// Function GetStreamDataSize (firmware bytes handed to the data handler, after decoding)
+uint32_t FwImageStream::GetStreamDataSize(void) {
+    return data_size_;
+}
+
+// Function GetCrc32 (CRC32 of the payload received so far, as stored)
+uint32_t FwImageStream::GetCrc32(void) {
+    return image_writer_.GetCrc32();
+}
+
+// Function FeedPayload
+void FwImageStream::FeedPayload(const uint8_t *data, size_t length) {
+    // Anything past the announced payload is ignored
+    length = min(length, (size_t)(header_.payload_size - payload_len_));
+    image_writer_.Append(header_.load_address, data, length);
+    payload_len_ += length;
+    if (header_.encoding == FW_IMAGE_HEATSHRINK) {
+        p_decoder_->FeedStream(data, length);
+        data_size_ = p_decoder_->GetStreamDataSize();
+        return;
+    }
+    for (size_t data_ix = 0; data_ix < length; data_ix += FW_IMAGE_CHUNK) {
+        uint8_t chunk_len = min(length - data_ix, (size_t)FW_IMAGE_CHUNK);
+        data_handler_(header_.load_address + data_size_, &data[data_ix], chunk_len, handler_context_);
+        data_size_ += chunk_len;
+    }
+}
@@ -0,0 +1,169 @@
+/*
+  fw-manifest.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Release manifest
+  ----------------------------------------------------------------------------
+*/
+
+#include "fw-manifest.h"
+
+/*  _________________________
+   |                         |
+   |     ParseFwManifest     |
+   |_________________________|
+*/
+// A document with no "key=value" line is an older version document, it only gives the version.
+// Unknown keys are ignored, so the manifest can grow. False if there is no usable version.
+bool ParseFwManifest(const String document, FwManifest *p_manifest) {
+    *p_manifest = FwManifest();
+    bool size_found = false;
+    bool crc_found = false;
+    int line_start = 0;
+    while (line_start < (int)document.length()) {
+        int line_end = document.indexOf('\n', line_start);
+        if (line_end < 0) {
+            line_end = document.length();
+        }
+        String line = document.substring(line_start, line_end);
+        line_start = line_end + 1;
+        line.trim();
+        int equals = line.indexOf('=');
+        if (equals < 0) {
+            if ((p_manifest->version == "") && (line != "") && (document.indexOf('=') < 0)) {
+                p_manifest->version = line;
+            }
+            continue;
+        }
+        String key = line.substring(0, equals);
+        String value = line.substring(equals + 1);
+        key.trim();
+        value.trim();
+        uint32_t number = strtoul(value.c_str(), nullptr, 0);
+        if (key == "version") {
+            p_manifest->version = value;
+        } else if (key == "address") {
+            p_manifest->load_address = number;
+        } else if (key == "size") {
+            p_manifest->size = number;
+            size_found = true;
+        } else if (key == "records") {
+            p_manifest->records = number;
+        } else if (key == "crc32") {
+            p_manifest->crc32 = number;
+            crc_found = true;
+        }
+    }
+    if ((p_manifest->version == "") || (p_manifest->version.length() >= FW_IMAGE_VER_LEN)) {
+        p_manifest->version = "";
+        return false;
+    }
+    p_manifest->complete = size_found && crc_found && (p_manifest->size > 0);
+    return true;
+}
+
+/*  __________________
+   |                  |
+   |     FwDigest     |
+   |__________________|
+*/
+// Function Begin (data past size_limit bytes from the first address invalidates the digest)
+void FwDigest::Begin(uint32_t size_limit, IHexDataHandler data_handler, void *context) {
+    data_handler_ = data_handler;
+    handler_context_ = context;
+    size_limit_ = size_limit;
+    load_address_ = 0;
+    next_address_ = 0;
+    size_ = 0;
+    blank_count_ = 0;
+    crc32_ = 0;
+    record_count_ = 0;
+    started_ = false;
+    invalid_ = false;
+}
+
+// Function Update
+// Blank bytes are only added to the digest once some firmware byte follows them, so the padding
+// of the last page (an image saved page by page) doesn't change it
+void FwDigest::Update(uint32_t address, const uint8_t data[], uint8_t length) {
+    record_count_++;
+    if (invalid_ || (length == 0)) {
+        return;
+    }
+    if (!started_) {
+        started_ = true;
+        load_address_ = address;
+        next_address_ = address;
+    }
+    if ((address < next_address_) || (address + length - load_address_ > size_limit_)) {
+        invalid_ = true;
+        return;
+    }
+    ForwardGap(next_address_, address - next_address_);
+    blank_count_ += address - next_address_;
+    next_address_ = address + length;
+    if (data_handler_ != nullptr) {
+        data_handler_(address, data, length, handler_context_);
+    }
+    uint8_t data_len = length;
+    while ((data_len > 0) && (data[data_len - 1] == FW_MANIFEST_BLANK)) {
+        data_len--;
+    }
+    if (data_len > 0) {
+        HashBlank();
+        crc32_ = Crc32(data, data_len, crc32_);
+        size_ += data_len;
+    }
+    blank_count_ += length - data_len;
+}
+
+// Function Matches (the firmware received so far is the one the manifest describes)
+bool FwDigest::Matches(const FwManifest *p_manifest) {
+    return p_manifest->complete && started_ && !invalid_ && (load_address_ == p_manifest->load_address) &&
+           (size_ == p_manifest->size) && (crc32_ == p_manifest->crc32);
+}
+
+// Function GetSize (firmware bytes, up to the last one that isn't blank)
+uint32_t FwDigest::GetSize(void) {
+    return size_;
+}
+
+// Function GetCrc32
+uint32_t FwDigest::GetCrc32(void) {
+    return crc32_;
+}
+
+// Function GetRecordCount
+uint16_t FwDigest::GetRecordCount(void) {
+    return record_count_;
+}
+
+// Function DataHandler (IHexDataHandler adapter, context is the FwDigest)
+void FwDigest::DataHandler(uint32_t address, const uint8_t *data, uint8_t length, void *context) {
+    ((FwDigest *)context)->Update(address, data, length);
+}
+
+// Function ForwardGap (blank bytes for the data handler, in the place of the missing data)
+void FwDigest::ForwardGap(uint32_t address, uint32_t length) {
+    uint8_t blank[FW_IMAGE_CHUNK];
+    memset(blank, FW_MANIFEST_BLANK, sizeof(blank));
+    while ((data_handler_ != nullptr) && (length > 0)) {
+        uint8_t chunk_len = min(length, (uint32_t)sizeof(blank));
+        data_handler_(address, blank, chunk_len, handler_context_);
+        address += chunk_len;
+        length -= chunk_len;
+    }
+}
+
+// Function HashBlank (the pending blank bytes go into the digest, a firmware byte follows them)
+void FwDigest::HashBlank(void) {
+    uint8_t blank[FW_IMAGE_CHUNK];
+    memset(blank, FW_MANIFEST_BLANK, sizeof(blank));
+    size_ += blank_count_;
+    while (blank_count_ > 0) {
+        uint8_t chunk_len = min(blank_count_, (uint32_t)sizeof(blank));
+        crc32_ = Crc32(blank, chunk_len, crc32_);
+        blank_count_ -= chunk_len;
+    }
+}
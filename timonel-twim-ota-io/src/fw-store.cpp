@@ -0,0 +1,167 @@
+/*
+  fw-store.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Firmware image store
+  ----------------------------------------------------------------------------
+*/
+
+#include "fw-store.h"
+
+#include "ota-log.h"
+
+FwStore fw_store;  // Firmware images flashed before, shared by the whole program
+
+// Constructor (empty store)
+FwStore::FwStore() {
+    memset(&index_, 0, sizeof(index_));
+    index_.magic = FW_STORE_MAGIC;
+}
+
+// Function Load
+// A missing or corrupt index (or one written with another FW_STORE_ENTRIES) starts the store empty
+bool FwStore::Load(void) {
+    StoreIndex saved;
+    if ((fs_session.ReadBlock(FW_STORE_INDEX, (uint8_t *)&saved, sizeof(saved)) != sizeof(saved)) ||
+        (saved.magic != FW_STORE_MAGIC) || (saved.entry_count > FW_STORE_ENTRIES) ||
+        (saved.crc32 != Crc32((const uint8_t *)&saved, offsetof(StoreIndex, crc32)))) {
+        return false;
+    }
+    index_ = saved;
+    return true;
+}
+
+// Function Add
+// Keeps a copy of an image file, evicting the least recently used images to make room. An image
+// already stored only gets its version tag and use updated.
+uint8_t FwStore::Add(const char file_name[]) {
+    FwImageHeader header;
+    uint8_t errors = ReadFwImageHeader(file_name, &header);
+    if (errors != FW_IMAGE_OK) {
+        return errors;
+    }
+    uint32_t file_size = sizeof(FwImageHeader) + header.payload_size;
+    if (file_size > FW_STORE_BUDGET) {
+        return FW_IMAGE_ERR_SIZE;
+    }
+    int8_t entry_ix = FindDigest(header.crc32);
+    if (entry_ix < 0) {
+        while ((index_.entry_count == FW_STORE_ENTRIES) || (GetUsedBytes() + file_size > FW_STORE_BUDGET)) {
+            uint8_t lru_ix = 0;
+            for (uint8_t ix = 1; ix < index_.entry_count; ix++) {
+                if (index_.entries[ix].last_used < index_.entries[lru_ix].last_used) {
+                    lru_ix = ix;
+                }
+            }
+            LOG_INFO("[%s] Evicting firmware %s from the image store ...\n\r", __func__, index_.entries[lru_ix].version);
+            RemoveEntry(lru_ix);
+        }
+        char store_file_name[FW_STORE_NAME_LEN];
+        GetFileName(header.crc32, store_file_name);
+        errors = CopyFwImage(file_name, store_file_name, &header);
+        if (errors != FW_IMAGE_OK) {
+            Save();
+            return errors;
+        }
+        entry_ix = index_.entry_count++;
+        index_.entries[entry_ix].digest = header.crc32;
+        index_.entries[entry_ix].file_size = file_size;
+    }
+    FwStoreEntry *p_entry = &index_.entries[entry_ix];
+    memset(p_entry->version, 0, FW_IMAGE_VER_LEN);
+    memcpy(p_entry->version, header.version, FW_IMAGE_VER_LEN - 1);
+    p_entry->last_used = ++index_.use_count;
+    return Save() ? FW_IMAGE_OK : FW_IMAGE_ERR_FS;
+}
+
+// Function Restore
+// Copies the most recently used stored image of a version to a file, *p_digest is set to its
+// payload CRC32. A stored image that turns out unusable is dropped from the store.
+uint8_t FwStore::Restore(const String version, const char file_name[], uint32_t *p_digest) {
+    int8_t entry_ix = FindVersion(version);
+    if (entry_ix < 0) {
+        return FW_STORE_ERR_MISSING;
+    }
+    FwStoreEntry *p_entry = &index_.entries[entry_ix];
+    char store_file_name[FW_STORE_NAME_LEN];
+    GetFileName(p_entry->digest, store_file_name);
+    FwImageHeader header;
+    uint8_t errors = CopyFwImage(store_file_name, file_name, &header);
+    if ((errors == FW_IMAGE_OK) && ((header.crc32 != p_entry->digest) || (version != header.version))) {
+        OTA_FS.remove(file_name);
+        errors = FW_IMAGE_ERR_HEADER;
+    }
+    if (errors != FW_IMAGE_OK) {
+        RemoveEntry(entry_ix);
+        Save();
+        return errors;
+    }
+    p_entry->last_used = ++index_.use_count;
+    Save();
+    *p_digest = header.crc32;
+    return FW_IMAGE_OK;
+}
+
+// Function GetEntryCount
+uint8_t FwStore::GetEntryCount(void) {
+    return index_.entry_count;
+}
+
+// Function GetUsedBytes (flash taken by the stored image files)
+uint32_t FwStore::GetUsedBytes(void) {
+    uint32_t used_bytes = 0;
+    for (uint8_t ix = 0; ix < index_.entry_count; ix++) {
+        used_bytes += index_.entries[ix].file_size;
+    }
+    return used_bytes;
+}
+
+// Function Save
+bool FwStore::Save(void) {
+    index_.crc32 = Crc32((const uint8_t *)&index_, offsetof(StoreIndex, crc32));
+    if (!fs_session.WriteBlock(FW_STORE_INDEX, (const uint8_t *)&index_, sizeof(index_))) {
+        LOG_WARN("[%s] Image store index not saved!\n\r", __func__);
+        return false;
+    }
+    return true;
+}
+
+// Function FindDigest (-1 if no stored image has that digest)
+int8_t FwStore::FindDigest(uint32_t digest) {
+    for (uint8_t ix = 0; ix < index_.entry_count; ix++) {
+        if (index_.entries[ix].digest == digest) {
+            return ix;
+        }
+    }
+    return -1;
+}
+
+// Function FindVersion (most recently used image of that version, -1 if there is none)
+int8_t FwStore::FindVersion(const String version) {
+    int8_t found_ix = -1;
+    for (uint8_t ix = 0; ix < index_.entry_count; ix++) {
+        if ((version == index_.entries[ix].version) &&
+            ((found_ix < 0) || (index_.entries[ix].last_used > index_.entries[found_ix].last_used))) {
+            found_ix = ix;
+        }
+    }
+    return found_ix;
+}
+
+// Function RemoveEntry (deletes the image file, the index is saved by the caller)
+void FwStore::RemoveEntry(uint8_t entry_ix) {
+    char store_file_name[FW_STORE_NAME_LEN];
+    GetFileName(index_.entries[entry_ix].digest, store_file_name);
+    fs_session.Remove(store_file_name);
+    index_.entry_count--;
+    for (uint8_t ix = entry_ix; ix < index_.entry_count; ix++) {
+        index_.entries[ix] = index_.entries[ix + 1];
+    }
+    memset(&index_.entries[index_.entry_count], 0, sizeof(FwStoreEntry));
+}
+
+// Function GetFileName
+void FwStore::GetFileName(uint32_t digest, char file_name[]) {
+    snprintf(file_name, FW_STORE_NAME_LEN, FW_STORE_FILE, (unsigned int)digest);
+}
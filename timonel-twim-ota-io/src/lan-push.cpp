@@ -0,0 +1,105 @@
+/*
+  lan-push.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  LAN push update endpoint
+  ----------------------------------------------------------------------------
+*/
+
+#include "lan-push.h"
+
+#include "ota-log.h"
+
+LanPush lan_push(LAN_PUSH_PORT);  // Update endpoint on the local network
+
+// Constructor
+LanPush::LanPush(uint16_t port) : server_(port) {
+}
+
+// Function Begin (the WiFi station must be connected)
+bool LanPush::Begin(const char host_name[]) {
+    server_.begin();
+    running_ = true;
+    if (!MDNS.begin(host_name)) {
+        LOG_WARN("[%s] mDNS responder not started, the endpoint is only reachable by address!\n\r", __func__);
+        return false;
+    }
+    MDNS.addService(LAN_PUSH_SERVICE, "tcp", LAN_PUSH_PORT);
+    LOG_INFO("[%s] LAN push endpoint at http://%s.local%s ...\n\r", __func__, host_name, LAN_PUSH_PATH);
+    return true;
+}
+
+// Function Accept
+// Polled from loop(), it returns at once unless a client is connecting. The request line and
+// headers are read then, false if they don't arrive in time.
+bool LanPush::Accept(WiFiClient *p_client, LanPushRequest *p_request) {
+    if (!running_) {
+        return false;
+    }
+    MDNS.update();
+    *p_client = server_.available();
+    if (!*p_client) {
+        return false;
+    }
+    *p_request = LanPushRequest();
+    p_request->authorized = (strlen(LAN_PUSH_TOKEN) == 0);
+    p_client->setTimeout(LAN_PUSH_TIMEOUT);
+    // Request line: "POST /update HTTP/1.1"
+    String line = p_client->readStringUntil('\n');
+    int path_start = line.indexOf(' ') + 1;
+    int path_end = line.indexOf(' ', path_start);
+    if ((path_start <= 0) || (path_end < 0)) {
+        p_client->stop();
+        return false;
+    }
+    p_request->method = line.substring(0, path_start - 1);
+    p_request->path = line.substring(path_start, path_end);
+    while (p_client->connected() || p_client->available()) {
+        line = p_client->readStringUntil('\n');
+        if ((line == "\r") || (line == "")) {
+            return true;
+        }
+        int colon = line.indexOf(':');
+        String name = line.substring(0, colon);
+        String value = line.substring(colon + 1);
+        value.trim();
+        if (name.equalsIgnoreCase("Content-Length")) {
+            p_request->content_length = value.toInt();
+        } else if (name.equalsIgnoreCase("X-Push-Token")) {
+            p_request->authorized = p_request->authorized || (value == LAN_PUSH_TOKEN);
+        } else if ((name.length() > strlen(LAN_PUSH_HEADER_PREFIX)) && name.substring(0, strlen(LAN_PUSH_HEADER_PREFIX)).equalsIgnoreCase(LAN_PUSH_HEADER_PREFIX)) {
+            // ParseFwManifest() keys are lowercase
+            String key = name.substring(strlen(LAN_PUSH_HEADER_PREFIX));
+            key.toLowerCase();
+            p_request->manifest_text += key + "=" + value + "\n";
+        }
+    }
+    p_client->stop();
+    return false;
+}
+
+// Function Reply (one line of text, then the connection is closed)
+void LanPush::Reply(WiFiClient &client, int status, const String text) {
+    const char *reason;
+    switch (status) {
+        case HTTP_STATUS_ACCEPTED: reason = "Accepted"; break;
+        case HTTP_STATUS_BAD_REQUEST: reason = "Bad Request"; break;
+        case HTTP_STATUS_FORBIDDEN: reason = "Forbidden"; break;
+        case HTTP_STATUS_NOT_ALLOWED: reason = "Method Not Allowed"; break;
+        case HTTP_STATUS_UNPROCESSABLE: reason = "Unprocessable Entity"; break;
+        case HTTP_STATUS_UNAVAILABLE: reason = "Service Unavailable"; break;
+        default: reason = (status < 300) ? "OK" : "Not Found"; break;
+    }
+    String body = text + "\r\n";
+    client.print(String("HTTP/1.1 ") + String(status) + " " + reason + "\r\n" +
+                 "Content-Type: text/plain\r\n" +
+                 "Content-Length: " + String(body.length()) + "\r\n" +
+                 "Connection: close\r\n\r\n" + body);
+    client.stop();
+}
+
+// Function Running
+bool LanPush::Running(void) {
+    return running_;
+}
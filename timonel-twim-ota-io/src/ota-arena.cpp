@@ -0,0 +1,66 @@
+/*
+  ota-arena.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Update memory arena
+  ----------------------------------------------------------------------------
+*/
+
+#include "ota-arena.h"
+
+#include "ota-log.h"
+
+// Constructor (the pool belongs to the caller, it is reserved for the arena for good)
+OtaArena::OtaArena(uint8_t pool[], size_t pool_size) : pool_(pool), pool_size_(pool_size) {
+}
+
+// Function Reset (at the start of an update run, whatever the previous one left allocated)
+void OtaArena::Reset(void) {
+    used_ = 0;
+    peak_ = 0;
+    failures_ = 0;
+}
+
+// Function Allocate (nullptr if the arena has no room left, nothing is allocated then)
+void *OtaArena::Allocate(size_t size) {
+    size_t start = (used_ + OTA_ARENA_ALIGN - 1) & ~(OTA_ARENA_ALIGN - 1);
+    if ((start > pool_size_) || (size > pool_size_ - start)) {
+        failures_++;
+        LOG_ERROR("[%s] %u bytes requested, only %u of %u left!\n\r", __func__, (unsigned int)size,
+                  (unsigned int)(pool_size_ - min(start, pool_size_)), (unsigned int)pool_size_);
+        return nullptr;
+    }
+    used_ = start + size;
+    if (used_ > peak_) {
+        peak_ = used_;
+    }
+    return &pool_[start];
+}
+
+// Function GetMark (to be released to once the allocations made after it are no longer in use)
+size_t OtaArena::GetMark(void) {
+    return used_;
+}
+
+// Function Release (gives back everything allocated since the mark was taken)
+void OtaArena::Release(size_t mark) {
+    if (mark < used_) {
+        used_ = mark;
+    }
+}
+
+// Function GetSize
+size_t OtaArena::GetSize(void) {
+    return pool_size_;
+}
+
+// Function GetPeak (most bytes in use at once since the last reset)
+size_t OtaArena::GetPeak(void) {
+    return peak_;
+}
+
+// Function GetFailures
+uint8_t OtaArena::GetFailures(void) {
+    return failures_;
+}
@@ -0,0 +1,93 @@
+/*
+  ota-log.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Console log
+  ----------------------------------------------------------------------------
+*/
+
+#include "ota-log.h"
+
+#if OTA_LOG_LEVEL > OTA_LOG_NONE
+
+OtaLog ota_log(&Serial);  // Console output of the whole program
+
+// Constructor
+OtaLog::OtaLog(HardwareSerial *p_serial) : p_serial_(p_serial) {
+}
+
+// Function Printf
+// A message is buffered whole or dropped, the console never shows half of one. The count of the
+// dropped ones is logged as soon as there is room again.
+void OtaLog::Printf(const char *format, ...) {
+    char line[OTA_LOG_LINE];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf_P(line, sizeof(line), format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    length = min(length, (int)sizeof(line) - 1);
+    Drain();
+    if (unreported_ > 0) {
+        char note[48];
+        int note_len = snprintf(note, sizeof(note), "\n\r[%s] %lu messages dropped ...\n\r", __func__, (unsigned long)unreported_);
+        if ((size_t)note_len + length > OTA_LOG_BUFFER - count_) {
+            dropped_++;
+            unreported_++;
+            return;
+        }
+        Put(note, note_len);
+        unreported_ = 0;
+    }
+    if ((size_t)length > OTA_LOG_BUFFER - count_) {
+        dropped_++;
+        unreported_++;
+        return;
+    }
+    Put(line, length);
+    Drain();
+}
+
+// Function Drain (sends what the serial transmit FIFO takes now, it never waits)
+void OtaLog::Drain(void) {
+    while (count_ > 0) {
+        size_t room = p_serial_->availableForWrite();
+        if (room == 0) {
+            return;
+        }
+        size_t chunk_len = min(min(room, count_), (size_t)(OTA_LOG_BUFFER - tail_));
+        p_serial_->write((const uint8_t *)&buffer_[tail_], chunk_len);
+        tail_ = (tail_ + chunk_len) % OTA_LOG_BUFFER;
+        count_ -= chunk_len;
+    }
+}
+
+// Function Flush (sends everything buffered, waiting for the serial port as needed)
+void OtaLog::Flush(void) {
+    while (count_ > 0) {
+        size_t chunk_len = min(count_, (size_t)(OTA_LOG_BUFFER - tail_));
+        p_serial_->write((const uint8_t *)&buffer_[tail_], chunk_len);
+        tail_ = (tail_ + chunk_len) % OTA_LOG_BUFFER;
+        count_ -= chunk_len;
+    }
+    p_serial_->flush();
+}
+
+// Function GetDropped
+uint32_t OtaLog::GetDropped(void) {
+    return dropped_;
+}
+
+// Function Put (the caller checked there is room)
+void OtaLog::Put(const char text[], size_t length) {
+    size_t first_len = min(length, (size_t)(OTA_LOG_BUFFER - head_));
+    memcpy(&buffer_[head_], text, first_len);
+    memcpy(buffer_, &text[first_len], length - first_len);
+    head_ = (head_ + length) % OTA_LOG_BUFFER;
+    count_ += length;
+}
+
+#endif  // OTA_LOG_LEVEL > OTA_LOG_NONE
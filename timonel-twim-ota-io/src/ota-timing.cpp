@@ -0,0 +1,182 @@
+/*
+  ota-timing.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Update latency instrumentation
+  ----------------------------------------------------------------------------
+*/
+
+#include "ota-timing.h"
+
+#include "fw-image.h"
+#include "ota-log.h"
+
+OtaTiming ota_timing;  // Update latency spans and histograms shared by the whole program
+
+static const char *const TIMING_PHASE_NAMES[TIMING_PHASES] = {
+    "wifi", "tls", "headers", "body", "parse", "erase", "page", "upload", "run"};
+
+// Constructor
+OtaTiming::OtaTiming() {
+    Clear();
+    dirty_ = false;
+}
+
+// Function Load
+// Adds up with the histograms saved before the restart, a missing or corrupt file starts them empty
+bool OtaTiming::Load(void) {
+    TimingStore saved;
+    if ((fs_session.ReadBlock(TIMING_FILE, (uint8_t *)&saved, sizeof(saved)) != sizeof(saved)) ||
+        (saved.magic != TIMING_MAGIC) || (saved.phase_count != TIMING_PHASES) || (saved.bucket_count != TIMING_BUCKETS) ||
+        (saved.crc32 != Crc32((const uint8_t *)&saved, offsetof(TimingStore, crc32)))) {
+        return false;
+    }
+    for (uint8_t phase = 0; phase < TIMING_PHASES; phase++) {
+        PhaseHistogram *p_saved = &saved.phases[phase];
+        PhaseHistogram *p_histogram = &store_.phases[phase];
+        p_histogram->count += p_saved->count;
+        p_histogram->max_us = max(p_histogram->max_us, p_saved->max_us);
+        p_histogram->total_us += p_saved->total_us;
+        for (uint8_t bucket = 0; bucket < TIMING_BUCKETS; bucket++) {
+            uint32_t bucket_count = (uint32_t)p_histogram->buckets[bucket] + p_saved->buckets[bucket];
+            p_histogram->buckets[bucket] = (bucket_count > UINT16_MAX) ? UINT16_MAX : bucket_count;
+        }
+    }
+    return true;
+}
+
+// Function Save (histograms only, the ring buffer is lost on restart)
+bool OtaTiming::Save(void) {
+    store_.crc32 = Crc32((const uint8_t *)&store_, offsetof(TimingStore, crc32));
+    save_ms_ = millis();
+    if (!fs_session.WriteBlock(TIMING_FILE, (const uint8_t *)&store_, sizeof(store_))) {
+        LOG_WARN("[%s] Timing histograms not saved!\n\r", __func__);
+        return false;
+    }
+    dirty_ = false;
+    return true;
+}
+
+// Function SaveIfDue (saves new spans at most once per TIMING_SAVE_INTERVAL, sparing the flash)
+bool OtaTiming::SaveIfDue(void) {
+    if (!dirty_ || ((millis() - save_ms_) < TIMING_SAVE_INTERVAL)) {
+        return true;
+    }
+    return Save();
+}
+
+// Function Clear
+void OtaTiming::Clear(void) {
+    memset(&store_, 0, sizeof(store_));
+    store_.magic = TIMING_MAGIC;
+    store_.phase_count = TIMING_PHASES;
+    store_.bucket_count = TIMING_BUCKETS;
+    ring_ix_ = 0;
+    ring_count_ = 0;
+    dirty_ = true;
+}
+
+// Function Begin
+void OtaTiming::Begin(TimingSpan *p_span, TimingPhase phase) {
+    p_span->phase = phase;
+    p_span->begin_ms = millis();
+    p_span->self_us = 0;
+    p_span->running = false;
+    Resume(p_span);
+}
+
+// Function Pause
+void OtaTiming::Pause(TimingSpan *p_span) {
+    if (!p_span->running) {
+        return;
+    }
+    uint32_t elapsed_us = micros() - p_span->resume_us;
+    uint32_t nested_us = nested_us_ - p_span->nested_mark;
+    uint32_t self_us = (elapsed_us > nested_us) ? (elapsed_us - nested_us) : 0;
+    p_span->self_us += self_us;
+    p_span->running = false;
+    // Enclosing spans exclude this time
+    nested_us_ += self_us;
+}
+
+// Function Resume
+void OtaTiming::Resume(TimingSpan *p_span) {
+    if (p_span->running) {
+        return;
+    }
+    p_span->resume_us = micros();
+    p_span->nested_mark = nested_us_;
+    p_span->running = true;
+}
+
+// Function End
+void OtaTiming::End(TimingSpan *p_span) {
+    Pause(p_span);
+    Record(p_span->phase, p_span->begin_ms, p_span->self_us);
+}
+
+// Function Record
+void OtaTiming::Record(TimingPhase phase, uint32_t begin_ms, uint32_t duration_us) {
+    ring_[ring_ix_].begin_ms = begin_ms;
+    ring_[ring_ix_].duration_us = duration_us;
+    ring_[ring_ix_].phase = phase;
+    ring_ix_ = (ring_ix_ + 1) % TIMING_RING_SIZE;
+    if (ring_count_ < TIMING_RING_SIZE) {
+        ring_count_++;
+    }
+    PhaseHistogram *p_histogram = &store_.phases[phase];
+    p_histogram->count++;
+    p_histogram->max_us = max(p_histogram->max_us, duration_us);
+    p_histogram->total_us += duration_us;
+    uint8_t bucket = 0;
+    while ((bucket < (TIMING_BUCKETS - 1)) && (duration_us >= ((uint32_t)TIMING_BUCKET_US << bucket))) {
+        bucket++;
+    }
+    if (p_histogram->buckets[bucket] < UINT16_MAX) {
+        p_histogram->buckets[bucket]++;
+    }
+    dirty_ = true;
+}
+
+// Function WriteJson
+// Every phase with its histogram ("buckets" lists the upper bound of each one in us, the last one
+// is open), then the ring buffer spans, oldest first
+void OtaTiming::WriteJson(Print &output) {
+    output.printf_P("{\"uptime_ms\":%lu,\"bucket_us\":[", millis());
+    for (uint8_t bucket = 0; bucket < (TIMING_BUCKETS - 1); bucket++) {
+        output.printf_P("%s%lu", bucket ? "," : "", (unsigned long)TIMING_BUCKET_US << bucket);
+    }
+    output.printf_P("],\"phases\":{");
+    for (uint8_t phase = 0; phase < TIMING_PHASES; phase++) {
+        PhaseHistogram *p_histogram = &store_.phases[phase];
+        output.printf_P("%s\"%s\":{\"count\":%u,\"total_ms\":%lu,\"max_us\":%u,\"buckets\":[",
+                        phase ? "," : "", TIMING_PHASE_NAMES[phase], p_histogram->count,
+                        (unsigned long)(p_histogram->total_us / 1000), p_histogram->max_us);
+        for (uint8_t bucket = 0; bucket < TIMING_BUCKETS; bucket++) {
+            output.printf_P("%s%u", bucket ? "," : "", p_histogram->buckets[bucket]);
+        }
+        output.printf_P("]}");
+    }
+    output.printf_P("},\"recent\":[");
+    for (uint8_t ix = 0; ix < ring_count_; ix++) {
+        TimingEntry *p_entry = &ring_[(ring_ix_ + TIMING_RING_SIZE - ring_count_ + ix) % TIMING_RING_SIZE];
+        output.printf_P("%s{\"phase\":\"%s\",\"at_ms\":%u,\"us\":%u}", ix ? "," : "",
+                        TIMING_PHASE_NAMES[p_entry->phase], p_entry->begin_ms, p_entry->duration_us);
+    }
+    output.printf_P("]}");
+}
+
+// Function SaveJson
+bool OtaTiming::SaveJson(const char file_name[]) {
+    if (!fs_session.Mount()) {
+        return false;
+    }
+    File file = OTA_FS.open(file_name, "w");
+    if (!file) {
+        return false;
+    }
+    WriteJson(file);
+    file.close();
+    return true;
+}
@@ -0,0 +1,511 @@
+/*
+  page-uploader.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Pipelined flashing of ATtiny85 pages
+  ----------------------------------------------------------------------------
+*/
+
+#include "page-uploader.h"
+
+#include <nb-twi-cmd.h>
+
+#include "ota-log.h"
+
+// Constructor (single slave)
+PageUploader::PageUploader(Timonel *p_timonel, FwImageWriter *p_image_writer)
+    : PageUploader(&p_timonel, 1, p_image_writer) {
+}
+
+// Constructor (several slaves on the same bus, all receiving the same image)
+PageUploader::PageUploader(Timonel *p_timonels[], uint8_t target_count, FwImageWriter *p_image_writer) {
+    target_count_ = (target_count < MAX_UPLOAD_TARGETS) ? target_count : MAX_UPLOAD_TARGETS;
+    for (uint8_t target_ix = 0; target_ix < target_count_; target_ix++) {
+        p_timonels_[target_ix] = p_timonels[target_ix];
+        target_errors_[target_ix] = 0;
+        links_[target_ix] = {TWI_UPLOAD_CLOCK, UPLOAD_CHUNK_PAGES, 0, 0, 0};
+    }
+    p_image_writer_ = p_image_writer;
+    // Without room for the chunk buffer, every page is written straight from its page buffer
+    chunk_arena_mark_ = ota_arena.GetMark();
+    if (UPLOAD_CHUNK_PAGES > 1) {
+        p_chunk_buffer_ = (uint8_t *)ota_arena.Allocate(UPLOAD_CHUNK_PAGES * TML_PAGE_SIZE);
+    }
+    chunk_capacity_ = (p_chunk_buffer_ != nullptr) ? UPLOAD_CHUNK_PAGES : 1;
+}
+
+// Destructor
+PageUploader::~PageUploader() {
+    CloseBaseImage();
+    if (p_chunk_buffer_ != nullptr) {
+        ota_arena.Release(chunk_arena_mark_);
+    }
+}
+
+// Function SetBaseImage
+// Enables delta flashing: the slave flash must hold exactly this image, with no page erased since
+uint8_t PageUploader::SetBaseImage(const char file_name[]) {
+    uint8_t errors = OpenFwImage(file_name, &base_file_, &base_header_);
+    if ((errors == FW_IMAGE_OK) && (base_header_.encoding == FW_IMAGE_HEATSHRINK)) {
+        // A packed base is decoded as the pages go by, the decoder only exists while it is in use
+        base_arena_mark_ = ota_arena.GetMark();
+        p_packed_base_ = ota_arena.New<PackedBase>();
+        if (p_packed_base_ == nullptr) {
+            CloseBaseImage();
+            return FW_IMAGE_ERR_MEMORY;
+        }
+        p_packed_base_->p_input = nullptr;
+        p_packed_base_->input_len = 0;
+        p_packed_base_->stored_left = base_header_.payload_size;
+        p_packed_base_->address = base_header_.load_address;
+        if (p_packed_base_->decoder.Begin(base_header_.window_bits, base_header_.lookahead_bits)) {
+            CloseBaseImage();
+            errors = FW_IMAGE_ERR_HEADER;
+        }
+    }
+    return errors;
+}
+
+// Function SetImageWriter (every page sent is also appended to the image being written)
+void PageUploader::SetImageWriter(FwImageWriter *p_image_writer) {
+    p_image_writer_ = p_image_writer;
+}
+
+// Function SetResumeAddress
+// Resumes a failed upload of the same image: the pages below the address are taken as written.
+// The rest of the slave flash may hold anything, so blank pages are written too.
+void PageUploader::SetResumeAddress(uint32_t resume_address) {
+    resume_address_ = resume_address;
+    skip_blank_ = (resume_address == 0);
+}
+
+// Function SetConfirmHandler (called every CONFIRM_INTERVAL pages confirmed on the slaves)
+void PageUploader::SetConfirmHandler(FlashConfirmHandler confirm_handler, void *context) {
+    confirm_handler_ = confirm_handler;
+    confirm_context_ = context;
+}
+
+// Function Write
+// Data must arrive in ascending address order, as the records of an AVR Intel Hex file do.
+// A whole record is buffered before any page goes out, so the caller can go straight back
+// to draining the network while the slave writes.
+void PageUploader::Write(uint32_t address, const uint8_t data[], uint16_t length) {
+    for (uint16_t ix = 0; ix < length; ix++) {
+        uint32_t page_address = (address + ix) & ~((uint32_t)TML_PAGE_SIZE - 1);
+        if (!page_open_) {
+            OpenPage(page_address);
+        } else if (page_address < page_address_[fill_ix_]) {
+            // Out of order data can't be pipelined, the image is incomplete whatever follows
+            out_of_order_ = true;
+            return;
+        } else if (page_address > page_address_[fill_ix_]) {
+            // The page being filled is complete: it waits in its buffer while the other one fills
+            if (page_pending_) {
+                FlushPage(fill_ix_ ^ 1);
+            }
+            page_pending_ = true;
+            if (page_address > page_address_[fill_ix_] + TML_PAGE_SIZE) {
+                // Gaps go through as blank pages, keeping the saved image contiguous (an erased slave skips them)
+                FlushPage(fill_ix_);
+                page_pending_ = false;
+                for (uint32_t gap_address = page_address_[fill_ix_] + TML_PAGE_SIZE; gap_address < page_address; gap_address += TML_PAGE_SIZE) {
+                    OpenPage(gap_address);
+                    FlushPage(fill_ix_);
+                }
+            }
+            fill_ix_ ^= 1;
+            OpenPage(page_address);
+        }
+        page_buffer_[fill_ix_][(address + ix) - page_address] = data[ix];
+    }
+    if (page_pending_) {
+        FlushPage(fill_ix_ ^ 1);
+        page_pending_ = false;
+    }
+}
+
+// Function SendPending
+// Writes the waiting run of complete pages now, even if shorter than a chunk: called while the
+// download has nothing more ready, so the slave isn't left idle waiting for the rest of the run
+void PageUploader::SendPending(void) {
+    SendChunk();
+}
+
+// Function Finish (returns one if any data came out of order, plus the page errors of every slave)
+uint8_t PageUploader::Finish(void) {
+    if (page_pending_) {
+        FlushPage(fill_ix_ ^ 1);
+        page_pending_ = false;
+    }
+    if (page_open_) {
+        FlushPage(fill_ix_);
+        page_open_ = false;
+    }
+    SendChunk();
+    Wire.setClock(TWI_BASE_CLOCK);
+    CloseBaseImage();
+    uint8_t errors = out_of_order_ ? 1 : 0;
+    for (uint8_t target_ix = 0; target_ix < target_count_; target_ix++) {
+        errors += target_errors_[target_ix];
+    }
+    return errors;
+}
+
+// Function GetPageCount
+uint16_t PageUploader::GetPageCount(void) {
+    return page_count_;
+}
+
+// Function GetSkippedCount
+uint16_t PageUploader::GetSkippedCount(void) {
+    return skipped_count_;
+}
+
+// Function GetResumedCount (pages not sent, as a previous attempt already wrote them)
+uint16_t PageUploader::GetResumedCount(void) {
+    return resumed_count_;
+}
+
+// Function GetConfirmedEnd
+// End of the slave flash known to hold the image: every page from the first one up to here was
+// written with no error (or didn't need to be) on every slave
+uint32_t PageUploader::GetConfirmedEnd(void) {
+    return confirmed_end_;
+}
+
+// Function GetTargetErrors
+uint8_t PageUploader::GetTargetErrors(uint8_t target_ix) {
+    return (target_ix < target_count_) ? ((out_of_order_ ? 1 : 0) + target_errors_[target_ix]) : 0;
+}
+
+// Function GetTargetRate (bytes per second written to a slave, flash programming time included)
+uint32_t PageUploader::GetTargetRate(uint8_t target_ix) {
+    if ((target_ix >= target_count_) || (links_[target_ix].busy_us == 0)) {
+        return 0;
+    }
+    return (uint64_t)links_[target_ix].bytes * 1000000 / links_[target_ix].busy_us;
+}
+
+// Function GetTargetClock (bus clock a slave was last written at)
+uint32_t PageUploader::GetTargetClock(uint8_t target_ix) {
+    return (target_ix < target_count_) ? links_[target_ix].clock : 0;
+}
+
+// Function GetTargetChunk (most pages a slave was last written per upload call)
+uint8_t PageUploader::GetTargetChunk(uint8_t target_ix) {
+    return (target_ix < target_count_) ? min(links_[target_ix].chunk_pages, chunk_capacity_) : 0;
+}
+
+// Function DataHandler (IHexDataHandler adapter, context is the PageUploader)
+void PageUploader::DataHandler(uint32_t address, const uint8_t *data, uint8_t length, void *context) {
+    ((PageUploader *)context)->Write(address, data, length);
+}
+
+// Function IdleHandler (HttpIdleHandler adapter, context is the PageUploader)
+void PageUploader::IdleHandler(void *context) {
+    ((PageUploader *)context)->SendPending();
+}
+
+// Function OpenPage
+void PageUploader::OpenPage(uint32_t page_address) {
+    memset(page_buffer_[fill_ix_], 0xFF, TML_PAGE_SIZE);
+    page_address_[fill_ix_] = page_address;
+    page_open_ = true;
+}
+
+// Function FlushPage
+// A page to write joins the run waiting to go out, which is written once it is full or the next
+// page doesn't follow it. Pages that need no write are confirmed after the run before them.
+void PageUploader::FlushPage(uint8_t buffer_ix) {
+    uint32_t page_address = page_address_[buffer_ix];
+    if (page_count_ == 0) {
+        confirmed_end_ = page_address;
+    }
+    bool skip_page = (page_address < resume_address_);
+    if (skip_page) {
+        resumed_count_++;
+    } else if ((skip_page = PageUnchanged(buffer_ix))) {
+        skipped_count_++;
+    }
+    if ((chunk_pages_ > 0) && (skip_page || (page_address != chunk_address_ + (uint32_t)chunk_pages_ * TML_PAGE_SIZE))) {
+        SendChunk();
+    }
+    if (skip_page) {
+        ConfirmPages(page_address, 1);
+    } else {
+        if (chunk_pages_ == 0) {
+            chunk_address_ = page_address;
+        }
+        if (p_chunk_buffer_ != nullptr) {
+            memcpy(&p_chunk_buffer_[chunk_pages_ * TML_PAGE_SIZE], page_buffer_[buffer_ix], TML_PAGE_SIZE);
+            p_chunk_ = p_chunk_buffer_;
+        } else {
+            p_chunk_ = page_buffer_[buffer_ix];
+        }
+        if (++chunk_pages_ == chunk_capacity_) {
+            SendChunk();
+        }
+    }
+    if (p_image_writer_ != nullptr) {
+        p_image_writer_->Append(page_address, page_buffer_[buffer_ix], TML_PAGE_SIZE);
+    }
+    page_count_++;
+}
+
+// Function SendChunk
+// Writes the waiting run of pages to every slave still without errors. A slave that already lost
+// a page gets no more, the rest of the bus time goes to the others.
+void PageUploader::SendChunk(void) {
+    if (chunk_pages_ == 0) {
+        return;
+    }
+    if (target_count_ == 1) {
+        if ((target_errors_[0] == 0) && !WriteChunk(0, 0, chunk_pages_)) {
+            target_errors_[0]++;
+        }
+    } else {
+        for (uint8_t page_ix = 0; page_ix < chunk_pages_; page_ix++) {
+            BroadcastPage(page_ix);
+        }
+        // The run is only on a slave once it is done programming its last page
+        for (uint8_t target_ix = 0; target_ix < target_count_; target_ix++) {
+            unsigned long wait_start = micros();
+            if (target_errors_[target_ix] == 0) {
+                if (WaitReady(target_ix)) {
+                    links_[target_ix].busy_us += micros() - wait_start;
+                } else {
+                    LOG_ERROR("[%s] Slave %d didn't finish writing page 0x%04X!\n\r", __func__, target_ix,
+                              chunk_address_ + (uint32_t)(chunk_pages_ - 1) * TML_PAGE_SIZE);
+                    target_errors_[target_ix]++;
+                }
+            }
+        }
+    }
+    bool chunk_confirmed = true;
+    for (uint8_t target_ix = 0; target_ix < target_count_; target_ix++) {
+        chunk_confirmed = chunk_confirmed && (target_errors_[target_ix] == 0);
+    }
+    if (chunk_confirmed) {
+        ConfirmPages(chunk_address_, chunk_pages_);
+    }
+    chunk_pages_ = 0;
+}
+
+// Function BroadcastPage
+// Sends a page of the waiting run to every slave still without errors, one write packet to each
+// in turn, so a slave stores a packet while the next one receives its own. The last packet starts
+// the page write, all the slaves program it at the same time and each one is only waited for
+// before its next page. A slave that missed a packet gets the page again on its own, with its
+// link slowed down.
+void PageUploader::BroadcastPage(uint8_t page_ix) {
+    const uint8_t *p_page = &p_chunk_[page_ix * TML_PAGE_SIZE];
+    uint32_t address = chunk_address_ + (uint32_t)page_ix * TML_PAGE_SIZE;
+    bool sent[MAX_UPLOAD_TARGETS];
+    TimingSpan page_span;
+    ota_timing.Begin(&page_span, TIMING_PAGE);
+    unsigned long round_start = micros();
+    for (uint8_t target_ix = 0; target_ix < target_count_; target_ix++) {
+        sent[target_ix] = (target_errors_[target_ix] == 0) && WaitReady(target_ix) && SetPageAddress(target_ix, address);
+    }
+    for (uint8_t offset = 0; offset < TML_PAGE_SIZE; offset += TML_PACKET_SIZE) {
+        for (uint8_t target_ix = 0; target_ix < target_count_; target_ix++) {
+            sent[target_ix] = sent[target_ix] && WritePacket(target_ix, &p_page[offset]);
+        }
+    }
+    unsigned long round_time = micros() - round_start;
+    ota_timing.End(&page_span);
+    for (uint8_t target_ix = 0; target_ix < target_count_; target_ix++) {
+        if (sent[target_ix]) {
+            links_[target_ix].bytes += TML_PAGE_SIZE;
+            links_[target_ix].busy_us += round_time;
+        } else if (target_errors_[target_ix] == 0) {
+            SlowDown(target_ix);
+            if (!WriteChunk(target_ix, page_ix, page_ix + 1)) {
+                target_errors_[target_ix]++;
+            }
+        }
+    }
+}
+
+// Function SetPageAddress (the slave acknowledges with the sum of the address bytes)
+bool PageUploader::SetPageAddress(uint8_t target_ix, uint32_t address) {
+    uint8_t command[] = {STPGADDR, (uint8_t)(address >> 8), (uint8_t)address, 0};
+    uint8_t reply[2];
+    command[3] = command[1] + command[2];
+    Wire.setClock(links_[target_ix].clock);
+    return (p_timonels_[target_ix]->TwiCmdXmit(command, sizeof(command), AKPGADDR, reply, sizeof(reply)) == 0) &&
+           (reply[0] == AKPGADDR) && (reply[1] == command[3]);
+}
+
+// Function WritePacket (the slave acknowledges with the sum of the data bytes)
+bool PageUploader::WritePacket(uint8_t target_ix, const uint8_t data[]) {
+    TargetLink *p_link = &links_[target_ix];
+    uint8_t command[1 + TML_PACKET_SIZE + 1];
+    uint8_t reply[2];
+    command[0] = WRITPAGE;
+    command[TML_PACKET_SIZE + 1] = 0;
+    for (uint8_t ix = 0; ix < TML_PACKET_SIZE; ix++) {
+        command[ix + 1] = data[ix];
+        command[TML_PACKET_SIZE + 1] += data[ix];
+    }
+    unsigned long since_packet = micros() - p_link->packet_us;
+    if (since_packet < TML_PACKET_GAP_US) {
+        delayMicroseconds(TML_PACKET_GAP_US - since_packet);
+    }
+    Wire.setClock(p_link->clock);
+    uint8_t xmit_errors = p_timonels_[target_ix]->TwiCmdXmit(command, sizeof(command), ACKWTPAG, reply, sizeof(reply));
+    p_link->packet_us = micros();
+    return (xmit_errors == 0) && (reply[0] == ACKWTPAG) && (reply[1] == command[TML_PACKET_SIZE + 1]);
+}
+
+// Function WaitReady (a slave programming a page doesn't acknowledge its address)
+bool PageUploader::WaitReady(uint8_t target_ix) {
+    uint8_t twi_address = p_timonels_[target_ix]->GetTwiAddress();
+    unsigned long wait_start = millis();
+    Wire.setClock(links_[target_ix].clock);
+    while (true) {
+        Wire.beginTransmission(twi_address);
+        if (Wire.endTransmission() == 0) {
+            return true;
+        }
+        if (millis() - wait_start >= TML_PAGE_TIMEOUT) {
+            return false;
+        }
+        delayMicroseconds(TML_WRITE_POLL_US);
+    }
+}
+
+// Function WriteChunk
+// Writes pages of the waiting run to one slave, from first_page up to end_page (not included), in
+// as few upload calls as its link allows. A failed call is repeated with the link slowed down,
+// only the failures with the link at its slowest count as tries.
+bool PageUploader::WriteChunk(uint8_t target_ix, uint8_t first_page, uint8_t end_page) {
+    TargetLink *p_link = &links_[target_ix];
+    uint8_t offset = first_page;
+    uint8_t tries = 0;
+    while (offset < end_page) {
+        uint8_t page_count = min(p_link->chunk_pages, (uint8_t)(end_page - offset));
+        uint32_t address = chunk_address_ + (uint32_t)offset * TML_PAGE_SIZE;
+        Wire.setClock(p_link->clock);
+        TimingSpan page_span;
+        ota_timing.Begin(&page_span, TIMING_PAGE);
+        unsigned long write_start = micros();
+        uint8_t page_errors = p_timonels_[target_ix]->UploadApplication((uint8_t *)&p_chunk_[offset * TML_PAGE_SIZE], page_count * TML_PAGE_SIZE, address);
+        unsigned long write_time = micros() - write_start;
+        ota_timing.End(&page_span);
+        if (page_errors == 0) {
+            p_link->bytes += page_count * TML_PAGE_SIZE;
+            p_link->busy_us += write_time;
+            offset += page_count;
+            tries = 0;
+        } else if (!SlowDown(target_ix) && (++tries >= PAGE_UPLOAD_TRIES)) {
+            LOG_ERROR("[%s] Page 0x%04X upload to slave %d failed! (%d)\n\r", __func__, address, target_ix, page_errors);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function SlowDown (halves the clock and the run length of a link, false if both are at their least)
+bool PageUploader::SlowDown(uint8_t target_ix) {
+    TargetLink *p_link = &links_[target_ix];
+    if ((p_link->clock <= TWI_BASE_CLOCK) && (p_link->chunk_pages <= 1)) {
+        return false;
+    }
+    p_link->clock = max(p_link->clock / 2, (uint32_t)TWI_BASE_CLOCK);
+    p_link->chunk_pages = max(p_link->chunk_pages / 2, 1);
+    LOG_WARN("[%s] Write to slave %d failed, going on at %lu kHz, up to %d pages per write ...\n\r", __func__,
+             target_ix, (unsigned long)(p_link->clock / 1000), p_link->chunk_pages);
+    return true;
+}
+
+// Function ConfirmPages (the confirmed part only grows with no page missing in between)
+void PageUploader::ConfirmPages(uint32_t address, uint8_t page_count) {
+    for (uint8_t page_ix = 0; (page_ix < page_count) && (address == confirmed_end_); page_ix++) {
+        confirmed_end_ = address + TML_PAGE_SIZE;
+        address += TML_PAGE_SIZE;
+        if ((++unreported_pages_ >= CONFIRM_INTERVAL) && (confirm_handler_ != nullptr)) {
+            confirm_handler_(confirmed_end_, confirm_context_);
+            unreported_pages_ = 0;
+        }
+    }
+}
+
+// Function PageUnchanged
+// True if the slave page already holds the data: the same page of the base image in delta
+// flashing, or a blank page on a slave erased before flashing (not when resuming)
+bool PageUploader::PageUnchanged(uint8_t buffer_ix) {
+    uint8_t base_page[TML_PAGE_SIZE];
+    uint32_t page_address = page_address_[buffer_ix];
+    // The reset vector page always goes through the bootloader, which rebuilds its trampoline from it
+    if (page_address == 0) {
+        return false;
+    }
+    if (!base_file_) {
+        if (!skip_blank_) {
+            return false;
+        }
+        for (uint8_t ix = 0; ix < TML_PAGE_SIZE; ix++) {
+            if (page_buffer_[buffer_ix][ix] != 0xFF) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (page_address < base_header_.load_address) {
+        return false;
+    }
+    if (p_packed_base_ != nullptr) {
+        // A packed base can only be decoded forward: the pages before this one are decoded and dropped
+        if (page_address < p_packed_base_->address) {
+            return false;
+        }
+        while (p_packed_base_->address < page_address) {
+            if (!ReadPackedBase(base_page, min((uint32_t)TML_PAGE_SIZE, page_address - p_packed_base_->address))) {
+                return false;
+            }
+        }
+        if (!ReadPackedBase(base_page, TML_PAGE_SIZE)) {
+            return false;
+        }
+    } else if (((page_address + TML_PAGE_SIZE) > (base_header_.load_address + base_header_.payload_size)) ||
+               !base_file_.seek(sizeof(FwImageHeader) + page_address - base_header_.load_address) ||
+               (base_file_.read(base_page, TML_PAGE_SIZE) != TML_PAGE_SIZE)) {
+        return false;
+    }
+    return (memcmp(base_page, page_buffer_[buffer_ix], TML_PAGE_SIZE) == 0);
+}
+
+// Function ReadPackedBase (decodes the next bytes of a packed base, false past its end)
+bool PageUploader::ReadPackedBase(uint8_t data[], size_t length) {
+    PackedBase *p_base = p_packed_base_;
+    size_t data_len = 0;
+    while (true) {
+        data_len += p_base->decoder.Decode(&p_base->p_input, &p_base->input_len, &data[data_len], length - data_len);
+        if (data_len == length) {
+            break;
+        }
+        // Input used up, the next piece of the payload is read
+        size_t input_len = (p_base->stored_left > 0) ? base_file_.read(p_base->input, min(p_base->stored_left, (uint32_t)FW_IMAGE_CHUNK)) : 0;
+        if (input_len == 0) {
+            return false;
+        }
+        p_base->p_input = p_base->input;
+        p_base->input_len = input_len;
+        p_base->stored_left -= input_len;
+    }
+    p_base->address += length;
+    return true;
+}
+
+// Function CloseBaseImage
+void PageUploader::CloseBaseImage(void) {
+    if (base_file_) {
+        base_file_.close();
+    }
+    if (p_packed_base_ != nullptr) {
+        ota_arena.Release(base_arena_mark_);
+        p_packed_base_ = nullptr;
+    }
+}
@@ -0,0 +1,82 @@
+/*
+  secure-client.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Reusable TLS client
+  ----------------------------------------------------------------------------
+*/
+
+#include "secure-client.h"
+
+#include "ota-log.h"
+
+SecureClient secure_client;  // TLS client of every update request, it keeps their session
+
+// Function Connect
+// The first connection to a server probes its max fragment length support, at the cost of a
+// server hello. Buffer sizes only change between connections.
+bool SecureClient::Connect(const char host[], uint16_t port, const char fingerprint[]) {
+    if (session_host_ != host) {
+        ForgetSession();
+        session_host_ = host;
+    }
+    if (mfln_support_ == MFLN_UNKNOWN) {
+        mfln_support_ = probeMaxFragmentLength(host, port, TLS_FRAGMENT_LEN) ? MFLN_SUPPORTED : MFLN_REFUSED;
+        if (mfln_support_ == MFLN_SUPPORTED) {
+            SetBuffers(TLS_FRAGMENT_LEN, TLS_FRAGMENT_LEN);
+        }
+    }
+    setFingerprint(fingerprint);
+    setSession(&session_);
+    bool resuming = session_saved_;
+    unsigned long handshake_start = millis();
+    if (!connect(host, port)) {
+        // A refused resumption must not make every later connection fail the same way
+        ForgetSession();
+        session_host_ = host;
+        return false;
+    }
+    handshake_time_ = millis() - handshake_start;
+    session_saved_ = true;
+    LOG_INFO("[%s] TLS handshake %lu ms (%s session), buffers RX %u + TX %u bytes ...\n\r", __func__,
+             (unsigned long)handshake_time_, resuming ? "resumed" : "new", rx_buffer_size_, tx_buffer_size_);
+    if ((mfln_support_ == MFLN_SUPPORTED) && !getMFLNStatus()) {
+        // The server may send full size records this time, the next connections get the default buffers
+        LOG_WARN("[%s] Max fragment length not negotiated!\n\r", __func__);
+        mfln_support_ = MFLN_REFUSED;
+        SetBuffers(TLS_DEFAULT_RX_LEN, TLS_DEFAULT_TX_LEN);
+    }
+    return true;
+}
+
+// Function ForgetSession (the next connection does a full handshake and probes the server again)
+void SecureClient::ForgetSession(void) {
+    session_ = BearSSL::Session();
+    session_saved_ = false;
+    session_host_ = "";
+    mfln_support_ = MFLN_UNKNOWN;
+    SetBuffers(TLS_DEFAULT_RX_LEN, TLS_DEFAULT_TX_LEN);
+}
+
+// Function GetHandshakeTime (ms taken by the last connection, TCP connection included)
+uint32_t SecureClient::GetHandshakeTime(void) {
+    return handshake_time_;
+}
+
+// Function GetRxBufferSize (bytes, overhead included)
+uint16_t SecureClient::GetRxBufferSize(void) {
+    return rx_buffer_size_;
+}
+
+// Function GetTxBufferSize (bytes, overhead included)
+uint16_t SecureClient::GetTxBufferSize(void) {
+    return tx_buffer_size_;
+}
+
+// Function SetBuffers (record payload sizes, for the next connection)
+void SecureClient::SetBuffers(uint16_t rx_len, uint16_t tx_len) {
+    setBufferSizes(rx_len, tx_len);
+    rx_buffer_size_ = rx_len + TLS_RX_OVERHEAD;
+    tx_buffer_size_ = tx_len + TLS_TX_OVERHEAD;
+}
@@ -20,6 +20,15 @@
 
 #include "timonel-twim-ota.h"
 
+OtaContext ota;  // Update state machine, advanced from loop()
+
+alignas(OTA_ARENA_ALIGN) static uint8_t ota_arena_pool[OTA_ARENA_SIZE];
+OtaArena ota_arena(ota_arena_pool, OTA_ARENA_SIZE);  // Update memory, reserved at build time
+TwiRegistry twi_registry(SDA, SCL);  // Where the slave was last seen on the bus
+
+static HttpIdleHandler http_idle_handler = nullptr;  // Work done while a download waits for data
+static void *http_idle_context = nullptr;
+
 /*  ___________________
    |                   | 
    |    Setup block    |
@@ -28,33 +37,23 @@
 void setup(void) {
     Serial.begin(SERIAL_BPS);
     ClrScr();
-    delay(3000);
-    Serial.printf_P("\n\r");
-    Serial.printf_P("...............................................\n\r");
-    Serial.printf_P(".          TIMONEL-TWIM-OTA DEMO 2.0          .\n\r");
-    Serial.printf_P("...............................................\n\r");
-
-    uint8_t slave_address = 0;
-    TwiBus *p_twi_bus = new TwiBus(SDA, SCL);
-    // Keep waiting until a slave device is detected    
-    USE_SERIAL.printf_P("\n\rWaiting until a TWI slave device is detected on the bus   ");
-    while (slave_address == 0) {
-        slave_address = p_twi_bus->ScanBus();
-        RotaryDelay();
-    }
-    USE_SERIAL.printf_P("\n\n\r");
-    delete p_twi_bus;
-
-    String new_ver = CheckFwUpdate(SSID, PASS, WEB_HOST, WEB_PORT, FINGERPRINT,
-                                   ReadFile(FW_ONBOARD_VER),
-                                   FW_LATEST_WEB);
-    if (new_ver != "") {
-        Serial.printf_P("New firmware version found on the intenet: %s, updating ATtiny85 ...\n\r", new_ver.c_str());
-        UpdateFirmware(new_ver);
-    } else {
-        Serial.printf_P("No new firmware version available ...\n\r");
-        StartApplication();
-    }
+    LOG_INFO("\n\r");
+    LOG_INFO("...............................................\n\r");
+    LOG_INFO(".          TIMONEL-TWIM-OTA DEMO 2.0          .\n\r");
+    LOG_INFO("...............................................\n\r");
+
+    // The filesystem stays mounted from here on, the state files are read from flash only once
+    fs_session.CacheFile(FW_LATEST_ETAG);
+    fs_session.CacheFile(FW_LATEST_DATE);
+    fs_session.Mount();
+    RecoverUpdateState();
+    fw_store.Load();
+    twi_registry.Load();
+    ota_timing.Load();
+
+    // Keep waiting until a slave device is detected
+    LOG_INFO("\n\rWaiting until a TWI slave device is detected on the bus   ");
+    SetOtaState(&ota, OTA_WAIT_SLAVE);
 }
 
 /*  ___________________
@@ -63,24 +62,503 @@ void setup(void) {
    |___________________|
 */
 void loop(void) {
-    uint16_t seconds = 60;
-    Serial.printf_P("\n\rI2C master main loop started");
-    Serial.printf_P("\n\r============================\n\n\r");
-
-    while (seconds) {
-        Serial.printf_P(".%d ", seconds);
-        delay(1000);
-        seconds--;
-    }
-    Serial.printf_P("\n\n\rI2C master restarting to check for ATtiny85 firmware updates, bye!\n\n\r");
-    delay(3000);
-    ESP.restart();
+    // Every state returns at once or after a bounded I/O operation, nothing sleeps here
+    RunOtaStateMachine(&ota);
+    ServeLanPush(&ota);
+    CheckSerialCommand();
+    LOG_DRAIN();
+    yield();
 }
 
 // #############################################################################################
 // #############################################################################################
 // #############################################################################################
 
+/*  ____________________________
+   |                            | 
+   |     RunOtaStateMachine     |
+   |____________________________|
+*/
+// Cooperative update state machine: states that wait on the slave poll it and return, so an
+// update takes only as long as the hardware needs. Failed attempts are retried in-process.
+void RunOtaStateMachine(OtaContext *p_ota) {
+    unsigned long state_elapsed = millis() - p_ota->state_time;
+    switch (p_ota->state) {
+        case OTA_WAIT_SLAVE: {
+            // ..................................................
+            // Waiting until any slave answers on the bus
+            // ..................................................
+            if (state_elapsed >= p_ota->poll_count * TWI_SCAN_INTERVAL) {
+                p_ota->poll_count++;
+                RotarySpin();
+                if (twi_registry.Locate() != 0) {
+                    LOG_INFO("\n\n\r");
+                    SetOtaState(p_ota, (WEB_UPDATE_CHECKS || LAN_PUSH_UPDATES) ? OTA_CONNECT_WIFI : OTA_START_APP);
+                }
+            }
+            break;
+        }
+        case OTA_CONNECT_WIFI: {
+            // ..................................................
+            // Associating with the WiFi network, kept between update checks
+            // ..................................................
+            if (WiFi.status() == WL_CONNECTED) {
+                if (p_ota->wifi_span.running) {
+                    ota_timing.End(&p_ota->wifi_span);
+                    LOG_INFO("\n\r");
+                    LOG_DEBUG("[%s] WiFi connected! IP address: %s\n\r", __func__, WiFi.localIP().toString().c_str());
+                }
+                p_ota->wifi_tries = 0;
+#if LAN_PUSH_UPDATES
+                if (!lan_push.Running()) {
+                    lan_push.Begin(LAN_PUSH_HOST);
+                }
+#endif  // LAN_PUSH_UPDATES
+                SetOtaState(p_ota, WEB_UPDATE_CHECKS ? OTA_CHECK_UPDATE : OTA_START_APP);
+            } else if (p_ota->poll_count == 0) {
+                p_ota->poll_count++;
+                ota_timing.Begin(&p_ota->wifi_span, TIMING_WIFI);
+                WiFi.mode(WIFI_STA);
+                WiFi.begin(SSID, PASS);
+                LOG_INFO("[%s] Opening WiFi connection ", __func__);
+            } else if (state_elapsed >= WIFI_CONNECT_TIMEOUT) {
+                LOG_INFO("\n\r");
+                LOG_ERROR("[%s] No WiFi connection after %lu ms!\n\r", __func__, WIFI_CONNECT_TIMEOUT);
+                p_ota->wifi_span.running = false;  // A failed association is not timed
+                SetOtaState(p_ota, OTA_WIFI_RETRY);
+            } else if (state_elapsed >= p_ota->poll_count * WIFI_POLL_INTERVAL) {
+                p_ota->poll_count++;
+                LOG_INFO(".");
+            }
+            break;
+        }
+        case OTA_WIFI_RETRY: {
+            // ..................................................
+            // Counting the failed association, the next one starts after a pause
+            // ..................................................
+            if (p_ota->poll_count == 0) {
+                p_ota->poll_count++;
+                p_ota->wifi_tries++;
+                WiFi.disconnect();
+                if (p_ota->wifi_tries >= WIFI_CONNECT_TRIES) {
+                    LOG_ERROR("[%s] WiFi unreachable after %d tries, the slave keeps running its application ...\n\r", __func__, p_ota->wifi_tries);
+                    p_ota->wifi_tries = 0;
+                    SetOtaState(p_ota, OTA_START_APP);
+                }
+            } else if (state_elapsed >= WIFI_RETRY_BACKOFF) {
+                SetOtaState(p_ota, OTA_CONNECT_WIFI);
+            }
+            break;
+        }
+        case OTA_CHECK_UPDATE: {
+            // ..................................................
+            // Asking the web server for the latest firmware version
+            // ..................................................
+            p_ota->new_version = CheckFwUpdate(SSID, PASS, WEB_HOST, WEB_PORT, FINGERPRINT,
+                                               update_journal.GetState().onboard_version,
+                                               FW_LATEST_WEB, &p_ota->manifest);
+            if (p_ota->new_version == "") {
+                LOG_INFO("No new firmware version available ...\n\r");
+                SetOtaState(p_ota, OTA_START_APP);
+                break;
+            }
+            LOG_INFO("New firmware version found on the intenet: %s, updating ATtiny85 ...\n\r", p_ota->new_version.c_str());
+            BeginUpdate(p_ota);
+            break;
+        }
+        case OTA_FETCH_IMAGE: {
+            // ..................................................
+            // Getting the new firmware and checking it, before the slave is touched
+            // ..................................................
+            ota_arena.Reset();
+            uint8_t errors = FetchFirmware(p_ota->new_version, &p_ota->manifest);
+            if (errors == 0) {
+                SetOtaState(p_ota, MULTI_TARGET_FLASHING ? OTA_FLEET_RESET : OTA_FIND_BOOTLOADER);
+            } else {
+                // Not a flash attempt: the slave application is left as it is, the next check tries again
+                LOG_INFO("[%s] Firmware [%s] not flashed, the slave keeps running its application ...\n\r", __func__, p_ota->new_version.c_str());
+                SetOtaState(p_ota, OTA_START_APP);
+            }
+            break;
+        }
+        case OTA_FIND_BOOTLOADER: {
+            // ..................................................
+            // Locating the slave, its application is reset into Timonel if needed
+            // ..................................................
+            LOG_INFO("[%s] Update attempts [%d of %d], starting the update routine ...\n\r", __func__, p_ota->update_tries + 1, MAX_UPDATE_TRIES);
+            p_ota->twi_address = twi_registry.Locate();
+            LOG_INFO("[%s] TWI address detected: %d", __func__, p_ota->twi_address);
+            if (p_ota->twi_address < LOW_TML_ADDR) {
+                LOG_INFO(", invalid address or device not present!\n\r");
+                SetOtaState(p_ota, OTA_RETRY);
+            } else if (p_ota->twi_address <= HIG_TML_ADDR) {
+                LOG_INFO(", device running Timonel bootloader ...\n\r");
+                p_ota->p_timonel = new Timonel(p_ota->twi_address, SDA, SCL);
+                if (!FirmwareFits(p_ota->p_timonel, &p_ota->manifest)) {
+                    SetOtaState(p_ota, OTA_START_APP);
+                    break;
+                }
+                // Delta flashing relies on the slave holding exactly the onboard image, which is no
+                // longer true once any flash attempt has begun
+                UpdateState state = update_journal.GetState();
+                p_ota->delta_update = PIPELINED_FLASHING && DELTA_FLASHING && (state.phase != JOURNAL_FLASHING) &&
+                                      FwImageMatches(FW_ONBOARD_LOC, state.onboard_crc);
+                // A failed attempt leaves part of the image on the slave, this one goes on from there
+                p_ota->resume_address = GetResumeAddress(p_ota->new_version);
+                if (p_ota->resume_address > 0) {
+                    LOG_INFO("[%s] Resuming the failed upload at address 0x%04X, no erase ...\n\r", __func__, p_ota->resume_address);
+                }
+                // From here on the slave flash changes, a single journal record marks it
+                update_journal.BeginFlash(p_ota->update_tries + 1);
+                SetOtaState(p_ota, (p_ota->delta_update || (p_ota->resume_address > 0)) ? OTA_WAIT_READY : OTA_ERASE);
+            } else {
+                LOG_INFO(", device running an user application ...\n\r");
+                NbMicro micro(p_ota->twi_address, SDA, SCL);
+                micro.TwiCmdXmit(RESETMCU, ACKRESET);
+                SetOtaState(p_ota, OTA_WAIT_BOOTLOADER);
+            }
+            break;
+        }
+        case OTA_WAIT_BOOTLOADER: {
+            // ..................................................
+            // Waiting for the reset slave to answer at a Timonel address
+            // ..................................................
+            if (state_elapsed >= p_ota->poll_count * TML_POLL_INTERVAL) {
+                p_ota->poll_count++;
+                // Only the known bootloader address is probed, the bus is scanned now and then in
+                // case the slave came back elsewhere
+                uint8_t twi_address = twi_registry.Locate(TWI_ROLE_BOOTLOADER, (p_ota->poll_count % TML_RESCAN_POLLS) == 0);
+                if (twi_address != 0) {
+                    LOG_INFO("[%s] The user application stopped after %lu ms ...\n\r", __func__, state_elapsed);
+                    SetOtaState(p_ota, OTA_FIND_BOOTLOADER);
+                } else if (state_elapsed > TML_READY_TIMEOUT) {
+                    LOG_ERROR("[%s] The slave didn't restart into the bootloader!\n\r", __func__);
+                    SetOtaState(p_ota, OTA_RETRY);
+                }
+            }
+            break;
+        }
+        case OTA_ERASE: {
+            // ..................................................
+            // Deleting the slave application
+            // ..................................................
+            p_ota->p_timonel->GetStatus();
+            ota_timing.Begin(&p_ota->erase_span, TIMING_ERASE);
+            p_ota->p_timonel->DeleteApplication();
+            SetOtaState(p_ota, OTA_WAIT_READY);
+            break;
+        }
+        case OTA_WAIT_READY: {
+            // ..................................................
+            // Polling the bootloader until it answers (i.e. any erase is over)
+            // ..................................................
+            if (state_elapsed >= p_ota->poll_count * TML_POLL_INTERVAL) {
+                p_ota->poll_count++;
+                if (TimonelReady(p_ota->p_timonel, p_ota->twi_address)) {
+                    if (p_ota->erase_span.running) {
+                        ota_timing.End(&p_ota->erase_span);
+                    }
+                    SetOtaState(p_ota, OTA_FLASH);
+                } else if (state_elapsed > TML_READY_TIMEOUT) {
+                    LOG_ERROR("[%s] Timonel bootloader not answering!\n\r", __func__);
+                    p_ota->erase_span.running = false;  // A failed erase is not timed
+                    SetOtaState(p_ota, OTA_RETRY);
+                }
+            }
+            break;
+        }
+        case OTA_FLASH: {
+            // ..................................................
+            // Sending the new firmware to the slave
+            // ..................................................
+            ota_arena.Reset();
+#if PIPELINED_FLASHING
+            uint8_t errors = PipelineFirmware(p_ota->new_version, p_ota->p_timonel, p_ota->delta_update, p_ota->resume_address);
+#else
+            uint8_t errors = BufferFirmware(p_ota->new_version, p_ota->p_timonel, p_ota->resume_address, &p_ota->manifest);
+#endif  // PIPELINED_FLASHING
+            LOG_INFO("[%s] OTA arena: %u of %u bytes used at most ...\n\r", __func__, (unsigned int)ota_arena.GetPeak(), (unsigned int)ota_arena.GetSize());
+            LOG_INFO("[%s] TWI slave lookups: %lu address probes, %lu bus scans ...\n\r", __func__, (unsigned long)twi_registry.GetProbeCount(), (unsigned long)twi_registry.GetScanCount());
+            if (errors == 0) {
+                // ..................................................
+                // Application firmware loaded on the device
+                // ..................................................
+                LOG_INFO("[%s] Firmware upload successful!\n\r", __func__);
+                // The latest firmware becomes the onboard one and the retry counter is reset, all in
+                // one record. Then the image file follows, RecoverUpdateState() finishes it if needed.
+                update_journal.CommitFlash();
+                fw_store.Add(FW_LATEST_LOC);
+                Rename(FW_LATEST_LOC, FW_ONBOARD_LOC);
+                SetOtaState(p_ota, OTA_START_APP);
+            } else {
+                LOG_ERROR("[%s] Firmware upload error! (%d)\n\r", __func__, errors);
+                SetOtaState(p_ota, OTA_RETRY);
+            }
+            break;
+        }
+        case OTA_RETRY: {
+            // ..................................................
+            // Counting the failed attempt, the next one starts here, without resetting the master
+            // ..................................................
+            if (p_ota->poll_count == 0) {
+                p_ota->poll_count++;
+                p_ota->update_tries++;
+                LOG_INFO("[%s] Failed attempts: [%d] ...\n\r", __func__, p_ota->update_tries);
+                delete p_ota->p_timonel;
+                p_ota->p_timonel = nullptr;
+                if (p_ota->update_tries >= MAX_UPDATE_TRIES) {
+                    AbandonUpdate(p_ota);
+                }
+            } else if (state_elapsed >= RETRY_BACKOFF) {
+                SetOtaState(p_ota, OTA_FIND_BOOTLOADER);
+            }
+            break;
+        }
+        case OTA_START_APP: {
+            // ..................................................
+            // Leaving the bootloader to run the slave application
+            // ..................................................
+            if (p_ota->p_timonel != nullptr) {
+                TimingSpan run_span;
+                ota_timing.Begin(&run_span, TIMING_RUN);
+                p_ota->p_timonel->RunApplication();
+                ota_timing.End(&run_span);
+                delete p_ota->p_timonel;
+                p_ota->p_timonel = nullptr;
+            } else {
+#if MULTI_TARGET_FLASHING
+                StartTwiFleet();
+#else
+                StartApplication();
+#endif  // MULTI_TARGET_FLASHING
+            }
+            // Update attempts are rare, their timing is saved right away
+            ota_timing.Save();
+            SetOtaState(p_ota, OTA_IDLE);
+            break;
+        }
+        case OTA_IDLE: {
+            // ..................................................
+            // Normal operation until the next update check
+            // ..................................................
+            if (p_ota->poll_count == 0) {
+                LOG_INFO("\n\rI2C master main loop started");
+                LOG_INFO("\n\r============================\n\n\r");
+            }
+            if (!WEB_UPDATE_CHECKS && (!LAN_PUSH_UPDATES || (WiFi.status() == WL_CONNECTED))) {
+                p_ota->poll_count = 1;  // Only a LAN push leaves this state
+            } else if (state_elapsed >= UPDATE_CHECK_INTERVAL) {
+                if (WEB_UPDATE_CHECKS) {
+                    LOG_INFO("\n\n\rI2C master checking for ATtiny85 firmware updates ...\n\n\r");
+                }
+                // Back to the web server (or the LAN endpoint) through a new association if it was lost
+                SetOtaState(p_ota, OTA_CONNECT_WIFI);
+            } else if (state_elapsed >= p_ota->poll_count * 1000UL) {
+                LOG_INFO(".%lu ", (UPDATE_CHECK_INTERVAL - state_elapsed + 999) / 1000);
+                p_ota->poll_count++;
+            }
+            break;
+        }
+#if MULTI_TARGET_FLASHING
+        case OTA_FLEET_RESET:
+        case OTA_FLEET_DISCOVER:
+        case OTA_FLEET_ERASE:
+        case OTA_FLEET_WAIT_READY:
+        case OTA_FLEET_FLASH:
+        case OTA_FLEET_REPORT: {
+            RunFleetState(p_ota, state_elapsed);
+            break;
+        }
+#endif  // MULTI_TARGET_FLASHING
+        default: {
+            SetOtaState(p_ota, OTA_IDLE);
+            break;
+        }
+    }
+}
+
+/*  _____________________
+   |                     | 
+   |     SetOtaState     |
+   |_____________________|
+*/
+void SetOtaState(OtaContext *p_ota, OtaState state) {
+    p_ota->state = state;
+    p_ota->state_time = millis();
+    p_ota->poll_count = 0;
+    if (state == OTA_IDLE) {
+        ota_timing.SaveIfDue();  // Update checks only
+    }
+}
+
+/*  _____________________
+   |                     | 
+   |     BeginUpdate     |
+   |_____________________|
+*/
+// Starts flashing p_ota->new_version, found on the web or pushed over the LAN
+void BeginUpdate(OtaContext *p_ota) {
+#if MULTI_TARGET_FLASHING
+    // Every device keeps its own retry counter, see LoadTwiTargets()
+    SetOtaState(p_ota, OTA_FETCH_IMAGE);
+#else
+    // Flash attempts interrupted by a master reset are counted too
+    p_ota->update_tries = update_journal.GetState().update_tries;
+    if (p_ota->update_tries < MAX_UPDATE_TRIES) {
+        SetOtaState(p_ota, OTA_FETCH_IMAGE);
+    } else {
+        AbandonUpdate(p_ota);
+    }
+#endif  // MULTI_TARGET_FLASHING
+}
+
+/*  ______________________
+   |                      | 
+   |     ServeLanPush     |
+   |______________________|
+*/
+// Polled from loop(). An image POSTed while no update is running is saved and checked as a
+// download would be, then flashed at once: the reply only tells it was accepted.
+void ServeLanPush(OtaContext *p_ota) {
+#if LAN_PUSH_UPDATES
+    WiFiClient client;
+    LanPushRequest request;
+    if (!lan_push.Accept(&client, &request)) {
+        return;
+    }
+    LOG_INFO("\n\r[%s] LAN request: %s %s (%u bytes) ...\n\r", __func__, request.method.c_str(), request.path.c_str(), (unsigned int)request.content_length);
+    FwManifest manifest;
+    if (request.path != LAN_PUSH_PATH) {
+        lan_push.Reply(client, HTTP_STATUS_NOT_FOUND, "Not found");
+    } else if (request.method != "POST") {
+        lan_push.Reply(client, HTTP_STATUS_NOT_ALLOWED, "Firmware images are POSTed");
+    } else if (!request.authorized) {
+        lan_push.Reply(client, HTTP_STATUS_FORBIDDEN, "Wrong push token");
+    } else if (p_ota->state != OTA_IDLE) {
+        lan_push.Reply(client, HTTP_STATUS_UNAVAILABLE, "Update in progress, try again later");
+    } else if (!ParseFwManifest(request.manifest_text, &manifest)) {
+        lan_push.Reply(client, HTTP_STATUS_BAD_REQUEST, "No " LAN_PUSH_HEADER_PREFIX "Version header");
+    } else {
+        ota_arena.Reset();
+        uint8_t fw_errors = ReceivePushedFirmware(client, manifest.version, &manifest);
+        if (fw_errors) {
+            lan_push.Reply(client, HTTP_STATUS_UNPROCESSABLE, String("Firmware rejected (") + String(fw_errors) + ")");
+            return;
+        }
+        lan_push.Reply(client, HTTP_STATUS_ACCEPTED, "Firmware " + manifest.version + " accepted, flashing");
+        LOG_INFO("[%s] Firmware [%s] pushed over the LAN, updating ATtiny85 ...\n\r", __func__, manifest.version.c_str());
+        p_ota->new_version = manifest.version;
+        p_ota->manifest = manifest;
+        BeginUpdate(p_ota);
+    }
+#else
+    (void)p_ota;
+#endif  // LAN_PUSH_UPDATES
+}
+
+/*  _______________________________
+   |                               | 
+   |     ReceivePushedFirmware     |
+   |_______________________________|
+*/
+// Saves an image pushed by a LAN client to the latest image file, decoding it on the way as a
+// packed download is, and checks it against the manifest sent with it. Returns the firmware errors.
+uint8_t ReceivePushedFirmware(WiFiClient &client, String new_version, const FwManifest *p_manifest) {
+    FwDigest digest;
+    digest.Begin(TARGET_FLASH_SIZE);
+    FwImageStream image_stream;
+    image_stream.BeginStream(FW_LATEST_LOC, new_version, FwDigest::DataHandler, &digest);
+    uint32_t bytes_received = ReceiveHttpBody(client, FeedFwImageStream, &image_stream);
+    uint8_t fw_errors = image_stream.EndStream();
+    LOG_INFO("[%s] %u bytes received from the LAN, %u firmware bytes decoded ...\n\r", __func__, (unsigned int)bytes_received, (unsigned int)image_stream.GetStreamDataSize());
+    if (fw_errors == FW_IMAGE_OK) {
+        update_journal.SetDownloaded(new_version, image_stream.GetCrc32());
+    }
+    return VerifyFirmware(new_version, p_manifest, &digest, false, fw_errors);
+}
+
+/*  _______________________
+   |                       | 
+   |     AbandonUpdate     |
+   |_______________________|
+*/
+// Update retries exceeded, running the application and exiting this update routine
+void AbandonUpdate(OtaContext *p_ota) {
+    LOG_ERROR("[%s] Retry [%d of %d] failed, please power-cycle both, master and slave devices!\n\r", __func__, p_ota->update_tries, MAX_UPDATE_TRIES);
+    //Format();
+    update_journal.AbandonFlash();
+    if (Exists(FW_LATEST_LOC)) {
+        DeleteFile(FW_LATEST_LOC);
+    }
+    if (Exists(FW_ONBOARD_LOC)) {
+        DeleteFile(FW_ONBOARD_LOC);  // The slave flash state is unknown now
+    }
+    delete p_ota->p_timonel;
+    p_ota->p_timonel = nullptr;
+    SetOtaState(p_ota, OTA_START_APP);
+}
+
+/*  ______________________
+   |                      | 
+   |     TimonelReady     |
+   |______________________|
+*/
+// A busy bootloader (e.g. erasing its flash) doesn't acknowledge its address
+bool TimonelReady(Timonel *p_timonel, uint8_t twi_address) {
+    Wire.beginTransmission(twi_address);
+    if (Wire.endTransmission() != 0) {
+        return false;
+    }
+    p_timonel->GetStatus();
+    return true;
+}
+
+/*  ____________________________
+   |                            | 
+   |     RecoverUpdateState     |
+   |____________________________|
+*/
+// Loads the update state from the journal and brings the image files in line with it
+void RecoverUpdateState(void) {
+    if (!update_journal.Recover()) {
+        // No journal yet: the onboard version kept by the older, per-file layout is imported once
+        UpdateState state = update_journal.GetState();
+        FwImageHeader header;
+        if (Exists(FW_ONBOARD_VER)) {
+            strncpy(state.onboard_version, ReadFile(FW_ONBOARD_VER).c_str(), FW_IMAGE_VER_LEN - 1);
+            if ((ReadFwImageHeader(FW_ONBOARD_LOC, &header) == FW_IMAGE_OK) && (strcmp(header.version, state.onboard_version) == 0)) {
+                state.onboard_crc = header.crc32;
+            }
+        }
+        update_journal.Append(state);
+        const char *legacy_files[] = {FW_ONBOARD_VER, FW_LATEST_VER, UPDATE_TRIES};
+        for (const char *file_name : legacy_files) {
+            if (Exists(file_name)) {
+                DeleteFile(file_name);
+            }
+        }
+    }
+    UpdateState state = update_journal.GetState();
+    // A reset between committing an update and renaming its image leaves the new onboard image
+    // under the latest image name
+    if ((state.phase == JOURNAL_IDLE) && (state.onboard_crc != 0) && FwImageMatches(FW_LATEST_LOC, state.onboard_crc)) {
+        Rename(FW_LATEST_LOC, FW_ONBOARD_LOC);
+    }
+    LOG_INFO("[%s] Journal record %u: onboard firmware [%s], phase %d, %d tries ...\n\r", __func__,
+             update_journal.GetSequence(), state.onboard_version, state.phase, state.update_tries);
+}
+
+/*  ________________________
+   |                        | 
+   |     FwImageMatches     |
+   |________________________|
+*/
+// Checks the image file is the one the journal refers to, by its payload CRC (header only)
+bool FwImageMatches(const char file_name[], uint32_t image_crc) {
+    FwImageHeader header;
+    return Exists(file_name) && (ReadFwImageHeader(file_name, &header) == FW_IMAGE_OK) && (header.crc32 == image_crc);
+}
+
 /*  _______________________
    |                       | 
    |     CheckFwUpdate     |
@@ -92,175 +570,490 @@ String CheckFwUpdate(const char ssid[],
                      const int port,
                      const char fingerprint[],
                      const String current_version,
-                     const String latest_version) {
+                     const String latest_version,
+                     FwManifest *p_manifest) {
     String fw_latest_ver = "";
-    ListFiles();
     // ..................................................
     // Accessing the internet to check for updates
     // ..................................................
+    // The validators of the last version document found up to date make the request conditional,
+    // so an unchanged document costs only the response headers
+    HttpValidators validators;
+    if (current_version != "") {
+        if (Exists(FW_LATEST_ETAG)) {
+            validators.etag = ReadFile(FW_LATEST_ETAG);
+        }
+        if (Exists(FW_LATEST_DATE)) {
+            validators.last_modified = ReadFile(FW_LATEST_DATE);
+        }
+    }
     // Check the latest firmware version available for the slave device through WiFi
-    Serial.printf_P("[%s] Connecting to the internet to check for updates ...\n\r", __func__);
-    char terminator = '\n';
-    String fw_latest_web = GetHttpDocument(ssid, password, host, port, fingerprint, latest_version, terminator);
-    if (current_version == fw_latest_web) {
+    LOG_INFO("[%s] Connecting to the internet to check for updates ...\n\r", __func__);
+    char terminator = '\0';  // The whole manifest, up to HTTP_DOCUMENT_MAX bytes
+    HttpValidators sent_validators = validators;
+    int http_status = 0;
+    String fw_latest_web = GetHttpDocument(ssid, password, host, port, fingerprint, latest_version, terminator, &validators, &http_status);
+    if (http_status == HTTP_STATUS_NOT_FOUND) {
+        // A server with no release manifest yet still has the plain version document
+        LOG_WARN("[%s] No release manifest on the server, getting the version document ...\n\r", __func__);
+        validators = sent_validators;
+        fw_latest_web = GetHttpDocument(ssid, password, host, port, fingerprint, FW_LATEST_DOC, terminator, &validators);
+    }
+    if (!validators.not_modified && ParseFwManifest(fw_latest_web, p_manifest)) {
+        fw_latest_web = p_manifest->version;
+    } else {
+        fw_latest_web = "";
+    }
+    if (validators.not_modified) {
+        // Update NOT needed, the version document didn't change since the last check
+        LOG_INFO("[%s] ===>> Version document not modified, onboard firmware [%s] is up to date! <<===\n\r", __func__, current_version.c_str());
+    } else if (fw_latest_web == "") {
+        // No usable document, the validators are not kept
+        LOG_ERROR("[%s] No firmware version found in the release manifest!\n\r", __func__);
+    } else if (current_version == fw_latest_web) {
         // Update NOT needed
-        Serial.printf_P("[%s] ===>> Current onboard firmware [%s] is up to date! <<===\n\r", __func__, current_version.c_str());
+        LOG_INFO("[%s] ===>> Current onboard firmware [%s] is up to date! <<===\n\r", __func__, current_version.c_str());
+        // Validators are kept only for an up-to-date document, so a pending update is never skipped
+        SaveHttpValidator(FW_LATEST_ETAG, validators.etag);
+        SaveHttpValidator(FW_LATEST_DATE, validators.last_modified);
     } else {
         // There is a new firmware version available
-        Serial.printf_P("[%s] Onboard firmware version: [%s], a web update is available: [%s] ...\n\r", __func__, current_version.c_str(), fw_latest_web.c_str());
+        LOG_INFO("[%s] Onboard firmware version: [%s], a web update is available: [%s] ...\n\r", __func__, current_version.c_str(), fw_latest_web.c_str());
+        if (p_manifest->complete) {
+            LOG_INFO("[%s] Release manifest: %u firmware bytes at 0x%04X, %u records, CRC32 %08X ...\n\r", __func__, (unsigned int)p_manifest->size,
+                     (unsigned int)p_manifest->load_address, p_manifest->records, (unsigned int)p_manifest->crc32);
+        }
         fw_latest_ver = fw_latest_web;
     }
     return fw_latest_ver;
 }
 
+/*  ___________________________
+   |                           | 
+   |     SaveHttpValidator     |
+   |___________________________|
+*/
+void SaveHttpValidator(const char file_name[], const String validator) {
+    if (validator != "") {
+        WriteFile(file_name, validator);
+    } else if (Exists(file_name)) {
+        DeleteFile(file_name);
+    }
+}
+
+/*  __________________________
+   |                          | 
+   |     LatestImageReady     |
+   |__________________________|
+*/
+// True if the latest image file holds the new firmware: left by a failed attempt, or else
+// restored from the image store, with no download
+bool LatestImageReady(String new_version) {
+    UpdateState state = update_journal.GetState();
+    if ((new_version == state.latest_version) && FwImageMatches(FW_LATEST_LOC, state.latest_crc)) {
+        return true;
+    }
+    uint32_t image_crc = 0;
+    if (fw_store.Restore(new_version, FW_LATEST_LOC, &image_crc) != FW_IMAGE_OK) {
+        return false;
+    }
+    LOG_INFO("[%s] Firmware [%s] restored from the image store ...\n\r", __func__, new_version.c_str());
+    update_journal.SetDownloaded(new_version, image_crc);
+    return true;
+}
+
+/*  _______________________
+   |                       | 
+   |     FetchFirmware     |
+   |_______________________|
+*/
+// Gets the new firmware into the latest image file, from FS or the web, and checks it against the
+// release manifest before the slave is touched: a wrong image is deleted, never flashed. With an
+// older version document (no size or digest to check), pipelined flashing fetches the firmware
+// while flashing. Buffered flashing always saves it first, the slave is erased only once it is in FS.
+uint8_t FetchFirmware(String new_version, const FwManifest *p_manifest) {
+    if (PIPELINED_FLASHING && !p_manifest->complete) {
+        LOG_INFO("[%s] No release manifest, the firmware is downloaded as it is flashed ...\n\r", __func__);
+        return 0;
+    }
+    if (p_manifest->complete && (p_manifest->size > TARGET_FLASH_SIZE)) {
+        LOG_ERROR("[%s] Firmware [%s] too big for the slave flash (%u bytes)!\n\r", __func__, new_version.c_str(), (unsigned int)p_manifest->size);
+        return FW_IMAGE_ERR_SIZE;
+    }
+    String fw_latest_ver = "";
+    uint8_t fw_errors = 0;
+    bool records_counted = false;
+    FwDigest digest;
+    digest.Begin(TARGET_FLASH_SIZE);
+    if (LatestImageReady(new_version)) {
+        // ..................................................
+        // New firmware image already present in FS, from a failed update or the image store
+        // ..................................................
+        LOG_INFO("[%s] New firmware image already present in FS, checking it ...\n\r", __func__);
+        fw_errors = StreamFwImage(FW_LATEST_LOC, &fw_latest_ver, FwDigest::DataHandler, &digest);
+    } else {
+        // ..................................................
+        // Downloading the new firmware to FS, its digest is taken as it arrives
+        // ..................................................
+        LOG_INFO("[%s] Getting new firmware file version: [%s] ...\n\r", __func__, new_version.c_str());
+        bool packed_found = false;
+#if COMPRESSED_TRANSPORT
+        fw_errors = DownloadPackedFirmware(new_version, FwDigest::DataHandler, &digest, &packed_found);
+#endif  // COMPRESSED_TRANSPORT
+        if (!packed_found) {
+            // The records are saved as a contiguous image, with any gaps between them left blank
+            String url = FW_WEB_URL "/firmware-" + new_version + ".hex";
+            FwImageWriter image_writer;
+            image_writer.Begin(FW_LATEST_LOC, new_version);
+            digest.Begin(TARGET_FLASH_SIZE, FwImageWriter::DataHandler, &image_writer);
+            HexParser hex_parser;
+            hex_parser.BeginStream(FwDigest::DataHandler, &digest);
+            fw_errors = DownloadIHexFile(SSID, PASS, WEB_HOST, WEB_PORT, FINGERPRINT, url, &hex_parser);
+            records_counted = (p_manifest->records != 0);
+            bool image_valid = (fw_errors == 0) && (!p_manifest->complete || digest.Matches(p_manifest)) &&
+                               (!records_counted || (digest.GetRecordCount() == p_manifest->records));
+            uint8_t image_errors = image_writer.Finish(image_valid);
+            if (image_valid && (image_errors == FW_IMAGE_OK)) {
+                update_journal.SetDownloaded(new_version, image_writer.GetCrc32());
+            } else if (fw_errors == 0) {
+                fw_errors = image_errors;
+            }
+        }
+    }
+    return VerifyFirmware(new_version, p_manifest, &digest, records_counted, fw_errors);
+}
+
 /*  ________________________
    |                        | 
-   |     UpdateFirmware     |
+   |     VerifyFirmware     |
    |________________________|
 */
-void UpdateFirmware(String new_version) {
-    const char ssid[] = SSID;
-    const char password[] = PASS;
-    const char host[] = "raw.githubusercontent.com";
-    const int port = 443;
-    uint8_t update_tries = 0;
-    String fw_latest_dat = "";
-    String fw_latest_ver = "";
-    String fw_onboard_ver = "";
-    ListFiles();
-    // Reading update attempts recording file
-    if (ReadFile(UPDATE_TRIES).charAt(0) != '\0') {
-        update_tries = atoi(ReadFile(UPDATE_TRIES).c_str());
+// Checks the digest of the firmware just saved against the release manifest, when there is one.
+// After any error the image is deleted, so it is never flashed. Returns the firmware errors.
+uint8_t VerifyFirmware(String new_version, const FwManifest *p_manifest, FwDigest *p_digest, bool records_counted, uint8_t fw_errors) {
+    if ((fw_errors == 0) && p_manifest->complete &&
+        (!p_digest->Matches(p_manifest) || (records_counted && (p_digest->GetRecordCount() != p_manifest->records)))) {
+        LOG_ERROR("[%s] Firmware doesn't match the release manifest: %u bytes, %u records, CRC32 %08X!\n\r", __func__,
+                  (unsigned int)p_digest->GetSize(), p_digest->GetRecordCount(), (unsigned int)p_digest->GetCrc32());
+        fw_errors = FW_IMAGE_ERR_CRC;
     }
-    if (update_tries < MAX_UPDATE_TRIES) {
+    if (fw_errors) {
         // ..................................................
-        // Update retries NOT exceeded, starting update routine
+        // There were errors getting the firmware, or it isn't the one released, discarding the image
         // ..................................................
-        Serial.printf_P("[%s] Update attempts [%d of %d], starting the update routine ...\n\r", __func__, update_tries + 1, MAX_UPDATE_TRIES);
+        LOG_ERROR("Firmware file error! (%d)\n\r", fw_errors);
         if (Exists(FW_LATEST_LOC)) {
-            // ..................................................
-            // New firmware file already present in FS, probably due to a failed update
-            // ..................................................
-            Serial.printf_P("[%s] New firmware file already present in FS, web download not necessary ...\n\r", __func__);
-            fw_latest_dat = ReadFile(FW_LATEST_LOC);
-            fw_latest_ver = ReadFile(FW_LATEST_VER);
-        } else {
-            // ..................................................
-            // New firmware file NOT present in FS, accessing the internet to check for updates
-            // ..................................................
-            Serial.printf_P("[%s] No new firmware file in FS, accessing internet to check for updates ...\n\r", __func__);
-            // ..................................................
-            // There is a new firmware version available, download it through WiFi
-            // ..................................................
-            Serial.printf_P("[%s] Getting new firmware file version: [%s] ...\n\r", __func__, new_version.c_str());
-            char terminator = '\0';
-            String url = FW_WEB_URL "/firmware-" + new_version + ".hex";
-            fw_latest_dat = GetHttpDocument(ssid, password, host, port, FINGERPRINT, url, terminator);
-            WriteFile(FW_LATEST_LOC, fw_latest_dat);  // Saving the new firmware file to FS
-            WriteFile(FW_LATEST_VER, new_version);    // saving the new firmware version to FS
+            DeleteFile(FW_LATEST_LOC);
         }
-        uint16_t payload_size = GetIHexSize(fw_latest_dat);
-        uint8_t payload[payload_size];
-        if (ParseIHexFormat(fw_latest_dat, payload)) {
-            // ..................................................
-            // There were errors parsing the downloaded Intel Hex firmware, resetting master
-            // ..................................................
-            Serial.printf_P("Intel Hex file checksum error!\n\r");
-            RetryRestart(UPDATE_TRIES, update_tries);
-        }
-        // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
-        FlashTwiDevice(payload, payload_size, update_tries);  // Flash device >>>
-        // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+    } else if (p_manifest->complete) {
+        LOG_INFO("[%s] Firmware [%s] matches the release manifest ...\n\r", __func__, new_version.c_str());
+    }
+    return fw_errors;
+}
+
+/*  ______________________
+   |                      | 
+   |     FirmwareFits     |
+   |______________________|
+*/
+// Checks the released firmware ends below the slave bootloader, before its application is deleted
+bool FirmwareFits(Timonel *p_timonel, const FwManifest *p_manifest) {
+    Timonel::Status status = p_timonel->GetStatus();
+    if (!p_manifest->complete || (status.bootloader_start == 0) ||
+        (p_manifest->load_address + p_manifest->size <= status.bootloader_start)) {
+        return true;
+    }
+    LOG_ERROR("[%s] Firmware [%s] ends at 0x%04X, past the bootloader start (0x%04X), not flashed!\n\r", __func__,
+              p_manifest->version.c_str(), (unsigned int)(p_manifest->load_address + p_manifest->size), status.bootloader_start);
+    return false;
+}
+
+/*  __________________________
+   |                          | 
+   |     GetResumeAddress     |
+   |__________________________|
+*/
+// Where the upload of a version can resume: the journal records how far a failed attempt got
+// with the latest image, which must still be in FS. 0 means from the start, after an erase.
+uint16_t GetResumeAddress(String new_version) {
+    UpdateState state = update_journal.GetState();
+    if (!RESUMABLE_FLASHING || (state.phase != JOURNAL_FLASHING) || (state.flashed_end == 0) ||
+        (new_version != state.latest_version) || !FwImageMatches(FW_LATEST_LOC, state.latest_crc)) {
+        return 0;
+    }
+    return state.flashed_end;
+}
+
+/*  __________________________
+   |                          | 
+   |     PipelineFirmware     |
+   |__________________________|
+*/
+// Flashes each page as soon as it is decoded, the whole image is never held in RAM.
+// With a full update, the slave application is deleted before the download starts.
+uint8_t PipelineFirmware(String new_version, Timonel *p_timonel, bool delta_update, uint16_t resume_address) {
+    PageUploader page_uploader(p_timonel);
+    if (delta_update && (SetDeltaBase(&page_uploader) != FW_IMAGE_OK)) {
+        return 1;
+    }
+    SetFlashResume(&page_uploader, &new_version, resume_address);
+    uint8_t upload_errors = 0;
+    uint8_t fw_errors = FeedFirmwarePages(new_version, &page_uploader, &upload_errors);
+    ReportSkippedPages(&page_uploader, delta_update);
+    ReportUploadRates(&page_uploader, &p_timonel, 1);
+    if (fw_errors + upload_errors) {
+        SaveFlashProgress(new_version, &page_uploader);
+    }
+    return fw_errors + upload_errors;
+}
+
+/*  ___________________________
+   |                           | 
+   |     FeedFirmwarePages     |
+   |___________________________|
+*/
+// Feeds the new firmware to a page uploader, from the image cached in FS or else straight from
+// the web, saving the image on the way. The uploader is finished here, so the last page also
+// goes into the image: its errors go to p_upload_errors, the firmware errors are returned.
+uint8_t FeedFirmwarePages(String new_version, PageUploader *p_page_uploader, uint8_t *p_upload_errors) {
+    String fw_latest_ver = "";
+    uint8_t fw_errors = 0;
+    if (LatestImageReady(new_version)) {
+        // ..................................................
+        // New firmware image already present in FS, from a failed update or the image store
+        // ..................................................
+        LOG_INFO("[%s] New firmware image already present in FS, web download and parsing not necessary ...\n\r", __func__);
+        LOG_INFO("[%s] Timonel bootloader uploading firmware to flash memory, \x1b[5mPLEASE WAIT\x1b[0m ...\n\r", __func__);
+        fw_errors = StreamFwImage(FW_LATEST_LOC, &fw_latest_ver, PageUploader::DataHandler, p_page_uploader);
+        *p_upload_errors = p_page_uploader->Finish();
     } else {
         // ..................................................
-        // Update retries exceeded, running the application and exiting this update routine
+        // There is a new firmware version available, download and flash it page by page
         // ..................................................
-        Serial.printf_P("[%s] Retry [%d of %d] failed, please power-cycle both, master and slave devices!\n\r", __func__, update_tries, MAX_UPDATE_TRIES);
-        //Format();
+        LOG_INFO("[%s] Getting new firmware file version: [%s] ...\n\r", __func__, new_version.c_str());
+        LOG_INFO("[%s] Timonel bootloader flashing pages as they arrive, \x1b[5mPLEASE WAIT\x1b[0m ...\n\r", __func__);
+        // Complete pages go out whenever the download stalls, not only once a whole run is buffered
+        SetHttpIdleHandler(PageUploader::IdleHandler, p_page_uploader);
+        bool packed_found = false;
+#if COMPRESSED_TRANSPORT
+        fw_errors = DownloadPackedFirmware(new_version, PageUploader::DataHandler, p_page_uploader, &packed_found);
+        if (packed_found) {
+            *p_upload_errors = p_page_uploader->Finish();  // The last page goes out
+        }
+#endif  // COMPRESSED_TRANSPORT
+        if (!packed_found) {
+            String url = FW_WEB_URL "/firmware-" + new_version + ".hex";
+            FwImageWriter image_writer;
+            image_writer.Begin(FW_LATEST_LOC, new_version);
+            p_page_uploader->SetImageWriter(&image_writer);
+            HexParser hex_parser;
+            hex_parser.BeginStream(PageUploader::DataHandler, p_page_uploader);
+            fw_errors = DownloadIHexFile(SSID, PASS, WEB_HOST, WEB_PORT, FINGERPRINT, url, &hex_parser);
+            *p_upload_errors = p_page_uploader->Finish();  // The last page goes out and into the image
+            p_page_uploader->SetImageWriter(nullptr);
+            // Only a cleanly parsed image is kept for the retries
+            uint8_t image_errors = image_writer.Finish(fw_errors == 0);
+            if ((fw_errors == 0) && (image_errors == FW_IMAGE_OK)) {
+                update_journal.SetDownloaded(new_version, image_writer.GetCrc32());
+            }
+        }
+        SetHttpIdleHandler(nullptr);
+    }
+    if (fw_errors) {
+        // ..................................................
+        // There were errors parsing or loading the firmware, discarding the image
+        // ..................................................
+        LOG_ERROR("Firmware file error! (%d)\n\r", fw_errors);
         DeleteFile(FW_LATEST_LOC);
-        DeleteFile(FW_LATEST_VER);
-        WriteFile(UPDATE_TRIES, "0");
-        StartApplication();
     }
+    return fw_errors;
+}
+
+/*  ______________________
+   |                      | 
+   |     SetDeltaBase     |
+   |______________________|
+*/
+// Sets the onboard image as the delta base. If it can't be used, it is discarded and the
+// attempt fails, so the retry does a full update.
+uint8_t SetDeltaBase(PageUploader *p_page_uploader) {
+    uint8_t errors = p_page_uploader->SetBaseImage(FW_ONBOARD_LOC);
+    if (errors == FW_IMAGE_OK) {
+        LOG_INFO("[%s] Delta update, only the pages that changed will be rewritten ...\n\r", __func__);
+    } else if (errors == FW_IMAGE_ERR_MEMORY) {
+        LOG_WARN("[%s] No room to decode the onboard image, the next attempt will be a full update ...\n\r", __func__);
+    } else {
+        LOG_WARN("[%s] Onboard image unusable, the next attempt will be a full update ...\n\r", __func__);
+        DeleteFile(FW_ONBOARD_LOC);
+    }
+    return errors;
 }
 
 /*  ________________________
    |                        | 
-   |     FlashTwiDevice     |
+   |     SetFlashResume     |
    |________________________|
 */
-void FlashTwiDevice(uint8_t payload[], uint16_t payload_size, uint8_t update_tries) {
-    uint8_t twi_address = 0;
-    TwiBus twi_bus(SDA, SCL);
-    twi_address = twi_bus.ScanBus();
-    NbMicro *p_micro = nullptr;
-    Timonel *p_timonel = nullptr;
-    Serial.printf_P("[%s] TWI address detected: %d", __func__, twi_address);
-    if (twi_address < LOW_TML_ADDR) {
-        // ..................................................
-        // TWI device NOT detected in the bus, resetting master
-        // ..................................................
-        Serial.printf_P(", invalid address or device not present!\n\r");
-        // ##### (R) #####
-        RetryRestart(UPDATE_TRIES, update_tries);
+// Skips the pages a failed attempt already wrote, and checkpoints the progress as the upload goes
+void SetFlashResume(PageUploader *p_page_uploader, String *p_new_version, uint16_t resume_address) {
+#if RESUMABLE_FLASHING
+    p_page_uploader->SetResumeAddress(resume_address);
+    p_page_uploader->SetConfirmHandler(ConfirmFlashedPages, p_new_version);
+#endif  // RESUMABLE_FLASHING
+}
+
+/*  ___________________________
+   |                           | 
+   |     SaveFlashProgress     |
+   |___________________________|
+*/
+// After a failed upload, records how far the slave holds the image for the next attempt
+void SaveFlashProgress(String new_version, PageUploader *p_page_uploader) {
+#if RESUMABLE_FLASHING
+    ConfirmFlashedPages(p_page_uploader->GetConfirmedEnd(), &new_version);
+    LOG_INFO("[%s] Slave flash confirmed up to address 0x%04X ...\n\r", __func__, p_page_uploader->GetConfirmedEnd());
+#endif  // RESUMABLE_FLASHING
+}
+
+/*  _____________________________
+   |                             | 
+   |     ConfirmFlashedPages     |
+   |_____________________________|
+*/
+// FlashConfirmHandler, context is the version being flashed. Only progress with the journal's
+// latest image is recorded: a streamed download has none until it completes.
+void ConfirmFlashedPages(uint32_t confirmed_end, void *context) {
+    UpdateState state = update_journal.GetState();
+    if ((*(String *)context == state.latest_version) && (state.latest_crc != 0)) {
+        update_journal.ConfirmFlash(confirmed_end);
+    }
+}
+
+/*  ____________________________
+   |                            | 
+   |     ReportSkippedPages     |
+   |____________________________|
+*/
+void ReportSkippedPages(PageUploader *p_page_uploader, bool delta_update) {
+    if (p_page_uploader->GetResumedCount() > 0) {
+        LOG_INFO("[%s] %d of %d pages written by the failed attempt, not sent again ...\n\r", __func__, p_page_uploader->GetResumedCount(), p_page_uploader->GetPageCount());
+    }
+    if (delta_update) {
+        LOG_INFO("[%s] %d of %d pages unchanged, not rewritten ...\n\r", __func__, p_page_uploader->GetSkippedCount(), p_page_uploader->GetPageCount());
+    } else if (p_page_uploader->GetSkippedCount() > 0) {
+        LOG_INFO("[%s] %d of %d pages blank, not sent ...\n\r", __func__, p_page_uploader->GetSkippedCount(), p_page_uploader->GetPageCount());
+    }
+}
+
+/*  ___________________________
+   |                           | 
+   |     ReportUploadRates     |
+   |___________________________|
+*/
+// Write rate of each slave, flash programming included, and the link it ended up with
+void ReportUploadRates(PageUploader *p_page_uploader, Timonel *p_timonels[], uint8_t target_count) {
+    for (uint8_t target_ix = 0; target_ix < target_count; target_ix++) {
+        uint32_t rate = p_page_uploader->GetTargetRate(target_ix);
+        if (rate > 0) {
+            LOG_INFO("[%s] Device %d: %lu bytes/s written, at %lu kHz with up to %d pages per write ...\n\r", __func__,
+                     p_timonels[target_ix]->GetTwiAddress(), (unsigned long)rate,
+                     (unsigned long)(p_page_uploader->GetTargetClock(target_ix) / 1000), p_page_uploader->GetTargetChunk(target_ix));
+        }
+    }
+}
+
+/*  ________________________
+   |                        | 
+   |     BufferFirmware     |
+   |________________________|
+*/
+// Decodes the whole image saved by FetchFirmware() into RAM and then flashes it in a single upload
+uint8_t BufferFirmware(String new_version, Timonel *p_timonel, uint16_t resume_address, const FwManifest *p_manifest) {
+    String fw_latest_ver = "";
+    // Only the pages the image writes are kept in RAM. The release manifest tells how many pages the firmware spans, only those are reserved.
+    uint32_t pool_size = TARGET_FLASH_SIZE;
+    if (p_manifest->complete) {
+        uint32_t low_page = p_manifest->load_address & ~(uint32_t)(TML_PAGE_SIZE - 1);
+        uint32_t high_page = (p_manifest->load_address + p_manifest->size + TML_PAGE_SIZE - 1) & ~(uint32_t)(TML_PAGE_SIZE - 1);
+        pool_size = min(high_page - low_page, (uint32_t)TARGET_FLASH_SIZE);
+    }
+    size_t arena_mark = ota_arena.GetMark();
+    uint8_t *page_pool = (uint8_t *)ota_arena.Allocate(pool_size);
+    if (page_pool == nullptr) {
+        LOG_ERROR("[%s] No room in the OTA arena for the firmware pages!\n\r", __func__);
+        return FW_IMAGE_ERR_MEMORY;
+    }
+    SparseImage fw_image(page_pool, pool_size, TML_PAGE_SIZE);
+    uint8_t fw_errors = FW_IMAGE_OK;
+    if (LatestImageReady(new_version)) {
+        // The new firmware image was saved to FS by FetchFirmware(), before the slave was erased
+        LOG_INFO("[%s] Loading the new firmware image from FS ...\n\r", __func__);
+        fw_errors = StreamFwImage(FW_LATEST_LOC, &fw_latest_ver, SparseImage::DataHandler, &fw_image);
+        if ((fw_errors == FW_IMAGE_OK) && (fw_image.Overflow() || (fw_image.GetPageCount() == 0))) {
+            fw_errors = IHEX_ERR_OVERFLOW;
+        }
     } else {
+        LOG_ERROR("[%s] No firmware [%s] image in FS!\n\r", __func__, new_version.c_str());
+        fw_errors = FW_IMAGE_ERR_FS;
+    }
+    if (fw_errors) {
         // ..................................................
-        // TWI device detected in the bus, creating an object for its address type
+        // There were errors parsing or loading the firmware, discarding the image
         // ..................................................
-        if (twi_address <= HIG_TML_ADDR) {
-            // ..................................................
-            // The address is in the 08-35 range, device running Timonel bootloader ...
-            // ..................................................
-            Serial.printf_P(", device running Timonel bootloader ...\n\r");
-            // Initialize Timonel object
-            p_timonel = new Timonel(twi_address, SDA, SCL);
-            p_timonel->GetStatus();
-            delay(125);
-            // Delete ATtiny85 onboard application
-            p_timonel->DeleteApplication();
-            delay(750);
-            p_timonel->GetStatus();
-            delay(125);
-            // Upload the new user application to the ATtiny85
-            USE_SERIAL.printf_P("[%s] Timonel bootloader uploading firmware to flash memory, \x1b[5mPLEASE WAIT\x1b[0m ...", __func__);
-            uint8_t errors = p_timonel->UploadApplication(payload, payload_size);
-            USE_SERIAL.printf_P("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
-            if (errors == 0) {
-                // ..................................................
-                // Application firmware loaded on the device
-                // ..................................................
-                USE_SERIAL.printf_P("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b successful!                          \n\r");
-                // Move the firmware version file from "latest" to "onboard"
-                Rename(FW_LATEST_VER, FW_ONBOARD_VER);
-                // Move the firmware data file from "latest" to "onboard"
-                Rename(FW_LATEST_LOC, FW_ONBOARD_LOC);
-                // Reset the retry counter file
-                WriteFile(UPDATE_TRIES, "0");
-                // Run the user application
-                p_timonel->RunApplication();
-            } else {
-                // ..................................................
-                // There were errors uploading the new firmware
-                // ..................................................
-                USE_SERIAL.printf_P("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b error! (%d)                         \n\r", errors);
-                RetryRestart(UPDATE_TRIES, update_tries);
-            }
-            // Remove Timonel object
-            delete p_timonel;
-        } else {
-            // ..................................................
-            // The address is above bootloader range, running an user application ...
-            // ..................................................
-            Serial.printf_P(", device running an user application ...\n\r");
-            p_micro = new NbMicro(twi_address, SDA, SCL);
-            p_micro->TwiCmdXmit(RESETMCU, ACKRESET);
-            delay(250);
-            delete p_micro;
-            Serial.printf_P("[%s] The user application should be stopped by now, restarting master to begin the update ...\n\r", __func__);
-            delay(5000);
-            ESP.restart();
+        LOG_ERROR("Firmware file error! (%d)\n\r", fw_errors);
+        DeleteFile(FW_LATEST_LOC);
+        ota_arena.Release(arena_mark);
+        return fw_errors;
+    }
+    // Upload the new user application to the ATtiny85, page by page in address order. The slave
+    // was erased, so the uploader leaves out the blank pages (unless resuming a failed upload).
+    LOG_INFO("[%s] Timonel bootloader uploading firmware to flash memory, \x1b[5mPLEASE WAIT\x1b[0m ...", __func__);
+    // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+    PageUploader page_uploader(p_timonel);
+    SetFlashResume(&page_uploader, &new_version, resume_address);
+    TimingSpan upload_span;
+    ota_timing.Begin(&upload_span, TIMING_UPLOAD);
+    for (uint8_t run_ix = 0; run_ix < fw_image.GetRunCount(); run_ix++) {
+        const IHexPageRun *p_run = fw_image.GetRun(run_ix);
+        for (uint16_t page_ix = 0; page_ix < p_run->page_count; page_ix++) {
+            uint32_t page_address = p_run->address + (uint32_t)page_ix * TML_PAGE_SIZE;
+            page_uploader.Write(page_address, fw_image.GetPage(page_address), TML_PAGE_SIZE);  // Flash device >>>
         }
     }
+    uint8_t errors = page_uploader.Finish();
+    ota_timing.End(&upload_span);
+    // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+    LOG_INFO("\n\r");
+    ReportSkippedPages(&page_uploader, false);
+    ReportUploadRates(&page_uploader, &p_timonel, 1);
+    if (errors) {
+        SaveFlashProgress(new_version, &page_uploader);
+    }
+    ota_arena.Release(arena_mark);
+    return errors;
+}
+
+/*  ________________________________
+   |                                | 
+   |     DownloadPackedFirmware     |
+   |________________________________|
+*/
+// Downloads the packed image of a version, handing the decoded firmware to a data handler and
+// saving the image as it arrives. *p_found is false if the server has no packed image, so the
+// caller can fall back to the Intel Hex file. Returns the firmware errors.
+uint8_t DownloadPackedFirmware(String new_version, IHexDataHandler data_handler, void *context, bool *p_found) {
+    String url = FW_WEB_URL "/firmware-" + new_version + FW_PACKED_EXT;
+    FwImageStream image_stream;
+    image_stream.BeginStream(FW_LATEST_LOC, new_version, data_handler, context);
+    int http_status = 0;
+    uint8_t fw_errors = DownloadFwImageFile(SSID, PASS, WEB_HOST, WEB_PORT, FINGERPRINT, url, &image_stream, &http_status);
+    *p_found = (http_status != HTTP_STATUS_NOT_FOUND);
+    if (!*p_found) {
+        LOG_WARN("[%s] No packed firmware file on the server, getting the Intel Hex one ...\n\r", __func__);
+    } else if (fw_errors == FW_IMAGE_OK) {
+        update_journal.SetDownloaded(new_version, image_stream.GetCrc32());
+    }
+    return fw_errors;
 }
 
 /*  __________________________
@@ -269,37 +1062,286 @@ void FlashTwiDevice(uint8_t payload[], uint16_t payload_size, uint8_t update_tri
    |__________________________|
 */
 void StartApplication(void) {
-    uint8_t twi_address = 0;
-    TwiBus twi_bus(SDA, SCL);
-    twi_address = twi_bus.ScanBus();
+    uint8_t twi_address = twi_registry.Locate();
     if (twi_address < LOW_TML_ADDR) {
-        Serial.printf_P("[%s] Invalid device TWI address detected (%d), probably a power-cycle would help ...\n\r", __func__, twi_address);
+        LOG_WARN("[%s] Invalid device TWI address detected (%d), probably a power-cycle would help ...\n\r", __func__, twi_address);
     } else {
         if (twi_address <= HIG_TML_ADDR) {
-            Serial.printf_P("[%s] Timonel TWI address detected (%d), trying to start the user application ...\n\r", __func__, twi_address);
+            LOG_INFO("[%s] Timonel TWI address detected (%d), trying to start the user application ...\n\r", __func__, twi_address);
             Timonel timonel(twi_address, SDA, SCL);
             timonel.GetStatus();
-            delay(125);
-            timonel.GetStatus();
-            delay(125);            
             timonel.RunApplication();
+            twi_registry.SetRole(TWI_ROLE_APPLICATION);
         } else {
-            Serial.printf_P("[%s] Application TWI address detected (%d), letting it run ...\n\r", __func__, twi_address);
+            LOG_INFO("[%s] Application TWI address detected (%d), letting it run ...\n\r", __func__, twi_address);
+        }
+    }
+}
+
+#if MULTI_TARGET_FLASHING
+/*  _______________________
+   |                       | 
+   |     RunFleetState     |
+   |_______________________|
+*/
+// Multi-target states: every slave on the bus is flashed with the same firmware. All slaves erase
+// at the same time and each page goes to all of them at once. Every device keeps its own retry
+// counter, and the ones that fail are retried in-process, without resetting the master.
+void RunFleetState(OtaContext *p_ota, unsigned long state_elapsed) {
+    switch (p_ota->state) {
+        case OTA_FLEET_RESET: {
+            // ..................................................
+            // Resetting every slave application into its bootloader
+            // ..................................................
+            p_ota->reset_count = ResetTwiApplications();
+            SetOtaState(p_ota, OTA_FLEET_DISCOVER);
+            break;
         }
+        case OTA_FLEET_DISCOVER: {
+            // ..................................................
+            // Polling until every reset application reappears as a bootloader
+            // ..................................................
+            if (state_elapsed >= p_ota->poll_count * TML_POLL_INTERVAL) {
+                p_ota->poll_count++;
+                uint8_t addresses[MAX_UPLOAD_TARGETS];
+                uint8_t target_count = ScanTwiRange(addresses, MAX_UPLOAD_TARGETS, LOW_TML_ADDR, HIG_TML_ADDR);
+                if ((target_count < p_ota->reset_count) && (state_elapsed <= TML_READY_TIMEOUT)) {
+                    break;
+                }
+                p_ota->target_count = LoadTwiTargets(p_ota->targets, addresses, target_count);
+                if (p_ota->target_count == 0) {
+                    LOG_ERROR("[%s] No Timonel device detected on the bus, probably a power-cycle would help ...\n\r", __func__);
+                    SetOtaState(p_ota, OTA_IDLE);
+                    break;
+                }
+                // The onboard image can't be a delta base once the applications are deleted
+                update_journal.BeginFlash(1);
+                p_ota->attempt = 0;
+                SetOtaState(p_ota, OTA_FLEET_ERASE);
+            }
+            break;
+        }
+        case OTA_FLEET_ERASE: {
+            // ..................................................
+            // Starting the erases of the round back to back, they run at the same time
+            // ..................................................
+            p_ota->round_count = 0;
+            for (uint8_t target_ix = 0; (target_ix < p_ota->target_count) && (p_ota->attempt < MAX_UPDATE_TRIES); target_ix++) {
+                TwiTarget *p_target = &p_ota->targets[target_ix];
+                if (!p_target->updated && (p_target->update_tries < MAX_UPDATE_TRIES)) {
+                    p_ota->round_ixs[p_ota->round_count] = target_ix;
+                    p_ota->p_timonels[p_ota->round_count++] = new Timonel(p_target->address, SDA, SCL);
+                }
+            }
+            if (p_ota->round_count == 0) {
+                SetOtaState(p_ota, OTA_FLEET_REPORT);
+                break;
+            }
+            LOG_INFO("[%s] Attempt %d, flashing %d device(s) ...\n\r", __func__, p_ota->attempt + 1, p_ota->round_count);
+            // The attempts count from here, even if the master resets during them
+            for (uint8_t ix = 0; ix < p_ota->round_count; ix++) {
+                p_ota->targets[p_ota->round_ixs[ix]].update_tries++;
+            }
+            SaveTwiTargetTries(p_ota);
+            for (uint8_t ix = 0; ix < p_ota->round_count; ix++) {
+                p_ota->p_timonels[ix]->GetStatus();
+            }
+            ota_timing.Begin(&p_ota->erase_span, TIMING_ERASE);
+            for (uint8_t ix = 0; ix < p_ota->round_count; ix++) {
+                p_ota->p_timonels[ix]->DeleteApplication();
+            }
+            p_ota->ready_mask = 0;
+            SetOtaState(p_ota, OTA_FLEET_WAIT_READY);
+            break;
+        }
+        case OTA_FLEET_WAIT_READY: {
+            // ..................................................
+            // Polling every bootloader of the round until it answers again
+            // ..................................................
+            if (state_elapsed >= p_ota->poll_count * TML_POLL_INTERVAL) {
+                p_ota->poll_count++;
+                uint8_t round_mask = (1 << p_ota->round_count) - 1;
+                for (uint8_t ix = 0; ix < p_ota->round_count; ix++) {
+                    if (!(p_ota->ready_mask & (1 << ix)) && TimonelReady(p_ota->p_timonels[ix], p_ota->targets[p_ota->round_ixs[ix]].address)) {
+                        p_ota->ready_mask |= (1 << ix);
+                    }
+                }
+                // A bootloader still not answering fails its page writes
+                if ((p_ota->ready_mask == round_mask) || (state_elapsed > TML_READY_TIMEOUT)) {
+                    ota_timing.End(&p_ota->erase_span);
+                    SetOtaState(p_ota, OTA_FLEET_FLASH);
+                }
+            }
+            break;
+        }
+        case OTA_FLEET_FLASH: {
+            // ..................................................
+            // Sending the new firmware to every slave of the round
+            // ..................................................
+            FlashTwiFleet(p_ota);
+            p_ota->attempt++;
+            SetOtaState(p_ota, OTA_FLEET_ERASE);
+            break;
+        }
+        case OTA_FLEET_REPORT: {
+            // ..................................................
+            // Recording the result of every slave, the failed ones get a new update check
+            // ..................................................
+            ReportTwiFleet(p_ota);
+            SetOtaState(p_ota, OTA_START_APP);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+/*  _______________________
+   |                       | 
+   |     FlashTwiFleet     |
+   |_______________________|
+*/
+// Flashes the round, the slaves updated run their new application at once
+void FlashTwiFleet(OtaContext *p_ota) {
+    ota_arena.Reset();
+    PageUploader page_uploader(p_ota->p_timonels, p_ota->round_count);
+    uint8_t upload_errors = 0;  // Counted per target below
+    uint8_t fw_errors = FeedFirmwarePages(p_ota->new_version, &page_uploader, &upload_errors);
+    ReportUploadRates(&page_uploader, p_ota->p_timonels, p_ota->round_count);
+    for (uint8_t ix = 0; ix < p_ota->round_count; ix++) {
+        TwiTarget *p_target = &p_ota->targets[p_ota->round_ixs[ix]];
+        p_target->errors = fw_errors + page_uploader.GetTargetErrors(ix);
+        if (p_target->errors == 0) {
+            p_target->updated = true;
+            p_target->update_tries = 0;
+            TimingSpan run_span;
+            ota_timing.Begin(&run_span, TIMING_RUN);
+            p_ota->p_timonels[ix]->RunApplication();
+            ota_timing.End(&run_span);
+        }
+    }
+    SaveTwiTargetTries(p_ota);
+    for (uint8_t ix = 0; ix < p_ota->round_count; ix++) {
+        delete p_ota->p_timonels[ix];
+        p_ota->p_timonels[ix] = nullptr;
+    }
+    p_ota->round_count = 0;
+}
+
+/*  ________________________
+   |                        | 
+   |     ReportTwiFleet     |
+   |________________________|
+*/
+// Per-device report, the new firmware only becomes the onboard one if every device got it
+void ReportTwiFleet(OtaContext *p_ota) {
+    uint8_t failed_count = 0;
+    for (uint8_t target_ix = 0; target_ix < p_ota->target_count; target_ix++) {
+        TwiTarget *p_target = &p_ota->targets[target_ix];
+        if (p_target->updated) {
+            LOG_INFO("[%s] Device %d: firmware %s flashed successfully\n\r", __func__, p_target->address, p_ota->new_version.c_str());
+        } else {
+            LOG_ERROR("[%s] Device %d: update failed after %d tries (%d errors), please power-cycle it!\n\r", __func__, p_target->address, p_target->update_tries, p_target->errors);
+            failed_count++;
+        }
+    }
+    // Either way every device count is cleared, as in the single device mode the next update
+    // check starts over
+    if (failed_count == 0) {
+        // The latest firmware becomes the onboard one
+        update_journal.CommitFlash();
+        fw_store.Add(FW_LATEST_LOC);
+        Rename(FW_LATEST_LOC, FW_ONBOARD_LOC);
+    } else {
+        update_journal.AbandonFlash();
+        DeleteFile(FW_LATEST_LOC);
+    }
+}
+
+/*  ____________________________
+   |                            | 
+   |     SaveTwiTargetTries     |
+   |____________________________|
+*/
+// The tries of every device in the round go into a single journal record
+void SaveTwiTargetTries(OtaContext *p_ota) {
+    uint8_t addresses[MAX_UPLOAD_TARGETS];
+    uint8_t update_tries[MAX_UPLOAD_TARGETS];
+    for (uint8_t ix = 0; ix < p_ota->round_count; ix++) {
+        TwiTarget *p_target = &p_ota->targets[p_ota->round_ixs[ix]];
+        addresses[ix] = p_target->address;
+        update_tries[ix] = p_target->update_tries;
+    }
+    update_journal.SetDeviceTries(addresses, update_tries, p_ota->round_count);
+}
+#endif  // MULTI_TARGET_FLASHING
+
+/*  _______________________
+   |                       | 
+   |     StartTwiFleet     |
+   |_______________________|
+*/
+void StartTwiFleet(void) {
+    uint8_t addresses[MAX_UPLOAD_TARGETS];
+    uint8_t device_count = ScanTwiRange(addresses, MAX_UPLOAD_TARGETS, LOW_TML_ADDR, HIG_TML_ADDR);
+    for (uint8_t ix = 0; ix < device_count; ix++) {
+        LOG_INFO("[%s] Timonel TWI address detected (%d), trying to start the user application ...\n\r", __func__, addresses[ix]);
+        Timonel timonel(addresses[ix], SDA, SCL);
+        timonel.GetStatus();
+        timonel.RunApplication();
     }
 }
 
+/*  ______________________________
+   |                              | 
+   |     ResetTwiApplications     |
+   |______________________________|
+*/
+// Resets every slave running an application into its bootloader, returns how many were reset
+uint8_t ResetTwiApplications(void) {
+    uint8_t addresses[MAX_UPLOAD_TARGETS];
+    uint8_t app_count = ScanTwiRange(addresses, MAX_UPLOAD_TARGETS, HIG_TML_ADDR + 1, HIG_APP_ADDR);
+    for (uint8_t ix = 0; ix < app_count; ix++) {
+        LOG_INFO("[%s] Device %d running an user application, resetting it ...\n\r", __func__, addresses[ix]);
+        NbMicro micro(addresses[ix], SDA, SCL);
+        micro.TwiCmdXmit(RESETMCU, ACKRESET);
+    }
+    return app_count;
+}
+
+/*  ________________________
+   |                        | 
+   |     LoadTwiTargets     |
+   |________________________|
+*/
+// Lists the bootloaders found as update targets, with the tries each one already had
+uint8_t LoadTwiTargets(TwiTarget targets[], const uint8_t addresses[], uint8_t target_count) {
+    for (uint8_t ix = 0; ix < target_count; ix++) {
+        targets[ix].address = addresses[ix];
+        targets[ix].update_tries = update_journal.GetDeviceTries(addresses[ix]);
+        targets[ix].errors = 0;
+        targets[ix].updated = false;
+        LOG_INFO("[%s] Timonel device %d ready (previous tries: %d)\n\r", __func__, addresses[ix], targets[ix].update_tries);
+    }
+    return target_count;
+}
+
 /*  ______________________
-   |                      |
-   |     RetryRestart     |
+   |                      | 
+   |     ScanTwiRange     |
    |______________________|
 */
-void RetryRestart(const char file_name[], uint8_t update_tries) {
-    update_tries++;
-    Serial.printf_P("[%s] Saving [%d] to retry counter and resetting ...\n\r", __func__, update_tries);
-    WriteFile(file_name, (String)update_tries);
-    delay(3000);
-    ESP.restart();
+uint8_t ScanTwiRange(uint8_t addresses[], uint8_t max_count, uint8_t low_address, uint8_t high_address) {
+    uint8_t device_count = 0;
+    Wire.begin(SDA, SCL);
+    for (uint8_t twi_address = low_address; (twi_address <= high_address) && (device_count < max_count); twi_address++) {
+        Wire.beginTransmission(twi_address);
+        if (Wire.endTransmission() == 0) {
+            addresses[device_count++] = twi_address;
+        }
+    }
+    return device_count;
 }
 
 /*  ______________________
@@ -325,50 +1367,282 @@ String GetHttpDocument(const char ssid[],
                        const int port,
                        const char fingerprint[],
                        String url,
-                       char terminator) {
+                       char terminator,
+                       HttpValidators *p_validators,
+                       int *p_http_status) {
+    int http_status = 0;
+    if (p_http_status != nullptr) {
+        *p_http_status = http_status;
+    }
+    if (!ConnectWiFi(ssid, password)) {
+        return "";
+    }
+    // The TLS session of the previous request is resumed
+    String http_string = "";
+    SecureClient &client = secure_client;
+    http_status = RequestHttpDocument(client, host, port, fingerprint, url, p_validators);
+    if (p_http_status != nullptr) {
+        *p_http_status = http_status;
+    }
+    if (http_status == HTTP_STATUS_OK) {
+        // The body is read until it ends, not until a stream timeout
+        HttpText http_text;
+        http_text.terminator = terminator;
+        ReceiveHttpBody(client, AppendHttpText, &http_text);
+        http_string = http_text.text;
+    }
+    client.stop();
+    if (http_status == HTTP_STATUS_NOT_MODIFIED) {
+        LOG_INFO("[%s] HTTP document not modified ...\n\r", __func__);
+    } else if (http_string != "") {
+        LOG_INFO("[%s] HTTP data received via WiFi ...\n\r", __func__);
+    } else {
+        LOG_ERROR("[%s] No HTTP data received via WiFi! (%d)\n\r", __func__, http_status);
+    }
+    // The WiFi association is kept between polls
+    return http_string;
+}
+
+/*  _____________________
+   |                     |
+   |     ConnectWiFi     |
+   |_____________________|
+*/
+// The state machine associates in OTA_CONNECT_WIFI, this only waits when the association was
+// lost in the middle of an update. Returns false after WIFI_CONNECT_TIMEOUT.
+bool ConnectWiFi(const char ssid[], const char password[]) {
+    if (WiFi.status() == WL_CONNECTED) {
+        return true;  // Still associated since the last request
+    }
     // " <<< Wifi connection "
+    TimingSpan wifi_span;
+    ota_timing.Begin(&wifi_span, TIMING_WIFI);
     WiFi.mode(WIFI_STA);
     WiFi.begin(ssid, password);
-    Serial.printf_P("[%s] Opening WiFi connection ", __func__);
+    LOG_INFO("[%s] Opening WiFi connection ", __func__);
+    unsigned long connect_start = millis();
     while (WiFi.status() != WL_CONNECTED) {
-        delay(1000);
-        Serial.printf_P(".");
+        if (millis() - connect_start >= WIFI_CONNECT_TIMEOUT) {
+            LOG_INFO("\n\r");
+            LOG_ERROR("[%s] No WiFi connection after %lu ms!\n\r", __func__, WIFI_CONNECT_TIMEOUT);
+            return false;
+        }
+        delay(WIFI_POLL_INTERVAL);
+        LOG_INFO(".");
     }
-    Serial.printf_P("\n\r");
-    //Serial.printf_P("[%s] WiFi connected! IP address: %s\n\r", __func__, WiFi.localIP().toString().c_str());
+    ota_timing.End(&wifi_span);
+    LOG_INFO("\n\r");
+    LOG_DEBUG("[%s] WiFi connected! IP address: %s\n\r", __func__, WiFi.localIP().toString().c_str());
     // " WiFi connection >>> "
-    // Use WiFiClientSecure class to create TLS connection
-    String http_string = "";
-    WiFiClientSecure client;
-    Serial.printf_P("[%s] Connecting to web site: %s\n\r", __func__, host);
-    //Serial.printf_P(" with fingerprint: %s\n\r", fingerprint);
-    client.setFingerprint(fingerprint);
-    if (!client.connect(host, port)) {
-        Serial.printf_P("[%s] HTTP connection failed!\n\r", __func__);
+    return true;
+}
+
+/*  _____________________________
+   |                             |
+   |     RequestHttpDocument     |
+   |_____________________________|
+*/
+// Sends the GET request and reads the response headers, leaving the client at the start of the
+// body. With validators, the request is conditional and they are updated from the response.
+// Returns the HTTP status code, 0 if the connection failed.
+int RequestHttpDocument(SecureClient &client,
+                        const char host[],
+                        const int port,
+                        const char fingerprint[],
+                        String url,
+                        HttpValidators *p_validators) {
+    LOG_INFO("[%s] Connecting to web site: %s\n\r", __func__, host);
+    LOG_DEBUG("[%s] Server fingerprint: %s\n\r", __func__, fingerprint);
+    TimingSpan request_span;
+    ota_timing.Begin(&request_span, TIMING_TLS);
+    bool connected = client.Connect(host, port, fingerprint);
+    ota_timing.End(&request_span);  // A failed handshake is timed too
+    if (!connected) {
+        LOG_ERROR("[%s] HTTP connection failed!\n\r", __func__);
         // Connection error!
+        return 0;
+    }
+    LOG_DEBUG("[%s] URL Request: %s\n\r", __func__, url.c_str());
+    String request = String("GET ") + url + " HTTP/1.1\r\n" +
+                     "Host: " + host + "\r\n" +
+                     "User-Agent: TimonelTwiMOtaESP8266\r\n";
+    if (p_validators != nullptr) {
+        if (p_validators->etag != "") {
+            request += "If-None-Match: " + p_validators->etag + "\r\n";
+        }
+        if (p_validators->last_modified != "") {
+            request += "If-Modified-Since: " + p_validators->last_modified + "\r\n";
+        }
+        p_validators->not_modified = false;
+    }
+    ota_timing.Begin(&request_span, TIMING_HEADERS);
+    client.print(request + "Connection: close\r\n\r\n");
+    LOG_DEBUG("[%s] Request sent ...\n\r", __func__);
+    // Status line: "HTTP/1.1 200 OK"
+    String line = client.readStringUntil('\n');
+    int http_status = line.substring(9, 12).toInt();
+    if ((p_validators != nullptr) && (http_status != HTTP_STATUS_NOT_MODIFIED)) {
+        // Validators that don't come with this response are no longer valid
+        p_validators->etag = "";
+        p_validators->last_modified = "";
     }
-    //Serial.printf_P("[%s] URL Request: %s\n\r", __func__, url.c_str());
-    client.print(String("GET ") + url + " HTTP/1.1\r\n" +
-                 "Host: " + host + "\r\n" +
-                 "User-Agent: TimonelTwiMOtaESP8266\r\n" +
-                 "Connection: close\r\n\r\n");
-    //Serial.printf_P("[%s] Request sent ...\n\r", __func__);
-    while (client.connected()) {
-        String line = client.readStringUntil('\n');
-        if (line == "\r") {
-            //Serial.printf_P("[%s] Headers received ...\n\r", __func__);
+    while (client.connected() || client.available()) {
+        line = client.readStringUntil('\n');
+        if ((line == "\r") || (line == "")) {
+            LOG_DEBUG("[%s] Headers received ...\n\r", __func__);
             break;
         }
+        if ((p_validators != nullptr) && (http_status == HTTP_STATUS_OK)) {
+            int colon = line.indexOf(':');
+            String value = line.substring(colon + 1);
+            value.trim();
+            if (line.substring(0, colon).equalsIgnoreCase("ETag")) {
+                p_validators->etag = value;
+            } else if (line.substring(0, colon).equalsIgnoreCase("Last-Modified")) {
+                p_validators->last_modified = value;
+            }
+        }
     }
-    http_string = client.readStringUntil(terminator);
-    if (http_string != "") {
-        Serial.printf_P("[%s] HTTP data received via WiFi ...\n\r", __func__);
-    } else {
-        Serial.printf_P("[%s] No HTTP data received via WiFi!\n\r", __func__);
+    if ((p_validators != nullptr) && (http_status == HTTP_STATUS_NOT_MODIFIED)) {
+        p_validators->not_modified = true;
     }
-    WiFi.disconnect();
-    //Serial.printf_P("[%s] WiFi disconnected!\n\r", __func__);
-    return http_string;
+    ota_timing.End(&request_span);
+    return http_status;
+}
+
+/*  __________________________
+   |                          |
+   |     DownloadIHexFile     |
+   |__________________________|
+*/
+// Streams an Intel Hex file body into the parser, chunk by chunk
+uint8_t DownloadIHexFile(const char ssid[],
+                         const char password[],
+                         const char host[],
+                         const int port,
+                         const char fingerprint[],
+                         String url,
+                         HexParser *p_hex_parser) {
+    uint32_t bytes_received = 0;
+    SecureClient &client = secure_client;
+    if (ConnectWiFi(ssid, password) && (RequestHttpDocument(client, host, port, fingerprint, url) == HTTP_STATUS_OK)) {
+        bytes_received = ReceiveHttpBody(client, FeedHexParser, p_hex_parser);
+    }
+    client.stop();
+    uint8_t errors = p_hex_parser->EndStream();
+    LOG_INFO("[%s] %u bytes received via WiFi, %u firmware bytes decoded ...\n\r", __func__, (unsigned int)bytes_received, (unsigned int)p_hex_parser->GetStreamDataSize());
+    return errors;
+}
+
+/*  _____________________________
+   |                             |
+   |     DownloadFwImageFile     |
+   |_____________________________|
+*/
+// Streams a packed image file body into the image stream, chunk by chunk. *p_http_status is set
+// to the response status code, 0 if the connection failed.
+uint8_t DownloadFwImageFile(const char ssid[],
+                            const char password[],
+                            const char host[],
+                            const int port,
+                            const char fingerprint[],
+                            String url,
+                            FwImageStream *p_image_stream,
+                            int *p_http_status) {
+    uint32_t bytes_received = 0;
+    SecureClient &client = secure_client;
+    *p_http_status = ConnectWiFi(ssid, password) ? RequestHttpDocument(client, host, port, fingerprint, url) : 0;
+    if (*p_http_status == HTTP_STATUS_OK) {
+        bytes_received = ReceiveHttpBody(client, FeedFwImageStream, p_image_stream);
+    }
+    client.stop();
+    uint8_t errors = p_image_stream->EndStream();
+    if (*p_http_status == HTTP_STATUS_OK) {
+        LOG_INFO("[%s] %u bytes received via WiFi, %u firmware bytes decoded ...\n\r", __func__, (unsigned int)bytes_received, (unsigned int)p_image_stream->GetStreamDataSize());
+    }
+    return errors;
+}
+
+/*  _________________________
+   |                         |
+   |     ReceiveHttpBody     |
+   |_________________________|
+*/
+// Reads the response body, after RequestHttpDocument, handing it to the body handler chunk by
+// chunk until it has all it needs, the connection closes or no data comes for HTTP_BODY_TIMEOUT.
+// A LAN client's request body is read the same way. Returns the bytes received.
+uint32_t ReceiveHttpBody(WiFiClient &client, HttpBodyHandler body_handler, void *context) {
+    size_t arena_mark = ota_arena.GetMark();
+    uint8_t *chunk = (uint8_t *)ota_arena.Allocate(HTTP_BODY_CHUNK);
+    if (chunk == nullptr) {
+        return 0;
+    }
+    uint32_t bytes_received = 0;
+    bool body_complete = false;
+    // The body span takes the network time only: parsing, and any flashing it triggers, are
+    // spans of their own that end inside it
+    TimingSpan body_span;
+    TimingSpan parse_span;
+    ota_timing.Begin(&body_span, TIMING_BODY);
+    ota_timing.Begin(&parse_span, TIMING_PARSE);
+    ota_timing.Pause(&parse_span);
+    unsigned long data_time = millis();
+    while ((client.connected() || client.available()) && !body_complete && (millis() - data_time < HTTP_BODY_TIMEOUT)) {
+        int available = client.available();
+        if (available > 0) {
+            size_t chunk_len = client.readBytes(chunk, (available < HTTP_BODY_CHUNK) ? available : HTTP_BODY_CHUNK);
+            ota_timing.Resume(&parse_span);
+            body_complete = body_handler(chunk, chunk_len, context);
+            ota_timing.Pause(&parse_span);
+            bytes_received += chunk_len;
+            data_time = millis();
+        } else {
+            if (http_idle_handler != nullptr) {
+                ota_timing.Resume(&parse_span);
+                http_idle_handler(http_idle_context);
+                ota_timing.Pause(&parse_span);
+            }
+            LOG_DRAIN();
+            delay(1);  // Let the WiFi stack run while waiting for more data
+        }
+    }
+    ota_timing.End(&parse_span);
+    ota_timing.End(&body_span);
+    ota_arena.Release(arena_mark);
+    return bytes_received;
+}
+
+// Function SetHttpIdleHandler (no handler: nothing is done while waiting for data)
+void SetHttpIdleHandler(HttpIdleHandler idle_handler, void *context) {
+    http_idle_handler = idle_handler;
+    http_idle_context = context;
+}
+
+// Function AppendHttpText (HttpBodyHandler adapter, context is the HttpText)
+// The text ends at its terminator or at HTTP_DOCUMENT_MAX bytes, the rest of the body isn't read
+bool AppendHttpText(const uint8_t data[], size_t length, void *context) {
+    HttpText *p_text = (HttpText *)context;
+    for (size_t ix = 0; ix < length; ix++) {
+        if (((p_text->terminator != '\0') && (data[ix] == p_text->terminator)) || (p_text->text.length() >= HTTP_DOCUMENT_MAX)) {
+            return true;
+        }
+        p_text->text += (char)data[ix];
+    }
+    return false;
+}
+
+// Function FeedHexParser (HttpBodyHandler adapter, context is the HexParser)
+bool FeedHexParser(const uint8_t data[], size_t length, void *context) {
+    HexParser *p_hex_parser = (HexParser *)context;
+    p_hex_parser->FeedStream(data, length);
+    return p_hex_parser->StreamComplete();
+}
+
+// Function FeedFwImageStream (HttpBodyHandler adapter, context is the FwImageStream)
+bool FeedFwImageStream(const uint8_t data[], size_t length, void *context) {
+    FwImageStream *p_image_stream = (FwImageStream *)context;
+    p_image_stream->FeedStream(data, length);
+    return p_image_stream->StreamComplete();
 }
 
 /*  __________________
@@ -377,26 +1651,12 @@ String GetHttpDocument(const char ssid[],
    |__________________|
 */
 String ReadFile(const char file_name[]) {
-    String file_data = "";
-    if (SPIFFS.begin()) {
-        //Serial.printf_P("[%s] SPIFFS filesystem mounted ...\n\r", __func__);
-    } else {
-        Serial.printf_P("[%s] Error mounting the SPIFFS file system\n\r", __func__);
-        // Mount error!
-    }
-    File file = SPIFFS.open(file_name, "r");
-    //Serial.printf_P("[%s] Reading \"%s\" file\n\r", __func__, file_name);
-    if (file && file.size()) {
-        while (file.available()) {
-            file_data += char(file.read());
-        }
-        file.close();
-        //Serial.printf_P("%s\n\r", file_data.c_str());
-    } else {
-        Serial.printf_P("[%s] Warning: File \"%s\" empty or unavailable!\n\r", __func__, file_name);
+    String file_data = fs_session.ReadFile(file_name);
+    LOG_DEBUG("[%s] Reading \"%s\" file\n\r", __func__, file_name);
+    if (file_data == "") {
+        LOG_WARN("[%s] Warning: File \"%s\" empty or unavailable!\n\r", __func__, file_name);
     }
     return file_data;
-    SPIFFS.end();
 }
 
 /*  ___________________
@@ -406,30 +1666,12 @@ String ReadFile(const char file_name[]) {
 */
 uint8_t WriteFile(const char file_name[], const String file_data) {
     uint8_t errors = 0;
-    if (SPIFFS.begin()) {
-        //Serial.printf_P("[%s] SPIFFS filesystem mounted ...\n\r", __func__);
-    } else {
-        Serial.printf_P("[%s] Error mounting the SPIFFS file system!\n\r", __func__);
-        errors += 1;
-        // Mount error!
-    }
-    // Save file data into the filesystem
-    File file = SPIFFS.open(file_name, "w");
-    if (!file) {
-        Serial.printf_P("[%s] Error opening file for writing!\n\r", __func__);
-        errors += 2;
-        // File opening error!
-    }
-    //Serial.printf_P("[%s] Writing \"%s\" file ...\n\r", __func__, file_name);
-    uint16 bytes_written = file.print(file_data);
-    if (bytes_written > 0) {
-        //Serial.printf_P("[%s] File write successful (%d bytes saved) ...\n\r", __func__, bytes_written);
-    } else {
-        Serial.printf_P("[%s] \"%s\" file writing failed!\n\r", __func__, file_name);
+    LOG_DEBUG("[%s] Writing \"%s\" file ...\n\r", __func__, file_name);
+    if (!fs_session.WriteFile(file_name, file_data)) {
+        LOG_ERROR("[%s] \"%s\" file writing failed!\n\r", __func__, file_name);
         errors += 3;
         // File writing error!
     }
-    SPIFFS.end();
     return errors;
 }
 
@@ -440,20 +1682,12 @@ uint8_t WriteFile(const char file_name[], const String file_data) {
 */
 uint8_t DeleteFile(const char file_name[]) {
     uint8_t errors = 0;
-    if (SPIFFS.begin()) {
-        //Serial.printf_P("[%s] SPIFFS filesystem mounted ...\n\r", __func__);
-    } else {
-        Serial.printf_P("[%s] Error mounting the SPIFFS file system!\n\r", __func__);
-        errors += 1;
-        // Mount error!
-    }
-    errors += SPIFFS.remove(file_name);  // This allows overwriting
+    errors += fs_session.Remove(file_name);
     if (errors) {
-        //Serial.printf_P("[%s] File deleted successfully ...\n\r", __func__);
+        LOG_DEBUG("[%s] File \"%s\" deleted successfully ...\n\r", __func__, file_name);
     } else {
-        Serial.printf_P("[%s] File \"%s\" deleting failed!\n\r", __func__, file_name);
+        LOG_ERROR("[%s] File \"%s\" deleting failed!\n\r", __func__, file_name);
     }
-    SPIFFS.end();
     return errors;
 }
 
@@ -464,19 +1698,16 @@ uint8_t DeleteFile(const char file_name[]) {
 */
 uint8_t ListFiles(void) {
     uint8_t errors = 0;
-    if (SPIFFS.begin()) {
-        //Serial.printf_P("[%s] SPIFFS filesystem mounted ...\n\r", __func__);
-    } else {
-        Serial.printf_P("[%s] Error mounting the SPIFFS file system!\n\r", __func__);
+    if (!fs_session.Mount()) {
         errors += 1;
         // Mount error!
+        return errors;
     }
-    //Serial.printf_P("[%s] Listing all filesystem files ...\n\r", __func__);
-    Dir dir = SPIFFS.openDir("");
+    LOG_DEBUG("[%s] Listing all filesystem files ...\n\r", __func__);
+    Dir dir = OTA_FS.openDir("/");
     while (dir.next()) {
-        Serial.printf("|-- %s - %d bytes\n\r", dir.fileName().c_str(), (int)dir.fileSize());
+        LOG_INFO("|-- %s - %d bytes\n\r", dir.fileName().c_str(), (int)dir.fileSize());
     }
-    SPIFFS.end();
     return errors;
 }
 
@@ -488,19 +1719,11 @@ uint8_t ListFiles(void) {
 */
 uint8_t Format(void) {
     uint8_t errors = 0;
-    if (SPIFFS.begin()) {
-        //Serial.printf_P("[%s] SPIFFS filesystem mounted ...\n\r", __func__);
-    } else {
-        Serial.printf_P("[%s] Error mounting the SPIFFS file system!\n\r", __func__);
+    LOG_INFO("[%s] Formatting the filesystem ...\n\r", __func__);
+    if (!fs_session.Format()) {
         errors += 1;
-        // Mount error!
-    }
-    Serial.printf_P("[%s] Formatting the SPIFFS filesystem ...\n\r", __func__);
-    errors += SPIFFS.format();
-    if (errors) {
-        Serial.printf_P("[%s] Error: Unable to format the filesystem!\n\r", __func__);
+        LOG_ERROR("[%s] Error: Unable to format the filesystem!\n\r", __func__);
     }
-    SPIFFS.end();
     return errors;
 }
 
@@ -512,34 +1735,18 @@ uint8_t Format(void) {
 // If destination exists, overwrites it
 uint8_t Rename(const char source_file_name[], const char destination_file_name[]) {
     uint8_t errors = 0;
-    if (SPIFFS.begin()) {
-        //Serial.printf_P("[%s] SPIFFS filesystem mounted ...\n\r", __func__);
-    } else {
-        Serial.printf_P("[%s] Error mounting the SPIFFS file system!\n\r", __func__);
-        errors += 1;
-        // Mount error!
-    }
-    SPIFFS.remove(destination_file_name);  // This allows overwriting
-    errors += SPIFFS.rename(source_file_name, destination_file_name);
+    errors += fs_session.Rename(source_file_name, destination_file_name);
     if (errors) {
-        //Serial.printf_P("[%s] File renamed successfully ...\n\r", __func__);
+        LOG_DEBUG("[%s] File renamed successfully ... (%s to %s)\n\r", __func__, source_file_name, destination_file_name);
     } else {
-        Serial.printf_P("[%s] File renaming failed! (%s to %s)\n\r", __func__, source_file_name, destination_file_name);
+        LOG_ERROR("[%s] File renaming failed! (%s to %s)\n\r", __func__, source_file_name, destination_file_name);
     }
-    SPIFFS.end();
     return errors;
 }
 
-// Function Exists (If destination exists, overwrites it)
+// Function Exists
 bool Exists(const char file_name[]) {
-    if (SPIFFS.begin()) {
-        //Serial.printf_P("[%s] SPIFFS filesystem mounted ...\n\r", __func__);
-    } else {
-        Serial.printf_P("[%s] Error mounting the SPIFFS file system!\n\r", __func__);
-        // Mount error!
-    }
-    return SPIFFS.exists(file_name);
-    SPIFFS.end();
+    return fs_session.Exists(file_name);
 }
 
 /*  _________________________
@@ -547,42 +1754,9 @@ bool Exists(const char file_name[]) {
    |     ParseIHexFormat     |
    |_________________________|
 */
-bool ParseIHexFormat(String serialized_file, uint8_t *payload) {
-    uint16_t file_len = serialized_file.length();
-    uint16_t payload_ix = 0;
-    uint8_t line_count = 0;
-    bool checksum_err = false;
-    // Loops through the serialized file
-    for (int ix = 0; ix < file_len; ix++) {
-        // If a record start is detected
-        if (serialized_file.charAt(ix) == IHEX_START_CODE) {
-            uint8_t byte_count = strtoul(serialized_file.substring(ix + 1, ix + 3).c_str(), 0, 16);
-            uint16_t address = strtoul(serialized_file.substring(ix + 3, ix + 7).c_str(), 0, 16);
-            uint8_t record_type = strtoul(serialized_file.substring(ix + 7, ix + 9).c_str(), 0, 16);
-            uint8_t checksum = strtoul(serialized_file.substring(ix + 9 + (byte_count << 1), ix + 11 + (byte_count << 1)).c_str(), 0, 16);
-            // Serial.printf_P("\rix: %d line len: %d type: %d check: %d\n\r", ix, byte_count, record_type, checksum);
-            if (record_type == 0) {
-                uint8_t record_check = 0;
-                // Serial.printf_P("%02d) [%04X] ", line_count++, address);
-                for (int data_pos = ix + 9; data_pos < (ix + 9 + (byte_count << 1)); data_pos += 2) {
-                    uint8_t ihex_data = strtoul(serialized_file.substring(data_pos, data_pos + 2).c_str(), 0, 16);
-                    record_check += ihex_data;
-                    payload[payload_ix] = ihex_data;
-                    // Serial.printf_P(".%02X", ihex_data);
-                    payload_ix++;
-                }
-                record_check = (~((byte_count + ((address >> 8) & 0xFF) + (address & 0xFF) + record_type + record_check) & 0xFF)) + 1;
-                if (record_check != checksum) {
-                    // Serial.printf_P(" { %02X ERROR }", record_check);
-                    checksum_err = true;
-                } else {
-                    // Serial.printf_P(" { %02X }", record_check);
-                }
-                // Serial.printf_P("\n\r");
-            }
-        }
-    }
-    return checksum_err;
+bool ParseIHexFormat(String serialized_file, uint8_t *payload, size_t payload_capacity) {
+    HexParser hex_parser;
+    return hex_parser.ParseIHexFormat(serialized_file, payload, payload_capacity);
 }
 
 /*  _____________________
@@ -591,35 +1765,50 @@ bool ParseIHexFormat(String serialized_file, uint8_t *payload) {
    |_____________________|
 */
 uint16_t GetIHexSize(String serialized_file) {
-    uint16_t file_length = serialized_file.length();
-    uint16_t data_size = 0;
-    for (int ix = 0; ix < file_length; ix++) {
-        if (serialized_file.charAt(ix) == ':') {
-            uint8_t record_type = strtoul(serialized_file.substring(ix + 7, ix + 9).c_str(), 0, 16);
-            uint8_t byte_count = strtoul(serialized_file.substring(ix + 1, ix + 3).c_str(), 0, 16);
-            //uint8_t checksum = strtoul(serialized_file.substring(ix + 9 + (byte_count << 1), ix + 11 + (byte_count << 1)).c_str(), 0, 16);
-            if (record_type == 0) {
-                data_size += byte_count;
-            }
-        }
-    }
-    //Serial.printf_P("\r\n[%s] File length: %d\n\r", __func__, file_length);
-    //Serial.printf_P("[%s] Payload size: %d\n\r", __func__, data_size);
-    return data_size;
+    HexParser hex_parser;
+    return hex_parser.GetIHexSize(serialized_file);
 }
 
-/*  _____________________
-   |                     |
-   |     RotaryDelay     |
-   |_____________________|
+/*  ____________________
+   |                    |
+   |     RotarySpin     |
+   |____________________|
 */
-void RotaryDelay(void) {
-    USE_SERIAL.printf_P("\b\b| ");
-    delay(125);
-    USE_SERIAL.printf_P("\b\b/ ");
-    delay(125);
-    USE_SERIAL.printf_P("\b\b- ");
-    delay(125);
-    USE_SERIAL.printf_P("\b\b\\ ");
-    delay(125);
+// Advances the rotary cursor one step per call, without waiting
+void RotarySpin(void) {
+    static const char spinner[] = {'|', '/', '-', '\\'};
+    static uint8_t spin_ix = 0;
+    LOG_INFO("\b\b%c ", spinner[spin_ix++ & 0x03]);
+}
+
+/*  ____________________________
+   |                            |
+   |     CheckSerialCommand     |
+   |____________________________|
+*/
+// Handles the single-character serial console commands, without waiting for them
+void CheckSerialCommand(void) {
+    if (Serial.available() <= 0) {
+        return;
+    }
+    switch (Serial.read()) {
+        case CMD_TIMING_DUMP: {
+            // The dump is command output, it goes straight to the port after the pending log
+            LOG_FLUSH();
+            Serial.printf_P("\n\r");
+            ota_timing.WriteJson(Serial);
+            Serial.printf_P("\n\r");
+            ota_timing.SaveJson(TIMING_JSON);
+            break;
+        }
+        case CMD_TIMING_CLEAR: {
+            ota_timing.Clear();
+            ota_timing.Save();
+            LOG_INFO("\n\r[%s] Update timing histograms cleared ...\n\r", __func__);
+            break;
+        }
+        default: {
+            break;
+        }
+    }
 }
@@ -0,0 +1,135 @@
+/*
+  twi-registry.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  TWI device registry
+  ----------------------------------------------------------------------------
+*/
+
+#include "twi-registry.h"
+
+#include "fw-image.h"
+#include "ota-log.h"
+
+// Constructor (no slave seen yet)
+TwiRegistry::TwiRegistry(uint8_t sda, uint8_t scl) : sda_(sda), scl_(scl) {
+    memset(&device_, 0, sizeof(device_));
+}
+
+// Function Load (a missing or corrupt registry leaves the slave unknown, the first Locate() scans)
+bool TwiRegistry::Load(void) {
+    RegistryFile saved;
+    if ((fs_session.ReadBlock(TWI_REGISTRY_FILE, (uint8_t *)&saved, sizeof(saved)) != sizeof(saved)) ||
+        (saved.magic != TWI_REGISTRY_MAGIC) ||
+        (saved.crc32 != Crc32((const uint8_t *)&saved, offsetof(RegistryFile, crc32)))) {
+        return false;
+    }
+    device_ = saved.device;
+    return true;
+}
+
+// Function Locate
+// Returns the slave address in the role asked for, 0 if it doesn't answer in it. The last address
+// the slave answered at is probed first, then its address in the other role. With scan set, or
+// when the slave was never seen in that role, the bus is scanned if those probes fail: only the
+// Timonel range for a bootloader, the first one answering is recorded for the next polls.
+uint8_t TwiRegistry::Locate(TwiRole role, bool scan) {
+    bool last_tml = (device_.role == TWI_ROLE_BOOTLOADER);
+    uint8_t candidates[2] = {last_tml ? device_.tml_address : device_.app_address,
+                             last_tml ? device_.app_address : device_.tml_address};
+    bool known = false;
+    Wire.begin(sda_, scl_);
+    for (uint8_t ix = 0; ix < 2; ix++) {
+        uint8_t twi_address = candidates[ix];
+        if ((twi_address == 0) || ((role != TWI_ROLE_ANY) && (GetRole(twi_address) != role))) {
+            continue;
+        }
+        known = true;
+        if (Probe(twi_address)) {
+            Record(twi_address);
+            return twi_address;
+        }
+    }
+    if (known && !scan) {
+        return 0;
+    }
+    if (role == TWI_ROLE_BOOTLOADER) {
+        for (uint8_t twi_address = LOW_TML_ADDR; twi_address <= HIG_TML_ADDR; twi_address++) {
+            if (Probe(twi_address)) {
+                Record(twi_address);
+                return twi_address;
+            }
+        }
+        return 0;
+    }
+    scan_count_++;
+    TwiBus twi_bus(sda_, scl_);
+    uint8_t twi_address = twi_bus.ScanBus();
+    if (twi_address < LOW_TML_ADDR) {
+        return 0;
+    }
+    Record(twi_address);
+    return ((role == TWI_ROLE_ANY) || (GetRole(twi_address) == role)) ? twi_address : 0;
+}
+
+// Function SetRole
+// The slave was told to switch role (its application reset or started), the next Locate() probes
+// its address in that role first
+void TwiRegistry::SetRole(TwiRole role) {
+    uint8_t twi_address = (role == TWI_ROLE_BOOTLOADER) ? device_.tml_address : device_.app_address;
+    if (twi_address != 0) {
+        Record(twi_address);
+    }
+}
+
+// Function GetProbeCount
+uint32_t TwiRegistry::GetProbeCount(void) {
+    return probe_count_;
+}
+
+// Function GetScanCount
+uint32_t TwiRegistry::GetScanCount(void) {
+    return scan_count_;
+}
+
+// Function Probe (one addressed write with no data, true if the slave acknowledges it)
+bool TwiRegistry::Probe(uint8_t twi_address) {
+    probe_count_++;
+    Wire.beginTransmission(twi_address);
+    return (Wire.endTransmission() == 0);
+}
+
+// Function Record (the registry is only written when the slave address or role changed)
+void TwiRegistry::Record(uint8_t twi_address) {
+    TwiDevice device = device_;
+    device.role = GetRole(twi_address);
+    if (device.role == TWI_ROLE_BOOTLOADER) {
+        device.tml_address = twi_address;
+    } else {
+        device.app_address = twi_address;
+    }
+    if (memcmp(&device, &device_, sizeof(device)) != 0) {
+        device_ = device;
+        Save();
+    }
+}
+
+// Function Save
+bool TwiRegistry::Save(void) {
+    RegistryFile registry;
+    memset(&registry, 0, sizeof(registry));
+    registry.magic = TWI_REGISTRY_MAGIC;
+    registry.device = device_;
+    registry.crc32 = Crc32((const uint8_t *)&registry, offsetof(RegistryFile, crc32));
+    if (!fs_session.WriteBlock(TWI_REGISTRY_FILE, (const uint8_t *)&registry, sizeof(registry))) {
+        LOG_WARN("[%s] TWI device registry not saved!\n\r", __func__);
+        return false;
+    }
+    return true;
+}
+
+// Function GetRole
+TwiRole TwiRegistry::GetRole(uint8_t twi_address) {
+    return (twi_address <= HIG_TML_ADDR) ? TWI_ROLE_BOOTLOADER : TWI_ROLE_APPLICATION;
+}
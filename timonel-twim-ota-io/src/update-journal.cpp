@@ -0,0 +1,200 @@
+/*
+  update-journal.cpp
+  =====================
+  Timonel OTA Demo v2.0 HP
+  ----------------------------------------------------------------------------
+  Update state journal
+  ----------------------------------------------------------------------------
+*/
+
+#include "update-journal.h"
+
+#include "ota-log.h"
+
+UpdateJournal update_journal;  // Update state shared by the whole program
+
+static const char *const JOURNAL_SLOTS[2] = {JOURNAL_SLOT_A, JOURNAL_SLOT_B};
+
+// Constructor (an empty journal means an idle slave with unknown firmware)
+UpdateJournal::UpdateJournal() {
+    memset(&state_, 0, sizeof(state_));
+    state_.phase = JOURNAL_IDLE;
+}
+
+// Function Recover
+// Reads both slots once and keeps the newest intact record. Returns false if there is none.
+bool UpdateJournal::Recover(void) {
+    JournalRecord newest[2];
+    bool torn[2];
+    uint8_t records[2];
+    for (uint8_t slot = 0; slot < 2; slot++) {
+        records[slot] = ScanSlot(JOURNAL_SLOTS[slot], &newest[slot], &torn[slot]);
+    }
+    int8_t best_slot = -1;
+    for (uint8_t slot = 0; slot < 2; slot++) {
+        if ((records[slot] > 0) && ((best_slot < 0) || (newest[slot].sequence > newest[best_slot].sequence))) {
+            best_slot = slot;
+        }
+    }
+    if (best_slot < 0) {
+        return false;
+    }
+    state_ = newest[best_slot].state;
+    sequence_ = newest[best_slot].sequence;
+    active_slot_ = best_slot;
+    slot_records_ = records[best_slot];
+    slot_torn_ = torn[best_slot];
+    return true;
+}
+
+// Function GetState
+UpdateState UpdateJournal::GetState(void) {
+    return state_;
+}
+
+// Function Append
+// Makes a new state current with a single record write, an unchanged state writes nothing
+bool UpdateJournal::Append(const UpdateState &state) {
+    if ((sequence_ != 0) && (memcmp(&state, &state_, sizeof(state_)) == 0)) {
+        return true;
+    }
+    JournalRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = JOURNAL_MAGIC;
+    record.sequence = sequence_ + 1;
+    record.state = state;
+    record.state.onboard_version[FW_IMAGE_VER_LEN - 1] = '\0';
+    record.state.latest_version[FW_IMAGE_VER_LEN - 1] = '\0';
+    record.crc32 = Crc32((const uint8_t *)&record, offsetof(JournalRecord, crc32));
+    // A full slot, or one ending with a torn record, is left as it is and the other one restarted
+    bool switch_slot = (sequence_ == 0) || slot_torn_ || (slot_records_ >= JOURNAL_SLOT_RECORDS);
+    uint8_t slot = (sequence_ == 0) ? 0 : (switch_slot ? (active_slot_ ^ 1) : active_slot_);
+    if (!fs_session.WriteBlock(JOURNAL_SLOTS[slot], (const uint8_t *)&record, sizeof(record), !switch_slot)) {
+        LOG_WARN("[%s] Journal record %u not written!\n\r", __func__, record.sequence);
+        slot_torn_ = true;  // Whatever reached the slot is not appended to
+        return false;
+    }
+    state_ = record.state;
+    sequence_ = record.sequence;
+    slot_records_ = switch_slot ? 1 : slot_records_ + 1;
+    active_slot_ = slot;
+    slot_torn_ = false;
+    return true;
+}
+
+// Function SetDownloaded
+// A complete image of the latest firmware is in FS. Pages flashed from another image don't count.
+bool UpdateJournal::SetDownloaded(const String version, uint32_t image_crc) {
+    UpdateState state = state_;
+    if (state.phase == JOURNAL_IDLE) {
+        state.phase = JOURNAL_DOWNLOADED;
+    }
+    if (image_crc != state.latest_crc) {
+        state.flashed_end = 0;
+    }
+    strncpy(state.latest_version, version.c_str(), FW_IMAGE_VER_LEN - 1);
+    state.latest_version[FW_IMAGE_VER_LEN - 1] = '\0';
+    state.latest_crc = image_crc;
+    return Append(state);
+}
+
+// Function BeginFlash
+// Recorded before the slave flash changes: the attempt counts even if the master resets during it
+bool UpdateJournal::BeginFlash(uint8_t update_tries) {
+    UpdateState state = state_;
+    state.phase = JOURNAL_FLASHING;
+    state.update_tries = update_tries;
+    return Append(state);
+}
+
+// Function ConfirmFlash
+// The slave flash holds the latest image below an address, a later attempt can resume from there
+bool UpdateJournal::ConfirmFlash(uint16_t flashed_end) {
+    UpdateState state = state_;
+    state.phase = JOURNAL_FLASHING;
+    state.flashed_end = flashed_end;
+    return Append(state);
+}
+
+// Function CommitFlash (the latest firmware becomes the onboard one)
+bool UpdateJournal::CommitFlash(void) {
+    UpdateState state = state_;
+    state.phase = JOURNAL_IDLE;
+    state.update_tries = 0;
+    memset(state.device_tries, 0, JOURNAL_DEVICES);
+    state.flashed_end = 0;
+    memcpy(state.onboard_version, state.latest_version, FW_IMAGE_VER_LEN);
+    state.onboard_crc = state.latest_crc;
+    memset(state.latest_version, 0, FW_IMAGE_VER_LEN);
+    state.latest_crc = 0;
+    return Append(state);
+}
+
+// Function AbandonFlash
+// Retries exceeded: the latest image is dropped and the slave flash content is unknown
+bool UpdateJournal::AbandonFlash(void) {
+    UpdateState state = state_;
+    state.phase = JOURNAL_FLASHING;
+    state.update_tries = 0;
+    memset(state.device_tries, 0, JOURNAL_DEVICES);
+    state.flashed_end = 0;
+    memset(state.latest_version, 0, FW_IMAGE_VER_LEN);
+    state.latest_crc = 0;
+    return Append(state);
+}
+
+// Function GetDeviceTries (multi-target mode, 0 for an address outside the Timonel range)
+uint8_t UpdateJournal::GetDeviceTries(uint8_t twi_address) {
+    if ((twi_address < LOW_TML_ADDR) || (twi_address > HIG_TML_ADDR)) {
+        return 0;
+    }
+    return state_.device_tries[twi_address - LOW_TML_ADDR];
+}
+
+// Function SetDeviceTries
+// Multi-target mode: the attempts of several bootloaders go into a single record
+bool UpdateJournal::SetDeviceTries(const uint8_t twi_addresses[], const uint8_t update_tries[], uint8_t device_count) {
+    UpdateState state = state_;
+    for (uint8_t ix = 0; ix < device_count; ix++) {
+        if ((twi_addresses[ix] >= LOW_TML_ADDR) && (twi_addresses[ix] <= HIG_TML_ADDR)) {
+            state.device_tries[twi_addresses[ix] - LOW_TML_ADDR] = update_tries[ix];
+        }
+    }
+    return Append(state);
+}
+
+// Function GetSequence
+uint32_t UpdateJournal::GetSequence(void) {
+    return sequence_;
+}
+
+// Function ScanSlot
+// Returns the number of records in a slot, with the newest intact one. A slot ending with a
+// partial or corrupt record is flagged as torn.
+uint8_t UpdateJournal::ScanSlot(const char file_name[], JournalRecord *p_newest, bool *p_torn) {
+    uint8_t records = 0;
+    *p_torn = false;
+    if (!fs_session.Mount() || !OTA_FS.exists(file_name)) {
+        return records;
+    }
+    File file = OTA_FS.open(file_name, "r");
+    if (!file) {
+        return records;
+    }
+    uint8_t block[FS_BLOCK_SIZE];
+    BlockReader reader(file, block, FS_BLOCK_SIZE);
+    JournalRecord record;
+    size_t record_len;
+    while ((record_len = reader.ReadBlock((uint8_t *)&record, sizeof(record))) > 0) {
+        if ((record_len != sizeof(record)) || (record.magic != JOURNAL_MAGIC) ||
+            (Crc32((const uint8_t *)&record, offsetof(JournalRecord, crc32)) != record.crc32) ||
+            ((records > 0) && (record.sequence != p_newest->sequence + 1))) {
+            *p_torn = true;
+            break;
+        }
+        *p_newest = record;
+        records++;
+    }
+    file.close();
+    return records;
+}